@@ -279,7 +279,7 @@ int main() try
         const uint32_t index = win.begin();
         const uint2 dims = win.get_dims();
         vkCmdBeginRenderPass(cmd, render_pass->get_vk_handle(), swapchain_framebuffers[index]->get_vk_handle(), {{0,0},{dims.x,dims.y}}, {{0, 0, 0, 1}, {1.0f, 0}});
-        list.write_commands(cmd, *render_pass, {per_scene, per_view});
+        list.write_commands(cmd, *render_pass, {{0,0},{dims.x,dims.y}}, {per_scene, per_view});
         vkCmdEndRenderPass(cmd); 
         check(vkEndCommandBuffer(cmd)); 
 
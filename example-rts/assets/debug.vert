@@ -0,0 +1,17 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+#include "scene.glsl"
+
+// Each vertex is one debug_vertex, with its color normalized from 8 bits per channel
+layout(location = 0) in vec3 v_position;
+layout(location = 1) in vec4 v_color;
+
+layout(location = 0) out vec4 color;
+out gl_PerVertex { vec4 gl_Position; };
+
+void main()
+{
+	color = v_color;
+	gl_Position = u_view_proj_matrix * vec4(v_position, 1);
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+
+// Each page of the sprite atlas is one layer of the texture
+layout(set=0, binding=0) uniform sampler2DArray u_texture;
+
+layout(location = 0) in vec2 texcoord;
+layout(location = 1) in vec4 color;
+layout(location = 2) flat in uint page;
+layout(location = 3) flat in uint flags;
+
+layout(location = 0) out vec4 f_color;
+
+// Must match the flags of gui_quad
+const uint SIGNED_DISTANCE = 1;
+const uint SHADOW = 2;
+
+// Signed distance fields store 0.5 on the edge of the glyph, so antialias over the distance covered by one pixel
+float get_sdf_alpha(float d, float w) { return smoothstep(0.5 - w, 0.5 + w, d); }
+
+void main() 
+{
+	// Derivatives must be computed outside of nonuniform control flow
+	float d = texture(u_texture, vec3(texcoord, page)).r;
+	float w = fwidth(d) * 0.5;
+	vec2 shadow_texcoord = texcoord - dFdx(texcoord) - dFdy(texcoord);
+
+	if((flags & SIGNED_DISTANCE) == 0)
+	{
+		f_color = color*vec4(1,1,1,d);
+		return;
+	}
+	float alpha = get_sdf_alpha(d, w);
+	if((flags & SHADOW) != 0)
+	{
+		// Composite the text over a black copy of itself, offset by one pixel down and to the right
+		float shadow_alpha = get_sdf_alpha(texture(u_texture, vec3(shadow_texcoord, page)).r, w);
+		float total_alpha = alpha + shadow_alpha * (1 - alpha);
+		f_color = vec4(total_alpha > 0 ? color.rgb * alpha / total_alpha : color.rgb, color.a * total_alpha);
+	}
+	else f_color = color*vec4(1,1,1,alpha);
+}
\ No newline at end of file
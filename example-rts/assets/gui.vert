@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+
+// Each instance is one gui_quad, expanded from the corners of a unit quad
+layout(location = 0) in ivec4 i_rect;
+layout(location = 1) in vec4 i_texcoords;
+layout(location = 2) in vec4 i_color;
+layout(location = 3) in uvec2 i_page_flags;
+
+layout(set=0, binding=1) uniform GuiTarget { vec2 u_target_dims; };
+
+layout(location = 0) out vec2 texcoord;
+layout(location = 1) out vec4 color;
+layout(location = 2) flat out uint page;
+layout(location = 3) flat out uint flags;
+out gl_PerVertex { vec4 gl_Position; };
+
+void main()
+{
+	vec2 corner = vec2(gl_VertexIndex >= 2, gl_VertexIndex == 1 || gl_VertexIndex == 2);
+	gl_Position = vec4(mix(vec2(i_rect.xy), vec2(i_rect.zw), corner) * 2.0 / u_target_dims - 1.0, 0, 1);
+	texcoord = mix(i_texcoords.xy, i_texcoords.zw, corner);
+	color = i_color;
+	page = i_page_flags.x;
+	flags = i_page_flags.y;
+}
\ No newline at end of file
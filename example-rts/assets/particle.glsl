@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GPU particle simulation: Per-update uniforms, counters, buffer layouts and a stateless random generator //
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+layout(set=0, binding=0) uniform ParticleUpdate
+{
+	vec3 u_gravity;
+	float u_restitution;
+	vec3 u_ground_normal;
+	float u_ground_offset;
+	float u_timestep;
+	uint u_max_particles;
+	uint u_current_list;	// Alive list holding the particles to simulate, survivors are appended to the other list
+	uint u_emit_count;		// Total number of particles requested by all bursts
+	uint u_burst_count;
+	uint u_seed;
+	uint u_index_count;		// Index count of the mesh drawn for each particle
+};
+
+// The counters double as the arguments of the indirect simulation dispatch and the indirect draw
+layout(set=0, binding=1) buffer ParticleCounters
+{
+	int u_dead_count;
+	uint u_simulate_count;
+	uvec2 u_padding;
+	uvec4 u_simulate_args;	// VkDispatchIndirectCommand
+	uint u_draw_args[5];	// VkDrawIndexedIndirectCommand, whose instance count is the length of the most recently filled alive list
+};
+
+struct particle
+{
+	vec3 position;
+	float life;
+	vec3 velocity;
+	float size_per_life;
+	vec3 color;
+	float padding;
+};
+
+struct particle_burst
+{
+	vec3 position;
+	uint count;
+	vec3 color;
+	float life;
+	float speed;
+	float spread;
+	float size_per_life;
+	uint first;
+};
+
+struct particle_instance
+{
+	vec3 position;
+	float size;
+	vec3 color;
+	float padding;
+};
+
+uint hash(uint x) 
+{ 
+	x ^= x >> 16; x *= 0x7feb352du;
+	x ^= x >> 15; x *= 0x846ca68bu;
+	return x ^ (x >> 16);
+}
+
+float random(inout uint state) { state = hash(state); return float(state >> 8) / 16777216.0; }
+
+// Standard normal distribution in each component, via the Box-Muller transform
+vec3 random_normal(inout uint state)
+{
+	float r0 = sqrt(-2 * log(max(random(state), 1e-7))), a0 = random(state) * 6.2831853;
+	float r1 = sqrt(-2 * log(max(random(state), 1e-7))), a1 = random(state) * 6.2831853;
+	return vec3(r0 * cos(a0), r0 * sin(a0), r1 * cos(a1));
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Post processing uniforms: The active region of each dispatch, and exposure, bloom and color grading parameters //
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Shaders which write a bloom level declare it with BLOOM_FORMAT, defined by the preamble from post_chain::get_shader_preamble(...)
+
+// Images are allocated at the maximum render resolution, and only the region of each which starts at its origin is active
+layout(set=0, binding=0) uniform PostRegion
+{
+	ivec2 u_dest_dims;		// Size of the active region of the destination image
+	vec2 u_source_scale;	// Fraction of the source texture covered by its active region
+};
+
+// Texture coordinates within the active region of a source texture, of the center of a destination pixel, kept half a texel from 
+// the far edges of the region so that bilinear taps never read the inactive texels beyond it
+vec2 get_source_coord(ivec2 pixel, sampler2D source) { return min((vec2(pixel) + 0.5) / vec2(u_dest_dims) * u_source_scale, u_source_scale - 0.5 / vec2(textureSize(source, 0))); }
+
+#ifdef POST_GRADING
+layout(set=0, binding=1) uniform PostGrading
+{
+	float u_exposure;
+	float u_bloom_strength;
+	float u_bloom_threshold;
+	float u_saturation;
+	vec3 u_lift;
+	vec3 u_gamma;
+	vec3 u_gain;
+};
+#endif
\ No newline at end of file
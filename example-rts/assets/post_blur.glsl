@@ -0,0 +1,41 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Separable 9 tap binomial blur, which reads each pair of outer taps with a single bilinear fetch, for 5 fetches in all //
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Define BLUR_HORIZONTAL before including this file to blur along x instead of y, and BLUR_ADD_LOWER to add the next smaller level.
+// The source is the same size as the destination, and u_source_scale applies to the next smaller level.
+#include "post.glsl"
+
+layout(local_size_x = 8, local_size_y = 8) in;
+#ifdef BLUR_HORIZONTAL
+const vec2 axis = vec2(1,0);
+#else
+const vec2 axis = vec2(0,1);
+#endif
+
+// The kernel is (1 8 28 56 70 56 28 8 1)/256. Each pair of outer taps is read at the weighted average of their offsets, so that
+// bilinear filtering applies both weights, with the sum of their weights.
+const float offsets[3] = float[](0, 112.0/84, 28.0/9);
+const float weights[3] = float[](70.0/256, 84.0/256, 9.0/256);
+
+layout(set=0, binding=1) uniform sampler2D u_source;
+layout(set=0, binding=2, BLOOM_FORMAT) uniform writeonly image2D u_dest;
+#ifdef BLUR_ADD_LOWER
+layout(set=0, binding=3) uniform sampler2D u_lower;
+#endif
+
+void main() 
+{
+	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+	if(any(greaterThanEqual(pixel, u_dest_dims))) return;
+
+	// Taps are clamped to the centers of the edge texels of the active region, so that they never read the inactive texels beyond it
+	vec2 texel = 1 / vec2(textureSize(u_source, 0)), center = (vec2(pixel) + 0.5) * texel;
+	vec2 lo = 0.5 * texel, hi = (vec2(u_dest_dims) - 0.5) * texel;
+	vec3 sum = textureLod(u_source, center, 0).rgb * weights[0];
+	for(int i=1; i<3; ++i) sum += (textureLod(u_source, clamp(center - axis*texel*offsets[i], lo, hi), 0).rgb + textureLod(u_source, clamp(center + axis*texel*offsets[i], lo, hi), 0).rgb) * weights[i];
+#ifdef BLUR_ADD_LOWER
+	sum += textureLod(u_lower, get_source_coord(pixel, u_lower), 0).rgb;
+#endif
+	imageStore(u_dest, pixel, vec4(sum, 1));
+}
\ No newline at end of file
@@ -5,20 +5,27 @@
 struct point_light
 {
 	vec3 position;
+	float radius;
 	vec3 color;
 };
 
 layout(set=0, binding=0) uniform PerScene
 {
-	mat4 u_shadow_map_matrix;
-	vec3 u_shadow_light_pos;
+	mat4 u_cascade_matrices[4];
+	vec4 u_cascade_far_depths;
 	vec3 u_ambient_light;
 	vec3 u_light_direction;
 	vec3 u_light_color;
-	point_light u_point_lights[64];
-	int u_num_point_lights;
+	uvec3 u_cluster_dims;
+	float u_cluster_depth_scale;
+	float u_cluster_depth_bias;
 };
-layout(set=0, binding=1) uniform sampler2DShadow u_shadow_map;
+layout(set=0, binding=1) uniform sampler2DShadow u_shadow_map; // Atlas of shadow cascades for the directional light
+
+// Point lights are binned into froxels of the main view, each of which holds a range of indices into the light list
+layout(set=0, binding=2) readonly buffer LightClusters { uvec2 u_light_clusters[]; };
+layout(set=0, binding=3) readonly buffer LightIndices { uint u_light_indices[]; };
+layout(set=0, binding=4) readonly buffer PointLights { point_light u_point_lights[]; };
 
 ////////////////////////////////////////////////////////////////////////////
 // Per-view uniforms: Used to define the world-to-viewport transformation //
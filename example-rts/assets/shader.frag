@@ -27,21 +27,30 @@ void main()
 
 	vec3 light = u_ambient_light + u_emissive_mtl;
 
-	// directional light (using shadow map)
+	// directional light (using the first shadow cascade which covers this fragment's view depth)
+	vec4 clip_position = u_view_proj_matrix * vec4(position, 1);
 	{
-		float lit = textureProj(u_shadow_map, u_shadow_map_matrix * vec4(position, 1)).r;
-		vec3 light_vec = normalize(u_shadow_light_pos - position); //u_light_direction;
-		float diffuse = max(dot(normal_vec, light_vec), 0) * lit;
+		int cascade = int(dot(vec4(greaterThan(vec4(clip_position.w), u_cascade_far_depths)), vec4(1)));
+		float lit = texture(u_shadow_map, (u_cascade_matrices[min(cascade, 3)] * vec4(position, 1)).xyz);
+		if(cascade == 4) lit = 1; // Beyond the last cascade, nothing is shadowed
+		float diffuse = max(dot(normal_vec, u_light_direction), 0) * lit;
 		light += albedo * u_light_color * diffuse;
 	}
 
-	for(int i=0; i<u_num_point_lights; ++i)
+	// point lights, from the froxel containing this fragment
+	ivec3 cluster_dims = ivec3(u_cluster_dims);
+	ivec3 froxel = ivec3(floor(vec3((clip_position.xy / clip_position.w * 0.5 + 0.5) * vec2(cluster_dims.xy), log(clip_position.w) * u_cluster_depth_scale + u_cluster_depth_bias)));
+	froxel = clamp(froxel, ivec3(0), cluster_dims - 1);
+	uvec2 cluster = u_light_clusters[(froxel.z * cluster_dims.y + froxel.y) * cluster_dims.x + froxel.x];
+	for(uint i=cluster.x; i<cluster.x+cluster.y; ++i)
 	{
-		vec3 light_vec = u_point_lights[i].position - position;
+		point_light pl = u_point_lights[u_light_indices[i]];
+		vec3 light_vec = pl.position - position;
 		float light_dist = length(light_vec);
 		light_vec /= light_dist;
-		float diffuse = max(dot(normal_vec, light_vec), 0) / light_dist; // Note: Linear falloff
-		light += albedo * u_point_lights[i].color * diffuse;
+		float window = clamp(1 - light_dist / pl.radius, 0, 1);
+		float diffuse = max(dot(normal_vec, light_vec), 0) / light_dist * window * window; // Note: Linear falloff, windowed to zero at the light's radius
+		light += albedo * pl.color * diffuse;
 	}
 
 	f_color = vec4(light,1);
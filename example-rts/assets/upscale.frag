@@ -0,0 +1,31 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+
+// Only the region at the origin of the texture which covers u_source_scale of its texture coordinates holds valid texels
+layout(set=0, binding=0) uniform UpscaleRegion { vec2 u_source_scale; };
+layout(set=0, binding=1) uniform sampler2D u_texture;
+
+layout(location = 0) in vec2 texcoord;
+
+layout(location = 0) out vec4 f_color;
+
+vec3 sample_region(vec2 texel, vec2 size, vec2 region_max) { return texture(u_texture, (clamp(texel, vec2(0), region_max) + 0.5) / size).rgb; }
+
+void main() 
+{
+	// Catmull-Rom bicubic filter, with the middle pair of taps along each axis merged into a single bilinear tap, for nine taps in all
+	vec2 size = vec2(textureSize(u_texture, 0)), region_max = u_source_scale * size - 1;
+	vec2 position = texcoord * u_source_scale * size - 0.5, origin = floor(position), f = position - origin;
+	vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+	vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+	vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+	vec2 w3 = f * f * (-0.5 + 0.5 * f);
+	vec2 w12 = w1 + w2;
+	vec2 t0 = origin - 1, t12 = origin + w2 / w12, t3 = origin + 2;
+
+	vec3 color = (sample_region(vec2(t0.x, t0.y), size, region_max) * w0.x + sample_region(vec2(t12.x, t0.y), size, region_max) * w12.x + sample_region(vec2(t3.x, t0.y), size, region_max) * w3.x) * w0.y
+	           + (sample_region(vec2(t0.x, t12.y), size, region_max) * w0.x + sample_region(vec2(t12.x, t12.y), size, region_max) * w12.x + sample_region(vec2(t3.x, t12.y), size, region_max) * w3.x) * w12.y
+	           + (sample_region(vec2(t0.x, t3.y), size, region_max) * w0.x + sample_region(vec2(t12.x, t3.y), size, region_max) * w12.x + sample_region(vec2(t3.x, t3.y), size, region_max) * w3.x) * w3.y;
+	f_color = vec4(max(color, 0), 1);
+}
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "rts-game.h"
+#include "post-chain.h"
+#include "dynamic-resolution.h"
 #include "sprite.h"
+#include "debug-draw.h"
 #include "utility.h"
 #include "load.h"
 
@@ -29,23 +32,89 @@ void draw_fullscreen_pass(VkCommandBuffer cmd, framebuffer & fb, const scene_des
     vkCmdBindVertexBuffers(cmd, 0, {*fullscreen_quad.vertex_buffer}, {0});
     vkCmdBindIndexBuffer(cmd, *fullscreen_quad.index_buffer, 0, VkIndexType::VK_INDEX_TYPE_UINT32);
     vkCmdDrawIndexed(cmd, fullscreen_quad.index_count, 1, 0, 0, 0);
-    if(additional_draws) additional_draws->write_commands(cmd, fb.get_render_pass(), {});
+    if(additional_draws) additional_draws->write_commands(cmd, fb.get_render_pass(), fb.get_bounds(), {});
     vkCmdEndRenderPass(cmd); 
 }
 
-int main() try
+struct replay_target
+{
+    std::shared_ptr<framebuffer> fb;
+    std::vector<VkClearValue> clear_values;
+    VkImage depth_image {}; // If set, moved into a depth attachment layout before passes which load their depth
+};
+
+// Reconstruct a captured frame repeatedly, and report how long it takes to rebuild, record, and submit
+int replay_frame_capture(renderer & r, const resource_registry & registry, const char * filename, const std::map<std::string, replay_target> & targets, array_view<VkDescriptorPoolSize> pool_sizes)
+{
+    const auto frame = load_frame_capture(filename);
+    size_t draw_count = 0;
+    for(auto & p : frame.passes) draw_count += frame.lists.at(p.list).draws.size();
+    std::cout << filename << ": " << frame.passes.size() << " passes, " << draw_count << " draws" << std::endl;
+
+    transient_resource_pool pool {r.ctx, pool_sizes, 1024};
+    std::vector<double> rebuild_times, record_times, submit_times, gpu_times;
+    for(int i=0; i<100; ++i)
+    {
+        pool.reset();
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        const replayed_frame replay {frame, registry, pool};
+        const auto t1 = std::chrono::high_resolution_clock::now();
+
+        VkCommandBuffer cmd = pool.allocate_command_buffer();
+        VkCommandBufferBeginInfo begin_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+        vkBeginCommandBuffer(cmd, &begin_info);
+        for(size_t j=0; j<replay.get_pass_count(); ++j)
+        {
+            auto & target = targets.at(replay.get_render_pass_name(j));
+            if(target.depth_image) transition_layout(cmd, target.depth_image, 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
+            vkCmdBeginRenderPass(cmd, target.fb->get_render_pass().get_vk_handle(), target.fb->get_vk_handle(), target.fb->get_bounds(), target.clear_values);
+            replay.write_commands(cmd, j, target.fb->get_bounds());
+            vkCmdEndRenderPass(cmd);
+        }
+        check(vkEndCommandBuffer(cmd));
+        const auto t2 = std::chrono::high_resolution_clock::now();
+
+        r.submit({cmd}, pool.get_fence());
+        const auto t3 = std::chrono::high_resolution_clock::now();
+        r.wait_until_device_idle();
+        const auto t4 = std::chrono::high_resolution_clock::now();
+
+        rebuild_times.push_back(std::chrono::duration<double>(t1 - t0).count());
+        record_times.push_back(std::chrono::duration<double>(t2 - t1).count());
+        submit_times.push_back(std::chrono::duration<double>(t3 - t2).count());
+        gpu_times.push_back(std::chrono::duration<double>(t4 - t3).count());
+    }
+
+    auto report = [](const char * label, std::vector<double> & times)
+    {
+        std::sort(begin(times), end(times));
+        std::cout << label << ": min " << times.front()*1000 << " ms, median " << times[times.size()/2]*1000 << " ms, max " << times.back()*1000 << " ms" << std::endl;
+    };
+    report("rebuild", rebuild_times);
+    report("record ", record_times);
+    report("submit ", submit_times);
+    report("gpu    ", gpu_times);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, const char * argv[]) try
 {
     constexpr coord_system vk_coords {coord_axis::right, coord_axis::down, coord_axis::forward};
 
+    // Running with --replay <filename> benchmarks a frame previously captured by pressing F12, without opening a window
+    const char * replay_filename = argc == 3 && strcmp(argv[1], "--replay") == 0 ? argv[2] : nullptr;
+
+    // Running with --cpu-particles simulates particles on the CPU instead of the GPU
+    const bool cpu_particle_simulation = argc == 2 && strcmp(argv[1], "--cpu-particles") == 0;
+
     game::state g;
 
     sprite_sheet sprites;
     gui_sprites gs {sprites};
-    const font_face font {sprites, "C:/windows/fonts/arial.ttf", 32.0f};
-    sprites.prepare_sheet();
+    font_face font {sprites, "C:/windows/fonts/arial.ttf", 32.0f, 1, glyph_rendering::signed_distance};
 
-    renderer r {[](const char * message) { std::cerr << "validation layer: " << message << std::endl; }}; 
-    sprites.texture = r.create_texture_2d(sprites.sheet);
+    renderer r {[](const char * message) { std::cerr << "validation layer: " << message << std::endl; }, replay_filename != nullptr}; 
+    sprites.update_texture(r);
 
     // Create our sampler
     VkSamplerCreateInfo image_sampler_info {VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
@@ -75,14 +144,18 @@ int main() try
     // Set up scene contract
     auto fb_render_pass = r.create_render_pass({make_attachment_description(VK_FORMAT_R16G16B16A16_SFLOAT, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)}, 
         make_attachment_description(VK_FORMAT_D32_SFLOAT, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED));
-    auto shadowmap_render_pass = r.create_render_pass({}, make_attachment_description(VK_FORMAT_D32_SFLOAT, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL), true);
+    auto shadow_atlas_pass = r.create_render_pass({}, make_attachment_description(VK_FORMAT_D32_SFLOAT, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL), true);
+    auto shadow_cache_pass = r.create_render_pass({}, make_attachment_description(VK_FORMAT_D32_SFLOAT, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL), true);
     auto post_render_pass = r.create_render_pass({make_attachment_description(VK_FORMAT_R16G16B16A16_SFLOAT, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)}, std::nullopt);
-    auto final_render_pass = r.create_render_pass({make_attachment_description(r.get_swapchain_surface_format(), VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)}, std::nullopt);
+    auto final_render_pass = r.create_render_pass({make_attachment_description(r.get_swapchain_surface_format(), VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_ATTACHMENT_STORE_OP_STORE, replay_filename ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)}, std::nullopt);
 
-    auto contract = r.create_contract({fb_render_pass, shadowmap_render_pass}, {
+    auto contract = r.create_contract({fb_render_pass, shadow_atlas_pass, shadow_cache_pass}, {
         {
             {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT}, // PerScene uniform block
-            {1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT} //uniform sampler2D u_shadow_map;
+            {1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT}, //uniform sampler2D u_shadow_map;
+            {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT}, // LightClusters buffer block
+            {3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT}, // LightIndices buffer block
+            {4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT}, // PointLights buffer block
         }, 
         {{0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT|VK_SHADER_STAGE_FRAGMENT_BIT}}
     });
@@ -97,46 +170,122 @@ int main() try
     std::vector<uint3> quad_tris {{0,1,2},{0,2,3}};
     gfx_mesh quad_mesh {r.ctx, quad_verts, quad_tris};
 
+    auto gui_quad_format = r.create_vertex_format({{0, sizeof(gui_quad), VK_VERTEX_INPUT_RATE_INSTANCE}}, {
+        {0, 0, VK_FORMAT_R16G16B16A16_SINT, offsetof(gui_quad, rect)}, 
+        {1, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(gui_quad, texcoords)},
+        {2, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(gui_quad, color)},
+        {3, 0, VK_FORMAT_R16G16_UINT, offsetof(gui_quad, page)},
+    });
+
     auto image_vert_shader = r.create_shader(VK_SHADER_STAGE_VERTEX_BIT, "assets/image.vert");
-    auto image_frag_shader = r.create_shader(VK_SHADER_STAGE_FRAGMENT_BIT, "assets/image.frag");
-    auto hipass_frag_shader = r.create_shader(VK_SHADER_STAGE_FRAGMENT_BIT, "assets/hipass.frag");
-    auto hgauss_frag_shader = r.create_shader(VK_SHADER_STAGE_FRAGMENT_BIT, "assets/hgauss.frag");
-    auto vgauss_frag_shader = r.create_shader(VK_SHADER_STAGE_FRAGMENT_BIT, "assets/vgauss.frag");
-    auto add_frag_shader = r.create_shader(VK_SHADER_STAGE_FRAGMENT_BIT, "assets/add.frag");
-    auto sample_frag_shader = r.create_shader(VK_SHADER_STAGE_FRAGMENT_BIT, "assets/sample.frag");
+    auto gui_vert_shader = r.create_shader(VK_SHADER_STAGE_VERTEX_BIT, "assets/gui.vert");
+    auto gui_frag_shader = r.create_shader(VK_SHADER_STAGE_FRAGMENT_BIT, "assets/gui.frag");
+    auto upscale_frag_shader = r.create_shader(VK_SHADER_STAGE_FRAGMENT_BIT, "assets/upscale.frag");
     
-    auto image_mtl = r.create_material(post_contract, image_vertex_format, {image_vert_shader, image_frag_shader}, false, false, VK_BLEND_FACTOR_SRC_ALPHA, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA);
-    auto hipass_mtl = r.create_material(post_contract, image_vertex_format, {image_vert_shader, hipass_frag_shader}, false, false, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO);
-    auto hgauss_mtl = r.create_material(post_contract, image_vertex_format, {image_vert_shader, hgauss_frag_shader}, false, false, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO);
-    auto vgauss_mtl = r.create_material(post_contract, image_vertex_format, {image_vert_shader, vgauss_frag_shader}, false, false, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO);
-    auto add_mtl = r.create_material(post_contract, image_vertex_format, {image_vert_shader, add_frag_shader}, false, false, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO);
-    auto sample_mtl = r.create_material(post_contract, image_vertex_format, {image_vert_shader, sample_frag_shader}, false, false, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO);
+    auto gui_mtl = r.create_material(post_contract, gui_quad_format, {gui_vert_shader, gui_frag_shader}, false, false, VK_BLEND_FACTOR_SRC_ALPHA, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA);
+    auto upscale_mtl = r.create_material(post_contract, image_vertex_format, {image_vert_shader, upscale_frag_shader}, false, false, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO);
+
+    auto debug_vertex_format = r.create_vertex_format({{0, sizeof(debug_vertex), VK_VERTEX_INPUT_RATE_VERTEX}}, {
+        {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(debug_vertex, position)}, 
+        {1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(debug_vertex, color)},
+    });
+    auto debug_vert_shader = r.create_shader(VK_SHADER_STAGE_VERTEX_BIT, "assets/debug.vert");
+    auto debug_frag_shader = r.create_shader(VK_SHADER_STAGE_FRAGMENT_BIT, "assets/debug.frag");
+    auto debug_tested_mtl = r.create_material(contract, debug_vertex_format, {debug_vert_shader, debug_frag_shader}, false, true, VK_BLEND_FACTOR_SRC_ALPHA, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA, VK_PRIMITIVE_TOPOLOGY_LINE_LIST);
+    auto debug_overlay_mtl = r.create_material(contract, debug_vertex_format, {debug_vert_shader, debug_frag_shader}, false, false, VK_BLEND_FACTOR_SRC_ALPHA, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA, VK_PRIMITIVE_TOPOLOGY_LINE_LIST);
 
     // Load our game resources
     const game::resources res {r, contract};
 
-    // Set up a window with swapchain framebuffers
-    window win {r.ctx, {1280, 720}, "Example RTS"};
-    render_target color {r.ctx, win.get_dims(), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT|VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT};
-    render_target color1 {r.ctx, win.get_dims(), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT|VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT};
-    render_target color2 {r.ctx, win.get_dims(), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT|VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT};
-    auto depth = make_depth_buffer(r.ctx, win.get_dims());
-    render_target shadowmap {r.ctx, {2048,2048}, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_DEPTH_BIT};
+    // Set up render targets
+    const uint2 dims {1280, 720};
+    render_target color {r.ctx, dims, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT|VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT};
+    auto depth = make_depth_buffer(r.ctx, dims);
+
+    // Dynamic casters are drawn over a copy of each cascade's cached static casters, in its tile of the shadow atlas
+    shadow_cascades cascades {4, 1024};
+    const uint2 tile_dims {cascades.get_tile_size(), cascades.get_tile_size()};
+    render_target shadow_atlas {r.ctx, cascades.get_atlas_size(), VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_ASPECT_DEPTH_BIT};
+    auto make_shadow_cache = [&]() -> render_target { return {r.ctx, tile_dims, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_DEPTH_BIT}; };
+    render_target shadow_caches[] {make_shadow_cache(), make_shadow_cache(), make_shadow_cache(), make_shadow_cache()};
 
     // Create framebuffers
-    auto main_framebuffer = r.create_framebuffer(fb_render_pass, {color.get_image_view(), depth.get_image_view()}, win.get_dims());
-    auto shadow_framebuffer = r.create_framebuffer(shadowmap_render_pass, {shadowmap.get_image_view()}, {2048,2048});
-    auto aux_framebuffer1 = r.create_framebuffer(post_render_pass, {color1.get_image_view()}, win.get_dims());
-    auto aux_framebuffer2 = r.create_framebuffer(post_render_pass, {color2.get_image_view()}, win.get_dims());
-    std::vector<std::shared_ptr<framebuffer>> swapchain_framebuffers;
-    for(auto & view : win.get_swapchain_image_views()) swapchain_framebuffers.push_back(r.create_framebuffer(final_render_pass, {view}, win.get_dims()));
+    auto main_framebuffer = r.create_framebuffer(fb_render_pass, {color.get_image_view(), depth.get_image_view()}, dims);
+    auto shadow_atlas_framebuffer = r.create_framebuffer(shadow_atlas_pass, {shadow_atlas.get_image_view()}, cascades.get_atlas_size());
+    std::vector<std::shared_ptr<framebuffer>> shadow_cache_framebuffers;
+    for(auto & cache : shadow_caches) shadow_cache_framebuffers.push_back(r.create_framebuffer(shadow_cache_pass, {cache.get_image_view()}, tile_dims));
+
+    // Bloom, tonemapping and color grading run as compute dispatches, with bloom computed over five successively half-sized levels
+    const VkFormat bloom_format = post_chain::select_bloom_format(r);
+    const char * bloom_preamble = post_chain::get_shader_preamble(bloom_format);
+    const post_chain post {r, dims, 5, bloom_format,
+        r.create_shader(VK_SHADER_STAGE_COMPUTE_BIT, "assets/post_threshold.comp", bloom_preamble), r.create_shader(VK_SHADER_STAGE_COMPUTE_BIT, "assets/post_downsample.comp", bloom_preamble),
+        r.create_shader(VK_SHADER_STAGE_COMPUTE_BIT, "assets/post_hblur.comp", bloom_preamble), r.create_shader(VK_SHADER_STAGE_COMPUTE_BIT, "assets/post_vblur.comp", bloom_preamble),
+        r.create_shader(VK_SHADER_STAGE_COMPUTE_BIT, "assets/post_vblur_add.comp", bloom_preamble), r.create_shader(VK_SHADER_STAGE_COMPUTE_BIT, "assets/post_composite.comp")};
+    post_grading grading;
+    grading.saturation = 1.1f;
+
+    // Particles are simulated entirely on the GPU by default, bouncing off the ground beneath the units
+    gpu_particles particles {r, 262144, res.particle_mesh->index_count, 
+        r.create_shader(VK_SHADER_STAGE_COMPUTE_BIT, "assets/particle_reset.comp"), r.create_shader(VK_SHADER_STAGE_COMPUTE_BIT, "assets/particle_emit.comp"),
+        r.create_shader(VK_SHADER_STAGE_COMPUTE_BIT, "assets/particle_prepare.comp"), r.create_shader(VK_SHADER_STAGE_COMPUTE_BIT, "assets/particle_simulate.comp")};
+    const particle_physics physics {{0,0,-2}, 0.5f, {0,0,1}, 0};
+    particle_pool cpu_particles;
+
+    // Name everything which draw lists may refer to, so that frames can be captured and replayed
+    resource_registry registry;
+    registry.add("contract", *contract);
+    registry.add("post_contract", *post_contract);
+    registry.add("fb_render_pass", *fb_render_pass);
+    registry.add("shadow_atlas_pass", *shadow_atlas_pass);
+    registry.add("shadow_cache_pass", *shadow_cache_pass);
+    registry.add("final_render_pass", *final_render_pass);
+    registry.add("gui_mtl", *gui_mtl);
+    registry.add("debug_tested_mtl", *debug_tested_mtl);
+    registry.add("debug_overlay_mtl", *debug_overlay_mtl);
+    registry.add("image_sampler", image_sampler);
+    registry.add("shadow_sampler", shadow_sampler);
+    registry.add("sprites", *sprites.get_texture());
+    registry.add("shadow_atlas", shadow_atlas);
+    res.register_names(registry);
+    registry.add("particles.instances", particles.get_instances().buffer);
+    registry.add("particles.counters", particles.get_draw_arguments().buffer);
 
-    // Set up our transient resource pools
     const VkDescriptorPoolSize pool_sizes[]
     {
         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,1024},
         {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,1024},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,1024},
     };
+    if(replay_filename)
+    {
+        // Captured frames draw particles indirectly from buffers which are only written on the GPU, so clear them before replaying
+        transient_resource_pool setup_pool {r.ctx, pool_sizes, 16};
+        VkCommandBuffer cmd = setup_pool.allocate_command_buffer();
+        VkCommandBufferBeginInfo begin_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+        vkBeginCommandBuffer(cmd, &begin_info);
+        particles.clear(cmd, setup_pool);
+        check(vkEndCommandBuffer(cmd));
+        r.submit({cmd}, setup_pool.get_fence());
+        r.wait_until_device_idle();
+
+        render_target final_color {r.ctx, dims, r.get_swapchain_surface_format(), VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT|VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT};
+        const std::map<std::string, replay_target> targets
+        {
+            {"shadow_cache_pass", {shadow_cache_framebuffers[0], {{1.0f, 0}}, shadow_caches[0].get_image()}}, // Every cache is the same size, so replays draw into the first
+            {"shadow_atlas_pass", {shadow_atlas_framebuffer, {}, shadow_atlas.get_image()}},
+            {"fb_render_pass", {main_framebuffer, {{0, 0, 0, 1}, {1.0f, 0}}}},
+            {"final_render_pass", {r.create_framebuffer(final_render_pass, {final_color.get_image_view()}, dims), {}}},
+        };
+        return replay_frame_capture(r, registry, replay_filename, targets, pool_sizes);
+    }
+
+    // Set up a window with swapchain framebuffers
+    window win {r.ctx, dims, "Example RTS"};
+    std::vector<std::shared_ptr<framebuffer>> swapchain_framebuffers;
+    for(auto & view : win.get_swapchain_image_views()) swapchain_framebuffers.push_back(r.create_framebuffer(final_render_pass, {view}, win.get_dims()));
+
+    // Set up our transient resource pools
     transient_resource_pool pools[3]
     {
         {r.ctx, pool_sizes, 1024},
@@ -144,6 +293,40 @@ int main() try
         {r.ctx, pool_sizes, 1024},
     };
     int frame_index = 0;
+    thread_pool threads;
+
+    // The scene is rendered into a sub-rectangle of its targets, sized to hold the GPU frame time near 60 frames per second
+    gpu_timer frame_timer {r.ctx, countof(pools)};
+    resolution_controller resolution {dims, 1.0f/60};
+
+    // Point lights are binned into a froxel grid covering the main view
+    const size_t max_lights = 4096, max_light_indices = 65536;
+    light_clusters clusters {{16,9,24}, 1.0f, 1000.0f, max_lights, max_light_indices};
+
+    // Static scenery is recorded once into a bundle, which owns persistent shared descriptor sets for each frame in flight
+    struct static_scene_frame { scene_descriptor_set per_scene, per_view; VkDescriptorBufferInfo ps, pv, light_clusters, light_indices, point_lights; std::vector<scene_descriptor_set> per_cascade; std::vector<VkDescriptorBufferInfo> pv_cascade; };
+    draw_bundle static_scene {r.ctx, *contract, pool_sizes, 64};
+    game::draw_static(static_scene.get_list(), res);
+    std::vector<static_scene_frame> static_scene_frames;
+    for(size_t i=0; i<countof(pools); ++i)
+    {
+        static_scene_frame f {static_scene.shared_descriptor_set(0), static_scene.shared_descriptor_set(1), 
+            static_scene.reserve_uniforms<game::per_scene_uniforms>(), static_scene.reserve_uniforms<game::per_view_uniforms>(),
+            static_scene.reserve_storage(product(clusters.get_dims()) * sizeof(uint2)), static_scene.reserve_storage(max_light_indices * sizeof(uint32_t)), static_scene.reserve_storage(max_lights * sizeof(clustered_light))};
+        f.per_scene.write_uniform_buffer(0, 0, f.ps);
+        f.per_scene.write_combined_image_sampler(1, 0, shadow_sampler, shadow_atlas.get_image_view(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        f.per_scene.write_storage_buffer(2, 0, f.light_clusters);
+        f.per_scene.write_storage_buffer(3, 0, f.light_indices);
+        f.per_scene.write_storage_buffer(4, 0, f.point_lights);
+        f.per_view.write_uniform_buffer(0, 0, f.pv);
+        for(size_t j=0; j<cascades.get_cascade_count(); ++j)
+        {
+            f.per_cascade.push_back(static_scene.shared_descriptor_set(1));
+            f.pv_cascade.push_back(static_scene.reserve_uniforms<game::per_view_uniforms>());
+            f.per_cascade.back().write_uniform_buffer(0, 0, f.pv_cascade.back());
+        }
+        static_scene_frames.push_back(f);
+    }
 
     fps_camera camera {{32,32,10}};
     camera.pitch = -1.0f;
@@ -152,6 +335,11 @@ int main() try
     auto t0 = std::chrono::high_resolution_clock::now();
 
     size_t anim_frame = 0;
+    bool capture_key_down = false;
+    bool show_debug = false, debug_key_down = false;
+    debug_draw debug;
+    gui_panel_cache gui_cache;
+    float list_scroll = 0;
     while(!win.should_close())
     {
         glfwPollEvents();
@@ -177,51 +365,92 @@ int main() try
         if(win.get_key(GLFW_KEY_A)) camera.position += qrot(camera.get_orientation(game::coords), game::coords.get_axis(coord_axis::west ) * (timestep * 50));
         if(win.get_key(GLFW_KEY_S)) camera.position += qrot(camera.get_orientation(game::coords), game::coords.get_axis(coord_axis::south) * (timestep * 50));
         if(win.get_key(GLFW_KEY_D)) camera.position += qrot(camera.get_orientation(game::coords), game::coords.get_axis(coord_axis::east ) * (timestep * 50));
-        if(!win.get_key(GLFW_KEY_SPACE)) g.advance(timestep);
+        if(!win.get_key(GLFW_KEY_SPACE)) g.advance(timestep, threads);
+        if(win.get_key(GLFW_KEY_UP)) list_scroll = std::max(list_scroll - timestep * 200, 0.0f);
+        if(win.get_key(GLFW_KEY_DOWN)) list_scroll += timestep * 200;
 
         // Determine matrices
         const auto proj_matrix = mul(linalg::perspective_matrix(1.0f, win.get_aspect(), 1.0f, 1000.0f, linalg::pos_z, linalg::zero_to_one), make_transform_4x4(game::coords, vk_coords));        
 
         // Render a frame
-        auto & pool = pools[frame_index];
+        const uint32_t frame_slot = frame_index;
+        auto & pool = pools[frame_slot];
+        auto & static_frame = static_scene_frames[frame_slot];
         frame_index = (frame_index+1)%3;
         pool.reset();
 
-        // Generate a draw list for the scene
-        fps_camera shadow_camera;        
-        shadow_camera.position = {32,32,40};
-        shadow_camera.yaw = 0;
-        shadow_camera.pitch = -1.57f;
-
-        //camera = shadow_camera;
-        const float4x4 shadow_bias_matrix = {{0.5f,0,0,0},{0,0.5f,0,0},{0,0,1,0},{0.5f,0.5f,0,1}};
-        const auto shadow_proj_matrix = mul(linalg::perspective_matrix(1.57f, 1.0f, 20.0f, 60.0f, linalg::pos_z, linalg::zero_to_one), make_transform_4x4(game::coords, vk_coords)); 
-        game::per_view_uniforms pv_shadow;
-        pv_shadow.view_proj_matrix = mul(shadow_proj_matrix, shadow_camera.get_view_matrix(game::coords));
-        pv_shadow.eye_position = shadow_camera.position;
-        pv_shadow.eye_x_axis = qrot(shadow_camera.get_orientation(game::coords), game::coords.get_right());
-        pv_shadow.eye_y_axis = qrot(shadow_camera.get_orientation(game::coords), game::coords.get_down());
+        // The last frame to use this pool has now finished, so its GPU time is available
+        if(auto gpu_seconds = frame_timer.get_elapsed_seconds(frame_slot)) resolution.update(static_cast<float>(*gpu_seconds));
+        const uint2 viewport_dims = resolution.get_viewport_dims();
+        const VkRect2D viewport {{0,0},{viewport_dims.x,viewport_dims.y}};
+
+        // Press F12 to write this frame's draw lists to disk, for later use with --replay
+        std::optional<frame_recorder> recorder;
+        if(win.get_key(GLFW_KEY_F12) && !capture_key_down)
+        {
+            recorder.emplace(registry, pool);
+            recorder->observe(static_scene);
+        }
+        capture_key_down = win.get_key(GLFW_KEY_F12);
 
+        // Generate a draw list for the scene
         game::per_scene_uniforms ps {};
-        ps.shadow_map_matrix = mul(shadow_bias_matrix, pv_shadow.view_proj_matrix);
-        ps.shadow_light_pos = pv_shadow.eye_position;
         ps.ambient_light = {0.01f,0.01f,0.01f};
         ps.light_direction = normalize(float3{1,-2,5});
         ps.light_color = {0.9f,0.9f,0.9f};
         draw_list list {pool, *contract};
-        game::draw(list, ps, res, g);
+        std::vector<clustered_light> lights;
+        game::draw(list, lights, res, g, threads);
+        if(cpu_particle_simulation)
+        {
+            for(auto & b : g.particle_bursts) cpu_particles.emit(b);
+            g.particle_bursts.clear();
+            cpu_particles.integrate(win.get_key(GLFW_KEY_SPACE) ? 0.0f : timestep, physics);
+            game::draw_particles(list, res, cpu_particles);
+        }
+        else game::draw_particles(list, res, particles);
+
+        // Rasterize glyphs which were first drawn last frame, and upload them along with any other new sprites
+        font.update(&threads);
+        sprites.update_texture(r);
 
         draw_list gui_list {pool, *post_contract};
-        gui_context gui {gs, gui_list, win.get_dims()};
+        gui_context gui {gs, gui_list, win.get_dims(), &gui_cache};
         auto r = rect{0,0,(int)win.get_dims().x,(int)win.get_dims().y};
         gui.begin_frame();
         //gui.draw_sprite_sheet({10,10});
-        r = r.take_y1(250);
-        auto r0 = r.take_x0(250); gui.draw_partial_rounded_rect(r0, 32, {0,0,0,0.5f}, false, true, false, false); gui.draw_partial_rounded_rect(r0.adjusted(0,4,-4,0), 28, {0,0,0,0.5f}, false, true, false, false);
-        auto r1 = r.take_x1(350); gui.draw_partial_rounded_rect(r1, 32, {0,0,0,0.5f}, true, false, false, false); gui.draw_partial_rounded_rect(r1.adjusted(4,4,0,0), 28, {0,0,0,0.5f}, true, false, false, false);
-        auto r2 = r.take_y1(200); gui.draw_rect(r2, {0,0,0,0.5f}); gui.draw_rect(r2.adjusted(-4,4,4,0), {0,0,0,0.5f});
-        gui.draw_shadowed_text(font, {1,1,1,1}, r2.x0+10, r2.y0+40, "This is a test of font rendering");
-        gui.end_frame(*image_mtl, image_sampler);
+
+        // The HUD layout depends only on the window size, so its quads are regenerated only when the window is resized, or when 
+        // glyphs have been added to or evicted from the font
+        if(gui.begin_panel(0, hash_values(r.x1, r.y1, font.get_generation())))
+        {
+            r = r.take_y1(250);
+            auto r0 = r.take_x0(250); gui.draw_partial_rounded_rect(r0, 32, {0,0,0,0.5f}, false, true, false, false); gui.draw_partial_rounded_rect(r0.adjusted(0,4,-4,0), 28, {0,0,0,0.5f}, false, true, false, false);
+            auto r1 = r.take_x1(350); gui.draw_partial_rounded_rect(r1, 32, {0,0,0,0.5f}, true, false, false, false); gui.draw_partial_rounded_rect(r1.adjusted(4,4,0,0), 28, {0,0,0,0.5f}, true, false, false, false);
+            auto r2 = r.take_y1(200); gui.draw_rect(r2, {0,0,0,0.5f}); gui.draw_rect(r2.adjusted(-4,4,4,0), {0,0,0,0.5f});
+            gui.draw_shadowed_text(font, {1,1,1,1}, r2.x0+10, r2.y0+40, "This is a test of font rendering");
+            gui.draw_shadowed_text(font, {1,1,1,1}, r2.x0+10, r2.y0+80, u8"\u00C5ngstr\u00F6m, \u0391\u03B8\u03AE\u03BD\u03B1, \u041C\u043E\u0441\u043A\u0432\u0430", 0.75f);
+            gui.end_panel();
+        }
+
+        // A long list in the lower left panel, scrolled with the arrow keys. Only the rows which intersect its clip rect generate
+        // quads, and the rows at its edges are clipped by the scissor rect.
+        const rect list_rect {16, static_cast<int>(win.get_dims().y) - 234, 226, static_cast<int>(win.get_dims().y) - 16};
+        const int scroll = static_cast<int>(list_scroll), row_height = 20, row_count = 1000;
+        if(gui.begin_panel(1, hash_values(list_rect.y0, scroll, font.get_generation())))
+        {
+            gui.push_clip(list_rect);
+            for(int i = scroll / row_height; i < row_count; ++i)
+            {
+                const rect row {list_rect.x0, list_rect.y0 + i*row_height - scroll, list_rect.x1, list_rect.y0 + (i+1)*row_height - scroll};
+                if(!gui.is_visible(row)) break;
+                if(i % 2) gui.draw_rect(row, {1,1,1,0.1f});
+                gui.draw_text(font, {1,1,1,1}, row.x0+4, row.y1-5, "Row " + std::to_string(i), 0.5f);
+            }
+            gui.pop_clip();
+            gui.end_panel();
+        }
+        gui.end_frame(*gui_mtl, image_sampler);
 
         // Set up per-scene and per-view descriptor sets
         game::per_view_uniforms pv;
@@ -230,49 +459,134 @@ int main() try
         pv.eye_x_axis = qrot(camera.get_orientation(game::coords), game::coords.get_right());
         pv.eye_y_axis = qrot(camera.get_orientation(game::coords), game::coords.get_down());
 
+        // Fit shadow cascades to the main view, for the light shining into the scene from ps.light_direction
+        cascades.update(pv.view_proj_matrix, 1.0f, 200.0f, -ps.light_direction, {0,0,-20}, {64,64,8});
+        std::vector<game::per_view_uniforms> pv_cascade(cascades.get_cascade_count());
+        for(size_t i=0; i<cascades.get_cascade_count(); ++i)
+        {
+            auto & c = cascades.get_cascade(i);
+            ps.cascade_matrices[i] = c.atlas_matrix;
+            ps.cascade_far_depths[i] = c.far_depth;
+            pv_cascade[i].view_proj_matrix = c.view_proj_matrix;
+            pv_cascade[i].eye_position = pv.eye_position;
+            pv_cascade[i].eye_x_axis = normalize(c.view_proj_matrix.row(0).xyz());
+            pv_cascade[i].eye_y_axis = normalize(c.view_proj_matrix.row(1).xyz());
+        }
+
+        // Bin point lights into the froxels of the main view
+        clusters.assign(pv.view_proj_matrix, lights);
+        ps.cluster_dims = clusters.get_dims();
+        ps.cluster_depth_scale = clusters.get_depth_scale();
+        ps.cluster_depth_bias = clusters.get_depth_bias();
+
+        // Press F3 to show unit bounds, bullet paths and point light volumes, and the shadow cascades over the top of the scene
+        if(win.get_key(GLFW_KEY_F3) && !debug_key_down) show_debug = !show_debug;
+        debug_key_down = win.get_key(GLFW_KEY_F3);
+        debug.clear();
+        if(show_debug)
+        {
+            for(auto & u : g.units) debug.draw_box(mul(game::get_model_matrix(u), scaling_matrix(float3{0.5f,0.5f,0.5f})), {game::team_colors[u.owner], 1});
+            for(size_t i=0; i<g.bullets.size(); ++i)
+            {
+                const auto b = game::get_bullet(g.bullets, i);
+                debug.draw_line(b.get_position(), {b.target, 0.75f}, {game::team_colors[b.owner], 1});
+            }
+            for(auto & l : lights) debug.draw_sphere(l.position, l.radius, {l.color, 0.5f}, debug_depth::tested, 16);
+            for(size_t i=0; i<cascades.get_cascade_count(); ++i) debug.draw_frustum(cascades.get_cascade(i).view_proj_matrix, {1,1,1,0.25f}, debug_depth::overlay);
+        }
+        draw_list debug_list {pool, *contract};
+        debug.draw(debug_list, *debug_tested_mtl, *debug_overlay_mtl);
+
         auto per_scene = list.shared_descriptor_set(0);
         per_scene.write_uniform_buffer(0, 0, list.upload_uniforms(ps));      
-        per_scene.write_combined_image_sampler(1, 0, shadow_sampler, shadowmap.get_image_view(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        per_scene.write_combined_image_sampler(1, 0, shadow_sampler, shadow_atlas.get_image_view(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        per_scene.write_storage_buffer(2, 0, list.upload_storage(clusters.get_ranges()));
+        per_scene.write_storage_buffer(3, 0, list.upload_storage(clusters.get_light_indices()));
+        per_scene.write_storage_buffer(4, 0, list.upload_storage(clusters.get_lights()));
 
         auto per_view = list.shared_descriptor_set(1);
         per_view.write_uniform_buffer(0, 0, list.upload_uniforms(pv));
 
-        auto per_view_shadow = list.shared_descriptor_set(1);
-        per_view_shadow.write_uniform_buffer(0, 0, list.upload_uniforms(pv_shadow));
+        std::vector<scene_descriptor_set> per_cascade;
+        for(auto & u : pv_cascade)
+        {
+            per_cascade.push_back(list.shared_descriptor_set(1));
+            per_cascade.back().write_uniform_buffer(0, 0, list.upload_uniforms(u));
+        }
+
+        // The pool's fence also protects the static scene's uniforms for this frame
+        static_scene.update_uniforms(static_frame.ps, ps);
+        static_scene.update_uniforms(static_frame.pv, pv);
+        for(size_t i=0; i<pv_cascade.size(); ++i) static_scene.update_uniforms(static_frame.pv_cascade[i], pv_cascade[i]);
+        static_scene.update_storage(static_frame.light_clusters, clusters.get_ranges());
+        static_scene.update_storage(static_frame.light_indices, clusters.get_light_indices());
+        static_scene.update_storage(static_frame.point_lights, clusters.get_lights());
 
         VkCommandBuffer cmd = pool.allocate_command_buffer();
 
         VkCommandBufferBeginInfo begin_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
         vkBeginCommandBuffer(cmd, &begin_info);
+        frame_timer.begin(cmd, frame_slot);
 
-        vkCmdBeginRenderPass(cmd, shadowmap_render_pass->get_vk_handle(), shadow_framebuffer->get_vk_handle(), shadow_framebuffer->get_bounds(), {{1.0f, 0}});
-        list.write_commands(cmd, *shadowmap_render_pass, {per_scene, per_view_shadow});
-        vkCmdEndRenderPass(cmd); 
+        // Emit this frame's bursts and advance every particle, before any pass draws them
+        if(!cpu_particle_simulation) particles.update(cmd, pool, win.get_key(GLFW_KEY_SPACE) ? 0.0f : timestep, physics, g.particle_bursts);
+        g.particle_bursts.clear();
 
-        vkCmdBeginRenderPass(cmd, fb_render_pass->get_vk_handle(), main_framebuffer->get_vk_handle(), main_framebuffer->get_bounds(), {{0, 0, 0, 1}, {1.0f, 0}});
-        list.write_commands(cmd, *fb_render_pass, {per_scene, per_view});
-        vkCmdEndRenderPass(cmd); 
+        // Render static casters only into the caches of cascades which have moved
+        for(size_t i=0; i<cascades.get_cascade_count(); ++i)
+        {
+            if(!cascades.get_cascade(i).static_dirty) continue;
+            auto & fb = *shadow_cache_framebuffers[i];
+            transition_layout(cmd, shadow_caches[i].get_image(), 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
+            vkCmdBeginRenderPass(cmd, shadow_cache_pass->get_vk_handle(), fb.get_vk_handle(), fb.get_bounds(), {{1.0f, 0}}, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            static_scene.write_commands(cmd, *shadow_cache_pass, fb, fb.get_bounds(), {static_frame.per_scene, static_frame.per_cascade[i]});
+            vkCmdEndRenderPass(cmd);
+            transition_layout(cmd, shadow_caches[i].get_image(), 0, 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
+        }
 
-        scene_descriptor_set hipass {pool, *hipass_mtl};
-        hipass.write_combined_image_sampler(0, 0, image_sampler, color.get_image_view());
-        draw_fullscreen_pass(cmd, *aux_framebuffer1, hipass, quad_mesh);
+        // Copy every cache into its tile of the atlas, then draw dynamic casters over the top
+        transition_layout(cmd, shadow_atlas.get_image(), 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
+        for(size_t i=0; i<cascades.get_cascade_count(); ++i)
+        {
+            const uint2 offset = cascades.get_cascade(i).tile_offset;
+            const VkImageCopy region {{VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1}, {0, 0, 0}, {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1}, {static_cast<int32_t>(offset.x), static_cast<int32_t>(offset.y), 0}, {tile_dims.x, tile_dims.y, 1}};
+            vkCmdCopyImage(cmd, shadow_caches[i].get_image(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, shadow_atlas.get_image(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        }
+        transition_layout(cmd, shadow_atlas.get_image(), 0, 0, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
 
-        scene_descriptor_set hgauss {pool, *hgauss_mtl};
-        hgauss.write_combined_image_sampler(0, 0, image_sampler, color1.get_image_view());
-        draw_fullscreen_pass(cmd, *aux_framebuffer2, hgauss, quad_mesh);
+        vkCmdBeginRenderPass(cmd, shadow_atlas_pass->get_vk_handle(), shadow_atlas_framebuffer->get_vk_handle(), shadow_atlas_framebuffer->get_bounds(), {}, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        for(size_t i=0; i<cascades.get_cascade_count(); ++i)
+        {
+            const uint2 offset = cascades.get_cascade(i).tile_offset;
+            const VkRect2D tile {{static_cast<int32_t>(offset.x), static_cast<int32_t>(offset.y)}, {tile_dims.x, tile_dims.y}};
+            list.write_commands(cmd, *shadow_atlas_pass, *shadow_atlas_framebuffer, tile, {per_scene, per_cascade[i]}, threads);
+        }
+        vkCmdEndRenderPass(cmd); 
 
-        scene_descriptor_set vgauss {pool, *vgauss_mtl};
-        vgauss.write_combined_image_sampler(0, 0, image_sampler, color2.get_image_view());
-        draw_fullscreen_pass(cmd, *aux_framebuffer1, vgauss, quad_mesh);
+        vkCmdBeginRenderPass(cmd, fb_render_pass->get_vk_handle(), main_framebuffer->get_vk_handle(), viewport, {{0, 0, 0, 1}, {1.0f, 0}}, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        static_scene.write_commands(cmd, *fb_render_pass, *main_framebuffer, viewport, {static_frame.per_scene, static_frame.per_view});
+        list.write_commands(cmd, *fb_render_pass, *main_framebuffer, viewport, {per_scene, per_view}, threads);
+        debug_list.write_commands(cmd, *fb_render_pass, *main_framebuffer, viewport, {per_scene, per_view}, threads);
+        vkCmdEndRenderPass(cmd); 
+
+        post.dispatch(cmd, pool, image_sampler, color.get_image_view(), viewport_dims, grading);
 
-        scene_descriptor_set add {pool, *add_mtl};
-        add.write_combined_image_sampler(0, 0, image_sampler, color.get_image_view());
-        add.write_combined_image_sampler(1, 0, image_sampler, color1.get_image_view());
+        // Upscale the active region of the post processed scene to the whole window, beneath the GUI
+        scene_descriptor_set upscale {pool, *upscale_mtl};
+        upscale.write_uniform_buffer(0, 0, pool.write_data(float2(viewport_dims) / float2(post.get_max_dims())));
+        upscale.write_combined_image_sampler(1, 0, image_sampler, post.get_output_view());
         
         const uint32_t index = win.begin();
-        draw_fullscreen_pass(cmd, *swapchain_framebuffers[index], add, quad_mesh, &gui_list);
+        draw_fullscreen_pass(cmd, *swapchain_framebuffers[index], upscale, quad_mesh, &gui_list);
+        frame_timer.end(cmd, frame_slot);
         check(vkEndCommandBuffer(cmd));
         win.end(index, {cmd}, pool.get_fence());
+
+        if(recorder)
+        {
+            save_frame_capture("frame.capture", recorder->finish());
+            std::cout << "Wrote frame.capture" << std::endl;
+        }
     }
 
     r.wait_until_device_idle();
@@ -1,172 +1,12 @@
 #include "rts-game.h"
 #include <algorithm>
 
-namespace game
-{
-    bool move(float2 & position, const float2 & target, float max_step)
-    {
-        const auto delta = target - position;
-        const auto delta_len = length(delta);
-        if(delta_len > max_step) 
-        {
-            position += delta*(max_step/delta_len);
-            return false;
-        }
-        position = target;
-        return true;
-    }
-
-    unit * get_nearest_enemy_unit(std::vector<unit> & units, const unit & u)
-    {
-        float best_dist = std::numeric_limits<float>::infinity();
-        unit * other {};
-        for(auto & v : units)
-        {
-            if(u.owner == v.owner) continue;
-            float dist = distance2(u.position, v.position);
-            if(dist < best_dist)
-            {
-                best_dist = dist;
-                other = &v;
-            }
-        }
-        return other;
-    }
-
-    float2 get_random_position(std::mt19937 & rng, int owner)
-    {
-        std::uniform_real_distribution<float> dist_x{0, 16};
-        std::uniform_real_distribution<float> dist_y{0, 64};
-        return {dist_x(rng)+owner*48.0f, dist_y(rng)};
-    }
-}
-
 struct particle_vertex
 {
     float2 offset;
     float2 texcoord;
 };
 
-struct particle_instance
-{
-    float3 position;
-    float size;
-    float3 color;
-};
-
-/////////////////
-// game::state //
-/////////////////
-
-game::state::state()
-{
-    for(size_t i=0; i<32; ++i) units.push_back({0, 5, get_random_position(rng, 0), {+1,0}});
-    for(size_t i=0; i<32; ++i) units.push_back({1, 5, get_random_position(rng, 1), {-1,0}});
-}
-
-void game::state::advance(float timestep)
-{
-    std::normal_distribution<float> ndist;
-
-    // Move towards the nearest enemy unit, and open fire once we have reached a distance of five units
-    for(auto & u : units)
-    {
-        u.cooldown = std::max(u.cooldown - timestep, 0.0f);
-        if(auto enemy = get_nearest_enemy_unit(units, u))
-        {
-            u.direction = slerp(u.direction, normalize(enemy->position - u.position), 0.1f);
-            if(distance2(u.position, enemy->position) > 25)
-            {
-                move(u.position, enemy->position, timestep*4);
-            }
-            else if(u.cooldown == 0)
-            {
-                bullets.push_back({u.owner, u.position, enemy->position});
-                u.cooldown += 0.5f;
-            }
-        }
-    }
-
-    // Simulate movement of bullets
-    for(auto it=begin(bullets); it!=end(bullets); )
-    {
-        if(move(it->position, it->target, timestep*20))
-        {
-            // Bullets which reach their destination deal one damage to all units within a radius of one
-            for(auto & u : units)
-            {
-                if(distance2(it->position, u.position) < 1)
-                {
-                    --u.hp;
-                }
-            }
-
-            // Generate some particles at the point of impact
-            for(int i=0; i<50; ++i) 
-            {
-                auto dir = float3{ndist(rng),ndist(rng),ndist(rng)};
-                particles.push_back({it->get_position(), dir+normalize(dir)*5.0f, team_colors[it->owner]*5.0f, 0.5f});
-            }
-            flashes.push_back({it->get_position(), team_colors[it->owner]*10.0f, 0.2f});
-
-            it = bullets.erase(it);
-        }
-        else ++it;
-    }
-
-    // Respawn units that have been destroyed on this frame
-    for(auto & u : units)
-    {
-        if(u.hp < 0)
-        {
-            // Generate some particles where unit was destroyed
-            for(int i=0; i<100; ++i) 
-            {
-                auto dir = float3{ndist(rng),ndist(rng),ndist(rng)};
-                particles.push_back({{u.position, 0.25f}, dir+normalize(dir)*5.0f, {6,4,2}, 1.0f});
-            }
-            flashes.push_back({{u.position, 0.25f}, {10,10,10}, 0.3f});
-
-            // Reset unit to new location
-            u.position = get_random_position(rng, u.owner);
-            u.direction = {u.owner ? -1.0f : +1.0f, 0};
-            u.hp = 5;
-            u.cooldown = 0;
-        }
-    }
-
-    // Push overlapping units apart
-    for(auto & u : units)
-    {
-        for(auto & v : units)
-        {
-            if(&u == &v) continue;
-            auto delta = v.position - u.position;
-            auto delta_len2 = length2(delta);
-            if(delta_len2 > 4) continue;
-            auto delta_len = std::sqrt(delta_len2);
-            delta *= (2-delta_len)*0.5f;
-            u.position -= delta;
-            v.position += delta;
-        }
-    }
-
-    // Simulate particles
-    const float3 gravity {0,0,-2};
-    for(auto & p : particles)
-    {
-        p.position += p.velocity * timestep + gravity * (timestep*timestep/2);
-        p.velocity += gravity * timestep;
-        if(p.position.z < 0 && p.velocity.z < 0) p.velocity.z *= -0.5f;
-        p.life -= timestep;
-    }
-    particles.erase(std::remove_if(begin(particles), end(particles), [](const particle & p) { return p.life <= 0; }), end(particles));
-
-    // Simulate flashes
-    for(auto & f : flashes) f.life -= timestep;
-    flashes.erase(std::remove_if(begin(flashes), end(flashes), [](const flash & f) { return f.life <= 0; }), end(flashes));
-}
-
 /////////////////////
 // game::resources //
 /////////////////////
@@ -187,15 +27,16 @@ std::ostream & print_type(std::ostream & out, const shader_info::type & type, in
 {
     if(auto * s = std::get_if<shader_info::sampler>(&type.contents)) 
     {
+        out << (s->storage ? "image" : "sampler");
         switch(s->view_type)
         {
-        case VK_IMAGE_VIEW_TYPE_1D: out << "sampler1D"; break;
-        case VK_IMAGE_VIEW_TYPE_2D: out << "sampler2D"; break;
-        case VK_IMAGE_VIEW_TYPE_3D: out << "sampler3D"; break;
-        case VK_IMAGE_VIEW_TYPE_CUBE: out << "samplerCube"; break;
-        case VK_IMAGE_VIEW_TYPE_1D_ARRAY: out << "sampler1DArray"; break;
-        case VK_IMAGE_VIEW_TYPE_2D_ARRAY: out << "sampler2DArray"; break;
-        case VK_IMAGE_VIEW_TYPE_CUBE_ARRAY: out << "samplerCubeArray"; break;
+        case VK_IMAGE_VIEW_TYPE_1D: out << "1D"; break;
+        case VK_IMAGE_VIEW_TYPE_2D: out << "2D"; break;
+        case VK_IMAGE_VIEW_TYPE_3D: out << "3D"; break;
+        case VK_IMAGE_VIEW_TYPE_CUBE: out << "Cube"; break;
+        case VK_IMAGE_VIEW_TYPE_1D_ARRAY: out << "1DArray"; break;
+        case VK_IMAGE_VIEW_TYPE_2D_ARRAY: out << "2DArray"; break;
+        case VK_IMAGE_VIEW_TYPE_CUBE_ARRAY: out << "CubeArray"; break;
         }
         return out << (s->multisampled ? "MS" : "") << (s->shadow ? "Shadow" : "") << "<" << s->channel << ">";
     }
@@ -238,6 +79,7 @@ game::resources::resources(renderer & r, std::shared_ptr<scene_contract> contrac
     bullet_mesh = std::make_shared<gfx_mesh>(r.ctx, apply_vertex_color(generate_box_mesh({-0.05f,-0.1f,-0.05f},{+0.05f,+0.1f,0.05f}), {2,2,2}));
     const particle_vertex particle_vertices[] {{{-0.5f,-0.5f}, {0,0}}, {{-0.5f,+0.5f}, {0,1}}, {{+0.5f,+0.5f}, {1,1}}, {{+0.5f,-0.5f}, {1,0}}};
     const uint32_t particle_indices[] {0, 1, 2, 0, 2, 3};
+    for(auto & o : obstacles) obstacle_meshes.push_back(std::make_shared<gfx_mesh>(r.ctx, apply_vertex_color(generate_box_mesh({float2(o.min_cell)*flow_cell_size, 0}, {float2(o.max_cell)*flow_cell_size, 3}), {0.6f,0.6f,0.6f})));
     particle_mesh = std::make_shared<gfx_mesh>(std::make_unique<static_buffer>(r.ctx, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sizeof(particle_vertices), particle_vertices),
                                                std::make_unique<static_buffer>(r.ctx, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sizeof(particle_indices), particle_indices), 6);
 
@@ -293,43 +135,84 @@ game::resources::resources(renderer & r, std::shared_ptr<scene_contract> contrac
     particle_mtl = r.create_material(contract, particle_vertex_format, {particle_vert_shader, particle_frag_shader}, false, true, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE);
 }
 
-/////////////////////
-// game::draw(...) //
-/////////////////////
+void game::resources::register_names(resource_registry & registry) const
+{
+    registry.add("standard_mtl", *standard_mtl);
+    registry.add("glow_mtl", *glow_mtl);
+    registry.add("particle_mtl", *particle_mtl);
+    registry.add("terrain_mesh", *terrain_mesh);
+    registry.add("unit0_mesh", *unit0_mesh);
+    registry.add("unit1_mesh", *unit1_mesh);
+    registry.add("bullet_mesh", *bullet_mesh);
+    registry.add("particle_mesh", *particle_mesh);
+    for(size_t i=0; i<obstacle_meshes.size(); ++i) registry.add("obstacle_mesh" + std::to_string(i), *obstacle_meshes[i]);
+    registry.add("terrain_tex", *terrain_tex);
+    registry.add("unit0_tex", *unit0_tex);
+    registry.add("unit1_tex", *unit1_tex);
+    registry.add("bullet_tex", *bullet_tex);
+    registry.add("particle_tex", *particle_tex);
+    registry.add("linear_sampler", *linear_sampler);
+}
+
+///////////////////////////////////////////
+// game::draw_static(...), game::draw(...) //
+///////////////////////////////////////////
 
-void game::draw(draw_list & list, per_scene_uniforms & ps, const resources & r, const state & s)
+void game::draw_static(draw_list & list, const resources & r)
 {
-    {
-        auto descriptors = list.descriptor_set(*r.standard_mtl);
-        descriptors.write_uniform_buffer(0, 0, list.upload_uniforms(per_static_object{translation_matrix(float3{0,0,0})}));
-        descriptors.write_combined_image_sampler(1, 0, *r.linear_sampler, *r.terrain_tex);
-        list.draw(descriptors, *r.terrain_mesh);
-    }
+    auto descriptors = list.descriptor_set(*r.standard_mtl);
+    descriptors.write_uniform_buffer(0, 0, list.upload_uniforms(per_static_object{translation_matrix(float3{0,0,0})}));
+    descriptors.write_combined_image_sampler(1, 0, *r.linear_sampler, *r.terrain_tex);
+    list.draw(descriptors, *r.terrain_mesh);
+    for(auto & m : r.obstacle_meshes) list.draw(descriptors, *m);
+}
 
-    for(auto & f : s.flashes)
-    {
-        if(ps.u_num_point_lights < 64) ps.u_point_lights[ps.u_num_point_lights++] = {f.position, f.color*f.life};
-    }
+void game::draw(draw_list & list, std::vector<clustered_light> & lights, const resources & r, const state & s, thread_pool & threads)
+{
+    const float3 * flash_positions = s.flashes.column<flash_position>(), * flash_colors = s.flashes.column<flash_color>();
+    const float * flash_lives = s.flashes.column<flash_life>();
+    for(size_t i=0; i<s.flashes.size(); ++i) lights.push_back({flash_positions[i], 16.0f, flash_colors[i]*flash_lives[i]});
 
-    for(auto & u : s.units)
+    // Units are recorded in parallel into one shard per thread, which are appended in order so that the list is deterministic
+    std::vector<draw_list> shards;
+    for(size_t i=0; i<threads.get_thread_count(); ++i) shards.emplace_back(list.pool.get_sub_pool(i), list.contract);
+    threads.run(shards.size(), [&](size_t i)
     {
-        auto descriptors = list.descriptor_set(*r.standard_mtl);
-        descriptors.write_uniform_buffer(0, 0, list.upload_uniforms(per_static_object{u.get_model_matrix(), game::team_colors[u.owner]*std::max(u.cooldown*4-1.5f,0.0f)}));
-        descriptors.write_combined_image_sampler(1, 0, *r.linear_sampler, u.owner ? *r.unit1_tex : *r.unit0_tex);
-        list.draw(descriptors, u.owner ? *r.unit1_mesh : *r.unit0_mesh);
-    }
+        auto & shard = shards[i];
+        for(size_t j=s.units.size()*i/shards.size(), n=s.units.size()*(i+1)/shards.size(); j<n; ++j)
+        {
+            auto & u = s.units[j];
+            auto descriptors = shard.descriptor_set(*r.standard_mtl);
+            descriptors.write_uniform_buffer(0, 0, shard.upload_uniforms(per_static_object{get_model_matrix(u), game::team_colors[u.owner]*std::max(u.cooldown*4-1.5f,0.0f)}));
+            descriptors.write_combined_image_sampler(1, 0, *r.linear_sampler, u.owner ? *r.unit1_tex : *r.unit0_tex);
+            shard.draw(descriptors, u.owner ? *r.unit1_mesh : *r.unit0_mesh);
+        }
+    });
+    for(auto & shard : shards) list.append(shard);
 
-    for(auto & b : s.bullets)
+    for(size_t i=0; i<s.bullets.size(); ++i)
     {
+        const auto b = get_bullet(s.bullets, i);
         auto descriptors = list.descriptor_set(*r.glow_mtl);
-        descriptors.write_uniform_buffer(0, 0, list.upload_uniforms(per_static_object{b.get_model_matrix()}));
+        descriptors.write_uniform_buffer(0, 0, list.upload_uniforms(per_static_object{get_model_matrix(b)}));
         list.draw(descriptors, *r.bullet_mesh);
-        if(ps.u_num_point_lights < 64) ps.u_point_lights[ps.u_num_point_lights++] = {b.get_position(), game::team_colors[b.owner]};
+        lights.push_back({b.get_position(), 16.0f, game::team_colors[b.owner]});
     }
+}
 
-    auto particle_descriptors = list.descriptor_set(*r.particle_mtl);
-    particle_descriptors.write_combined_image_sampler(0, 0, *r.linear_sampler, *r.particle_tex);
+void game::draw_particles(draw_list & list, const resources & r, const gpu_particles & particles)
+{
+    auto descriptors = list.descriptor_set(*r.particle_mtl);
+    descriptors.write_combined_image_sampler(0, 0, *r.linear_sampler, *r.particle_tex);
+    list.draw_indirect(descriptors, *r.particle_mesh, particles.get_instances(), particles.get_draw_arguments());
+}
+
+void game::draw_particles(draw_list & list, const resources & r, const particle_pool & particles)
+{
+    // Interleave every particle directly into the instance ring
     list.begin_instances();
-    for(auto & p : s.particles) list.write_instance(particle_instance{p.position, p.life/3, p.color});           
-    list.draw(particle_descriptors, *r.particle_mesh, list.end_instances(), sizeof(particle_instance));
+    particles.write_instances(list.reserve_instances<particle_instance>(particles.size()));
+    auto descriptors = list.descriptor_set(*r.particle_mtl);
+    descriptors.write_combined_image_sampler(0, 0, *r.linear_sampler, *r.particle_tex);
+    list.draw(descriptors, *r.particle_mesh, list.end_instances(), sizeof(particle_instance));
 }
\ No newline at end of file
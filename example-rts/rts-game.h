@@ -1,66 +1,21 @@
 #ifndef RTS_GAME_H
 #define RTS_GAME_H
 
+#include "rts-state.h"
 #include "renderer.h"
-#include <random>
+#include "capture.h"
+#include "light-clusters.h"
+#include "shadow-cascades.h"
+#include "gpu-particles.h"
 
 namespace game
 {
     constexpr coord_system coords {coord_axis::east, coord_axis::north, coord_axis::up};
-    constexpr float3 team_colors[] {{0.5f,0.5f,0.0f}, {0.2f,0.2f,1.0f}};
 
-    struct unit
-    {
-        int owner;
-        int hp;
-        float2 position;
-        float2 direction;
-        float cooldown;
-
-        float3 get_position() const { return {position,0.5f}; }
-        float3 get_direction() const { return {direction,0}; }
-        float4 get_orientation() const { return rotation_quat(coords.get_axis(coord_axis::north), get_direction()); }
-        float_pose get_pose() const { return {get_orientation(), get_position()}; }
-        float4x4 get_model_matrix() const { return pose_matrix(get_pose()); }
-    };
-
-    struct bullet
-    {
-        int owner;
-        float2 position;
-        float2 target;
-
-        float3 get_position() const { return {position,0.75f}; }
-        float3 get_direction() const { return {normalize(target-position),0}; }
-        float4 get_orientation() const { return rotation_quat(coords.get_axis(coord_axis::north), get_direction()); }
-        float_pose get_pose() const { return {get_orientation(), get_position()}; }
-        float4x4 get_model_matrix() const { return pose_matrix(get_pose()); }
-    };
-
-    struct particle
-    {
-        float3 position, velocity, color; 
-        float life;
-    };
-
-    struct flash
-    {
-        float3 position;
-        float3 color;
-        float life;
-    };
-
-    struct state
-    {
-        std::mt19937 rng;
-        std::vector<unit> units;
-        std::vector<bullet> bullets;
-        std::vector<particle> particles;
-        std::vector<flash> flashes;
-
-        state();
-        void advance(float timestep);
-    };
+    // Units and bullets face along their direction of travel
+    inline float4x4 get_model_matrix(const float3 & position, const float3 & direction) { return pose_matrix(float_pose{rotation_quat(coords.get_axis(coord_axis::north), direction), position}); }
+    inline float4x4 get_model_matrix(const unit & u) { return get_model_matrix(u.get_position(), u.get_direction()); }
+    inline float4x4 get_model_matrix(const bullet & b) { return get_model_matrix(b.get_position(), b.get_direction()); }
 
     // Immutable GPU resources used during rendering
     struct resources
@@ -73,6 +28,7 @@ namespace game
         std::shared_ptr<gfx_mesh> unit1_mesh;
         std::shared_ptr<gfx_mesh> bullet_mesh;
         std::shared_ptr<gfx_mesh> particle_mesh;
+        std::vector<std::shared_ptr<gfx_mesh>> obstacle_meshes;
         std::shared_ptr<texture> terrain_tex;
         std::shared_ptr<texture> unit0_tex;
         std::shared_ptr<texture> unit1_tex;
@@ -81,24 +37,22 @@ namespace game
         std::shared_ptr<sampler> linear_sampler;
 
         resources(renderer & r, std::shared_ptr<scene_contract> contract);
-    };
 
-    // Uniforms which are constant for the entire scene
-    struct point_light
-    {
-	    alignas(16) float3 u_position;
-	    alignas(16) float3 u_color;
+        // Assign names to our resources so that captured frames can refer to them
+        void register_names(resource_registry & registry) const;
     };
 
+    // Uniforms which are constant for the entire scene
     struct per_scene_uniforms
     {
-        alignas(16) float4x4 shadow_map_matrix;
-        alignas(16) float3 shadow_light_pos;
+        alignas(16) float4x4 cascade_matrices[4];
+        alignas(16) float4 cascade_far_depths;
 	    alignas(16) float3 ambient_light;
 	    alignas(16) float3 light_direction;
 	    alignas(16) float3 light_color;
-	    alignas(16) point_light u_point_lights[64];
-	    alignas(16) int u_num_point_lights;
+	    alignas(16) uint3 cluster_dims;
+	    float cluster_depth_scale;
+	    float cluster_depth_bias;
     };
 
     // Uniforms which are constant within a single viewport
@@ -117,7 +71,10 @@ namespace game
         alignas(16) float3 emissive_mtl;
     };
 
-    void draw(draw_list & list, per_scene_uniforms & ps, const resources & r, const state & s);
+    void draw_static(draw_list & list, const resources & r); // Scenery which does not change from frame to frame
+    void draw(draw_list & list, std::vector<clustered_light> & lights, const resources & r, const state & s, thread_pool & threads);
+    void draw_particles(draw_list & list, const resources & r, const gpu_particles & particles);
+    void draw_particles(draw_list & list, const resources & r, const particle_pool & particles);
 }
 
 #endif
\ No newline at end of file
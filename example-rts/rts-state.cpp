@@ -0,0 +1,219 @@
+#include "rts-state.h"
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+namespace game
+{
+    bool move(float2 & position, const float2 & target, float max_step)
+    {
+        const auto delta = target - position;
+        const auto delta_len = length(delta);
+        if(delta_len > max_step) 
+        {
+            position += delta*(max_step/delta_len);
+            return false;
+        }
+        position = target;
+        return true;
+    }
+
+    // Split [0,count) into chunk_count contiguous ranges, in order, and call f(chunk, begin, end) for each of them in parallel
+    template<class F> void parallel_for(thread_pool & threads, size_t chunk_count, size_t count, F f)
+    {
+        threads.run(chunk_count, [&](size_t chunk) { f(chunk, count*chunk/chunk_count, count*(chunk+1)/chunk_count); });
+    }
+
+    float2 get_random_position(std::mt19937 & rng, int owner)
+    {
+        std::uniform_real_distribution<float> dist_x{0, 16};
+        std::uniform_real_distribution<float> dist_y{0, 64};
+        return {dist_x(rng)+owner*48.0f, dist_y(rng)};
+    }
+}
+
+/////////////////
+// game::state //
+/////////////////
+
+game::state::state()
+{
+    std::mt19937 rng;
+    for(size_t i=0; i<32; ++i) units.push_back({0, 5, get_random_position(rng, 0), {+1,0}});
+    for(size_t i=0; i<32; ++i) units.push_back({1, 5, get_random_position(rng, 1), {-1,0}});
+    for(auto & o : obstacles) for(int y=o.min_cell.y; y<o.max_cell.y; ++y) for(int x=o.min_cell.x; x<o.max_cell.x; ++x) flows.set_cost({x,y}, cost_field::impassable);
+}
+
+void game::state::advance(float timestep, thread_pool & threads)
+{
+    // Each phase only reads state which no task of the same phase writes, and gathers anything it creates into the events of its range.
+    // Events are merged in order of the ranges, which is the order a single thread would have produced them in.
+    const size_t chunk_count = threads.get_thread_count();
+    chunk_events.resize(chunk_count);
+    for(auto & e : chunk_events)
+    {
+        e.bullets.clear();
+        e.arrived_bullets.clear();
+        e.impacts.clear();
+        e.hit_units.clear();
+    }
+    auto merge_effects = [this]()
+    {
+        for(auto & e : chunk_events)
+        {
+            particle_bursts.insert(end(particle_bursts), begin(e.particle_bursts), end(e.particle_bursts));
+            for(auto & f : e.flashes) flashes.insert(f.position, f.color, f.life);
+            e.particle_bursts.clear();
+            e.flashes.clear();
+        }
+    };
+
+    // Move towards the nearest enemy unit, and open fire once we have reached a distance of five units. Enemies are found from the 
+    // positions of units at the start of the step.
+    const float max_step = timestep*4;
+    unit_positions.resize(units.size());
+    for(size_t i=0; i<units.size(); ++i) unit_positions[i] = units[i].position;
+    unit_grid.build(unit_positions.size(), [&](uint32_t i) { return unit_positions[i]; });
+    unit_targets.resize(units.size());
+    parallel_for(threads, chunk_count, units.size(), [&](size_t, size_t first, size_t last)
+    {
+        for(size_t i=first; i<last; ++i) unit_targets[i] = unit_grid.find_nearest(unit_positions[i], [&](uint32_t j) { return unit_positions[j]; }, 0, [&](uint32_t j) { return units[j].owner != units[i].owner; });
+    });
+
+    // Units which are out of range path around obstacles using the flow field towards the cell of their target, which is shared with
+    // every other unit chasing a target in that cell
+    unit_flows.assign(units.size(), nullptr);
+    for(size_t i=0; i<units.size(); ++i)
+    {
+        if(!unit_targets[i]) continue;
+        const float2 target = unit_positions[*unit_targets[i]];
+        if(distance2(unit_positions[i], target) > 25) unit_flows[i] = &flows.get_field(flows.get_costs().get_cell(target));
+    }
+    parallel_for(threads, chunk_count, units.size(), [&](size_t chunk, size_t first, size_t last)
+    {
+        for(size_t i=first; i<last; ++i)
+        {
+            auto & u = units[i];
+            u.cooldown = std::max(u.cooldown - timestep, 0.0f);
+            if(!unit_targets[i]) continue;
+            const float2 target = unit_positions[*unit_targets[i]];
+
+            // Follow the field until reaching the cell of the target, then head straight for it
+            const float2 flow = unit_flows[i] ? unit_flows[i]->get_direction(u.position) : float2{0,0};
+            const bool follow_flow = flow != float2{0,0};
+            u.direction = slerp(u.direction, follow_flow ? flow : normalize(target - u.position), 0.1f);
+            if(unit_flows[i])
+            {
+                if(follow_flow) u.position += flow*max_step;
+                else move(u.position, target, max_step);
+            }
+            else if(u.cooldown == 0)
+            {
+                chunk_events[chunk].bullets.push_back({u.owner, u.position, target});
+                u.cooldown += 0.5f;
+            }
+        }
+    });
+    for(auto & e : chunk_events) for(auto & b : e.bullets) bullets.insert(b.owner, b.position, b.target);
+
+    // Simulate movement of bullets, removing those which have reached their destination
+    const int * bullet_owners = bullets.column<bullet_owner>();
+    float2 * bullet_positions = bullets.column<bullet_position>();
+    const float2 * bullet_targets = bullets.column<bullet_target>();
+    parallel_for(threads, chunk_count, bullets.size(), [&](size_t chunk, size_t first, size_t last)
+    {
+        auto & e = chunk_events[chunk];
+        for(size_t i=first; i<last; ++i)
+        {
+            if(!move(bullet_positions[i], bullet_targets[i], timestep*20)) continue;
+            e.arrived_bullets.push_back(bullets.get_handle(i));
+            e.impacts.push_back(bullet_positions[i]);
+
+            // Generate some particles at the point of impact
+            const float3 position {bullet_positions[i], 0.75f};
+            e.particle_bursts.push_back({position, 50, team_colors[bullet_owners[i]]*5.0f, 0.5f, 5.0f, 1.0f, 1.0f/3});
+            e.flashes.push_back({position, team_colors[bullet_owners[i]]*10.0f, 0.2f});
+        }
+    });
+    impacts.clear();
+    for(auto & e : chunk_events)
+    {
+        for(auto & h : e.arrived_bullets) bullets.erase(h);
+        impacts.insert(end(impacts), begin(e.impacts), end(e.impacts));
+    }
+    merge_effects();
+
+    // Bullets which reached their destination deal one damage to all units within a radius of one. Units have moved by up to one step
+    // since the grid was built. Damage is summed, so the order in which hits are applied does not matter.
+    parallel_for(threads, chunk_count, impacts.size(), [&](size_t chunk, size_t first, size_t last)
+    {
+        auto & e = chunk_events[chunk];
+        for(size_t i=first; i<last; ++i)
+        {
+            unit_grid.find_within(impacts[i], 1, [&](uint32_t j) { return units[j].position; }, max_step, [](uint32_t) { return true; }, e.query_results);
+            e.hit_units.insert(end(e.hit_units), begin(e.query_results), end(e.query_results));
+        }
+    });
+    for(auto & e : chunk_events) for(auto i : e.hit_units) --units[i].hp;
+
+    // Respawn units that have been destroyed on this step, at a position drawn from a random stream seeded by the step and the unit
+    parallel_for(threads, chunk_count, units.size(), [&](size_t chunk, size_t first, size_t last)
+    {
+        auto & e = chunk_events[chunk];
+        for(size_t i=first; i<last; ++i)
+        {
+            auto & u = units[i];
+            if(u.hp >= 0) continue;
+
+            // Generate some particles where unit was destroyed
+            e.particle_bursts.push_back({{u.position, 0.25f}, 100, {6,4,2}, 1.0f, 5.0f, 1.0f, 1.0f/3});
+            e.flashes.push_back({{u.position, 0.25f}, {10,10,10}, 0.3f});
+
+            // Reset unit to new location
+            std::seed_seq seed {static_cast<uint32_t>(tick), static_cast<uint32_t>(tick >> 32), static_cast<uint32_t>(i)};
+            std::mt19937 rng {seed};
+            u.position = get_random_position(rng, u.owner);
+            u.direction = {u.owner ? -1.0f : +1.0f, 0};
+            u.hp = 5;
+            u.cooldown = 0;
+        }
+    });
+    merge_effects();
+
+    // Push overlapping units apart, by the sum of the pushes from every unit which overlapped them at the start of the pass. Pairs are 
+    // gathered into a list of neighbors for each unit, so that each unit sums its pushes in order of increasing neighbor index.
+    unit_grid.build(units.size(), [&](uint32_t i) { return units[i].position; });
+    unit_grid.find_pairs(2, unit_pairs, &threads);
+    for(size_t i=0; i<units.size(); ++i) unit_positions[i] = units[i].position;
+    neighbor_starts.assign(units.size()+1, 0);
+    for(auto & p : unit_pairs) { ++neighbor_starts[p.x]; ++neighbor_starts[p.y]; }
+    std::partial_sum(begin(neighbor_starts), end(neighbor_starts), begin(neighbor_starts));
+    neighbors.resize(neighbor_starts.back());
+    for(auto it=rbegin(unit_pairs); it!=rend(unit_pairs); ++it)
+    {
+        neighbors[--neighbor_starts[it->x]] = it->y;
+        neighbors[--neighbor_starts[it->y]] = it->x;
+    }
+    parallel_for(threads, chunk_count, units.size(), [&](size_t, size_t first, size_t last)
+    {
+        for(size_t i=first; i<last; ++i)
+        {
+            float2 offset {0,0};
+            for(uint32_t k=neighbor_starts[i]; k<neighbor_starts[i+1]; ++k)
+            {
+                auto delta = unit_positions[neighbors[k]] - unit_positions[i];
+                auto delta_len2 = length2(delta);
+                if(delta_len2 > 4) continue;
+                offset -= delta*((2-std::sqrt(delta_len2))*0.5f);
+            }
+            units[i].position = unit_positions[i] + offset;
+        }
+    });
+
+    // Simulate flashes
+    float * flash_lives = flashes.column<flash_life>();
+    parallel_for(threads, chunk_count, flashes.size(), [&](size_t, size_t first, size_t last) { for(size_t i=first; i<last; ++i) flash_lives[i] -= timestep; });
+    flashes.erase_rows_if([&](size_t i) { return flash_lives[i] <= 0; });
+    flows.update();
+    ++tick;
+}
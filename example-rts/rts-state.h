@@ -0,0 +1,95 @@
+#ifndef RTS_STATE_H
+#define RTS_STATE_H
+
+#include "particle-pool.h"
+#include "spatial-grid.h"
+#include "soa-table.h"
+#include "flow-field.h"
+#include "thread-pool.h"
+
+// The simulation of the game, which is kept apart from rendering so that it can be tested without a GPU
+namespace game
+{
+    constexpr float3 team_colors[] {{0.5f,0.5f,0.0f}, {0.2f,0.2f,1.0f}};
+
+    // Impassable blocks between the two armies, as ranges of cells of the flow field grid over the map, from min_cell up to but
+    // excluding max_cell
+    struct obstacle { int2 min_cell, max_cell; };
+    constexpr float flow_cell_size = 4;
+    constexpr int2 flow_grid_dims {16,16};
+    constexpr obstacle obstacles[] {{{7,1},{9,5}}, {{7,7},{9,9}}, {{7,11},{9,15}}};
+
+    struct unit
+    {
+        int owner;
+        int hp;
+        float2 position;
+        float2 direction;
+        float cooldown;
+
+        float3 get_position() const { return {position,0.5f}; }
+        float3 get_direction() const { return {direction,0}; }
+    };
+
+    struct bullet
+    {
+        int owner;
+        float2 position;
+        float2 target;
+
+        float3 get_position() const { return {position,0.75f}; }
+        float3 get_direction() const { return {normalize(target-position),0}; }
+    };
+
+    // Bullets and flashes are stored as structures of arrays, with these columns
+    enum bullet_column : size_t { bullet_owner, bullet_position, bullet_target };
+    enum flash_column : size_t { flash_position, flash_color, flash_life };
+    using bullet_table = soa_table<int, float2, float2>;
+    using flash_table = soa_table<float3, float3, float>;
+
+    inline bullet get_bullet(const bullet_table & bullets, size_t row) { return {bullets.column<bullet_owner>()[row], bullets.column<bullet_position>()[row], bullets.column<bullet_target>()[row]}; }
+
+    struct flash
+    {
+        float3 position;
+        float3 color;
+        float life;
+    };
+
+    // Everything created by one phase of advance(...) over a contiguous range of units or bullets, to be merged in order of the ranges
+    struct step_events
+    {
+        std::vector<bullet> bullets;
+        std::vector<soa_handle> arrived_bullets;
+        std::vector<float2> impacts;
+        std::vector<uint32_t> hit_units, query_results;
+        std::vector<particle_burst> particle_bursts;
+        std::vector<flash> flashes;
+    };
+
+    struct state
+    {
+        uint64_t tick {0}; // Number of calls to advance(...), from which the random numbers of each step are derived
+        std::vector<unit> units;
+        bullet_table bullets;
+        std::vector<particle_burst> particle_bursts; // Requested since the last frame
+        flash_table flashes;
+        spatial_grid unit_grid {4.0f};              // Rebuilt from the positions of units during each advance(...)
+        flow_field_cache flows {cost_field{{0,0}, flow_cell_size, flow_grid_dims}}; // Shared by every unit chasing a target in the same cell
+        std::vector<std::optional<uint32_t>> unit_targets;  // Nearest enemy of each unit at the start of the current advance(...)
+        std::vector<const flow_field *> unit_flows;         // Field leading towards the target of each unit which is out of range
+        std::vector<float2> unit_positions;         // Positions of units at the start of the current phase of advance(...)
+        std::vector<uint2> unit_pairs;              // Scratch space for pairs of overlapping units
+        std::vector<uint32_t> neighbor_starts;      // Index into neighbors of the first overlapping unit of each unit, and of the end
+        std::vector<uint32_t> neighbors;            // Indices of the units overlapping each unit, in increasing order
+        std::vector<float2> impacts;                // Scratch space for the positions where bullets landed during advance(...)
+        std::vector<step_events> chunk_events;      // One per range of units or bullets processed in parallel
+
+        state();
+
+        // Phases of the step run in parallel over ranges of units or bullets, and the result is identical for any number of threads
+        void advance(float timestep, thread_pool & threads);
+    };
+}
+
+#endif
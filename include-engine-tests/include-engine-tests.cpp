@@ -1,4 +1,19 @@
 #include "linalg.h"
+#include "light-clusters.h"
+#include "shadow-cascades.h"
+#include "dynamic-resolution.h"
+#include "particle-pool.h"
+#include "skyline-packer.h"
+#include "distance-field.h"
+#include "spatial-grid.h"
+#include "soa-table.h"
+#include "flow-field.h"
+#include "thread-pool.h"
+#include "utility.h"
+#include "rts-state.h"
+#include <random>
+#include <chrono>
+#include <iostream>
 using namespace linalg::aliases;
 
 #define CATCH_CONFIG_MAIN
@@ -75,4 +90,442 @@ TEST_CASE("transform functions", "[transform]")
     test_transform(float4x4{{0,0,1,0},{0,1,0,0},{-1,0,0,0},{0,0,0,1}}, true, true); // rotation
     test_transform(float4x4{{0,1,0,0},{0,0,1,0},{1,0,0,0},{0,0,0,1}}, true, true); // rotation
     test_transform(float4x4{{-1,0,0,0},{0,1,0,0},{0,0,1,0},{0,0,0,1}}, true, true); // mirror
-}
\ No newline at end of file
+}
+
+TEST_CASE("light clusters", "[lighting]")
+{
+    // Forward is +z, so view depth is simply z. Place a small light in the middle of a depth slice, in the center of the view.
+    light_clusters clusters {{4,4,8}, 1.0f, 100.0f, 16, 64};
+    const uint32_t slice = 4;
+    const float depth = std::exp((slice + 0.5f - clusters.get_depth_bias()) / clusters.get_depth_scale());
+    const auto view_proj_matrix = linalg::perspective_matrix(1.57f, 1.0f, 1.0f, 100.0f, linalg::pos_z, linalg::zero_to_one);
+    clusters.assign(view_proj_matrix, {
+        {{0,0,depth}, 0.5f, {1,1,1}},   // Small light in the center of the view
+        {{0,0,-10}, 5.0f, {1,1,1}},     // Light behind the eye
+        {{1000,0,10}, 5.0f, {1,1,1}},   // Light far off to the side
+        {{0,0,0}, 200.0f, {1,1,1}},     // Light which covers every froxel, and so overflows the index list
+    });
+    REQUIRE(clusters.get_lights().size() == 3);
+
+    // The center light touches the four central tiles of its depth slice, and the culled lights touch nothing
+    REQUIRE(clusters.get_light_indices().size() == 4);
+    for(uint32_t y=0; y<4; ++y)
+    {
+        for(uint32_t x=0; x<4; ++x)
+        {
+            const auto range = clusters.get_ranges()[clusters.get_cluster_index({x,y,slice})];
+            const uint32_t expected_count = (x == 1 || x == 2) && (y == 1 || y == 2) ? 1 : 0;
+            REQUIRE(range.y == expected_count);
+            if(range.y) REQUIRE(clusters.get_light_indices()[range.x] == 0);
+        }
+    }
+}
+
+TEST_CASE("shadow cascades", "[shadows]")
+{
+    // Forward is +z, so view depth is simply z. The light shines down and across the scene.
+    shadow_cascades cascades {4, 1024};
+    REQUIRE(cascades.get_atlas_size() == uint2(2048,2048));
+    const float3 light_direction {1,1,-2}, caster_min {-200,-200,-10}, caster_max {200,200,10};
+    const auto proj_matrix = linalg::perspective_matrix(1.0f, 1.0f, 1.0f, 100.0f, linalg::pos_z, linalg::zero_to_one);
+    auto update = [&](const float3 & eye) { cascades.update(mul(proj_matrix, linalg::translation_matrix(-eye)), 1.0f, 100.0f, light_direction, caster_min, caster_max); };
+    auto count_dirty = [&]() { int n=0; for(size_t i=0; i<cascades.get_cascade_count(); ++i) n += cascades.get_cascade(i).static_dirty; return n; };
+
+    // Cascades cover the view depth range in order, and the center of each slice falls within its cascade
+    update({0,0,0});
+    REQUIRE(count_dirty() == 4);
+    REQUIRE(cascades.get_cascade(0).near_depth == Approx(1.0f));
+    REQUIRE(cascades.get_cascade(3).far_depth == Approx(100.0f));
+    for(size_t i=0; i<cascades.get_cascade_count(); ++i)
+    {
+        const auto & c = cascades.get_cascade(i);
+        if(i > 0) REQUIRE(c.near_depth == cascades.get_cascade(i-1).far_depth);
+        const float4 p = mul(c.view_proj_matrix, float4{0, 0, (c.near_depth + c.far_depth)/2, 1});
+        REQUIRE(std::abs(p.x) < 1);
+        REQUIRE(std::abs(p.y) < 1);
+        REQUIRE(p.z > 0);
+        REQUIRE(p.z < 1);
+    }
+
+    // Moving the camera by a small fraction of a texel leaves every cascade exactly where it was, while moving it further does not
+    const float4x4 first_matrix = cascades.get_cascade(0).view_proj_matrix;
+    update({0.00001f,0,0});
+    REQUIRE(count_dirty() == 0);
+    REQUIRE(cascades.get_cascade(0).view_proj_matrix == first_matrix);
+    update({10,0,0});
+    REQUIRE(count_dirty() == 4);
+
+    // Invalidating static casters marks every cascade dirty on the next update only
+    cascades.invalidate_static();
+    update({10,0,0});
+    REQUIRE(count_dirty() == 4);
+    update({10,0,0});
+    REQUIRE(count_dirty() == 0);
+}
+
+TEST_CASE("dynamic resolution", "[resolution]")
+{
+    // Simulate a GPU with a fixed cost per frame plus a cost per pixel, which starts out too heavy for the target at full resolution
+    resolution_controller controller {{1280,720}, 1.0f/60, 0.5f, 8};
+    auto simulate = [&](float per_pixel_seconds) { for(int i=0; i<200; ++i) controller.update(0.004f + per_pixel_seconds * controller.get_scale() * controller.get_scale()); };
+    REQUIRE(controller.get_viewport_dims() == uint2(1280,720));
+
+    // The scale settles where the frame time is within the band below the target
+    simulate(0.02f);
+    const float settled_seconds = 0.004f + 0.02f * controller.get_scale() * controller.get_scale();
+    REQUIRE(controller.get_scale() < 1.0f);
+    REQUIRE(settled_seconds <= 1.0f/60);
+    REQUIRE(settled_seconds >= 0.85f/60);
+    REQUIRE(controller.get_viewport_dims() == uint2(960,540));
+
+    // Under impossible loads the scale stops at its minimum, and it returns to full resolution once the load is light
+    simulate(1.0f);
+    REQUIRE(controller.get_scale() == Approx(0.5f));
+    simulate(0.005f);
+    REQUIRE(controller.get_scale() == Approx(1.0f));
+}
+
+TEST_CASE("particle pool", "[particles]")
+{
+    particle_pool pool;
+    pool.emit({{0,0,1}, 100, {1,2,3}, 1.0f, 5.0f, 1.0f, 0.5f, 0});
+    pool.emit({{0,0,1}, 13, {1,2,3}, 0.25f, 5.0f, 1.0f, 0.5f, 0});
+    REQUIRE(pool.size() == 113);
+
+    // Every particle starts at the burst position, moving at least as fast as the burst speed
+    for(size_t i=0; i<pool.size(); ++i)
+    {
+        require_approx_equal(pool.get_position(i), {0,0,1});
+        REQUIRE(length(pool.get_velocity(i)) >= 5.0f);
+    }
+
+    // Particles never end up moving downwards while below the ground
+    const particle_physics physics {{0,0,-2}, 0.5f, {0,0,1}, 0};
+    for(int i=0; i<10; ++i)
+    {
+        pool.integrate(0.05f, physics);
+        for(size_t j=0; j<pool.size(); ++j) REQUIRE((pool.get_position(j).z >= 0 || pool.get_velocity(j).z >= 0));
+    }
+
+    // The shorter lived burst has expired, and the survivors are written out as instances
+    REQUIRE(pool.size() == 100);
+    std::vector<particle_instance> instances(pool.size());
+    pool.write_instances(instances.data());
+    for(size_t i=0; i<pool.size(); ++i)
+    {
+        require_approx_equal(instances[i].position, pool.get_position(i));
+        REQUIRE(instances[i].size == Approx(pool.get_life(i) * 0.5f));
+        require_approx_equal(instances[i].color, {1,2,3});
+    }
+}
+
+TEST_CASE("skyline packer", "[sprites]")
+{
+    // Pack a mix of rectangles until the area is full, in an order which is not sorted by size
+    skyline_packer packer {{64,64}};
+    std::vector<int4> placed;
+    for(int i=0; ; ++i)
+    {
+        const int2 size {3 + i*7%13, 2 + i*5%11};
+        const auto position = packer.insert(size);
+        if(!position) break;
+        placed.push_back({position->x, position->y, position->x+size.x, position->y+size.y});
+    }
+    REQUIRE(placed.size() > 20);
+    REQUIRE(packer.get_used_height() <= 64);
+
+    // Every rectangle lies within the area, and no two rectangles overlap
+    for(size_t i=0; i<placed.size(); ++i)
+    {
+        REQUIRE(placed[i].x >= 0);
+        REQUIRE(placed[i].y >= 0);
+        REQUIRE(placed[i].z <= 64);
+        REQUIRE(placed[i].w <= 64);
+        for(size_t j=0; j<i; ++j) REQUIRE((placed[i].z <= placed[j].x || placed[j].z <= placed[i].x || placed[i].w <= placed[j].y || placed[j].w <= placed[i].y));
+    }
+
+    // Rectangles which are too large never fit, while empty rectangles always do
+    REQUIRE_FALSE(skyline_packer(int2(64,64)).insert(int2(65,1)));
+    REQUIRE(packer.insert({0,0}) == int2(0,0));
+}
+
+TEST_CASE("utf-8 decoding", "[text]")
+{
+    auto decode_all = [](std::string_view text)
+    {
+        std::vector<uint32_t> codepoints;
+        while(!text.empty()) codepoints.push_back(decode_utf8(text));
+        return codepoints;
+    };
+
+    // One to four byte sequences decode to their code points
+    REQUIRE(decode_all(u8"A\u00E5\u4E2D\U0001F600") == (std::vector<uint32_t>{0x41, 0xE5, 0x4E2D, 0x1F600}));
+
+    // Truncated sequences, stray continuation bytes, overlong encodings and surrogates each decode to U+FFFD one byte at a time
+    REQUIRE(decode_all("\xE4\xB8") == (std::vector<uint32_t>{0xFFFD, 0xFFFD}));
+    REQUIRE(decode_all("\x80Z") == (std::vector<uint32_t>{0xFFFD, 'Z'}));
+    REQUIRE(decode_all("\xC0\xAF") == (std::vector<uint32_t>{0xFFFD, 0xFFFD}));
+    REQUIRE(decode_all("\xED\xA0\x80") == (std::vector<uint32_t>{0xFFFD, 0xFFFD, 0xFFFD}));
+}
+
+TEST_CASE("signed distance field", "[text]")
+{
+    // A filled square in the middle of a 64x64 coverage bitmap, reduced to a 16x16 field
+    std::vector<uint8_t> coverage(64*64);
+    for(int y=16; y<48; ++y) for(int x=16; x<48; ++x) coverage[y*64+x] = 255;
+    const auto field = compute_signed_distance_field(coverage.data(), {64,64}, 4, 2);
+    REQUIRE(field.size() == 16*16);
+
+    // The field is above one half inside the square, below one half outside it, and saturates beyond the spread
+    REQUIRE(field[8*16+8] == 255);
+    REQUIRE(field[0] == 0);
+    REQUIRE(field[8*16+5] > 128);
+    REQUIRE(field[8*16+3] < 128);
+
+    // Texels which straddle the edge of the square are close to one half
+    std::vector<uint8_t> straddling(64*64);
+    for(int y=0; y<64; ++y) for(int x=0; x<34; ++x) straddling[y*64+x] = 255;
+    REQUIRE(std::abs(compute_signed_distance_field(straddling.data(), {64,64}, 4, 2)[8*16+8] - 128) < 16);
+}
+
+TEST_CASE("spatial grid", "[spatial]")
+{
+    // Scatter points belonging to two owners, with some exact duplicates to exercise tie breaking
+    std::mt19937 rng;
+    std::uniform_real_distribution<float> coord {0, 100}, jitter {-0.7f, 0.7f};
+    std::vector<float2> positions;
+    std::vector<int> owners;
+    for(int i=0; i<500; ++i)
+    {
+        positions.push_back(i % 10 == 9 ? positions[i-3] : float2{coord(rng), coord(rng)});
+        owners.push_back(i % 3 == 0);
+    }
+    auto get_position = [&](uint32_t i) { return positions[i]; };
+    spatial_grid grid {4.0f};
+    REQUIRE_FALSE(grid.find_nearest({0,0}, get_position, 0, [](uint32_t) { return true; }));
+    grid.build(positions.size(), get_position);
+
+    // Move every point by up to the slack after building the grid, and compare queries from inside and outside the bounds with brute force
+    const float slack = 1;
+    for(auto & p : positions) p += float2{jitter(rng), jitter(rng)};
+    std::uniform_real_distribution<float> query_coord {-20, 120};
+    std::vector<uint32_t> results;
+    for(int q=0; q<200; ++q)
+    {
+        const float2 p {query_coord(rng), query_coord(rng)};
+        const int owner = q % 2;
+        auto is_enemy = [&](uint32_t i) { return owners[i] != owner; };
+        std::vector<std::pair<float, uint32_t>> expected;
+        for(uint32_t i=0; i<positions.size(); ++i) if(is_enemy(i)) expected.push_back({distance2(p, positions[i]), i});
+        std::sort(expected.begin(), expected.end());
+
+        REQUIRE(grid.find_nearest(p, get_position, slack, is_enemy) == expected[0].second);
+
+        grid.find_k_nearest(p, 5, get_position, slack, is_enemy, results);
+        REQUIRE(results.size() == 5);
+        for(size_t i=0; i<5; ++i) REQUIRE(results[i] == expected[i].second);
+
+        grid.find_within(p, 7, get_position, slack, is_enemy, results);
+        std::vector<uint32_t> expected_within;
+        for(auto & e : expected) if(e.first < 49) expected_within.push_back(e.second);
+        std::sort(results.begin(), results.end());
+        std::sort(expected_within.begin(), expected_within.end());
+        REQUIRE(results == expected_within);
+    }
+
+    // Pairs match a brute force search over the positions the grid was built from, whether or not the search is parallel
+    grid.build(positions.size(), get_position);
+    std::vector<uint2> expected_pairs, pairs;
+    for(uint32_t i=0; i<positions.size(); ++i) for(uint32_t j=i+1; j<positions.size(); ++j) if(distance2(positions[i], positions[j]) < 25) expected_pairs.push_back({i,j});
+    grid.find_pairs(5, pairs);
+    REQUIRE(pairs == expected_pairs);
+    thread_pool threads {3};
+    grid.find_pairs(5, pairs, &threads);
+    REQUIRE(pairs == expected_pairs);
+}
+
+TEST_CASE("soa table", "[containers]")
+{
+    soa_table<int, float2> table;
+    std::vector<soa_handle> handles;
+    for(int i=0; i<10; ++i) handles.push_back(table.insert(i, {i*2.0f, 0}));
+    REQUIRE(table.size() == 10);
+    REQUIRE_FALSE(table.contains(soa_handle{}));
+
+    // Removing a row moves the last row into its place, and handles follow their rows
+    REQUIRE(table.erase(handles[2]));
+    REQUIRE_FALSE(table.erase(handles[2]));
+    REQUIRE(table.size() == 9);
+    REQUIRE(table.column<0>()[2] == 9);
+    REQUIRE(table.find(handles[9]) == std::optional<size_t>(2));
+    table.erase_rows_if([&](size_t row) { return table.column<0>()[row] % 3 == 0; });
+    REQUIRE(table.size() == 5);
+
+    // Freed slots are reused, without reviving handles to the rows which previously occupied them
+    auto h = table.insert(100, {1,1});
+    REQUIRE(h.slot < 10);
+    REQUIRE(table.contains(h));
+    for(int i=0; i<10; ++i)
+    {
+        auto row = table.find(handles[i]);
+        REQUIRE(row.has_value() == (i != 2 && i % 3 != 0));
+        if(!row) continue;
+        REQUIRE(table.get_handle(*row) == handles[i]);
+        REQUIRE(table.column<0>()[*row] == i);
+        REQUIRE(table.column<1>()[*row].x == i*2.0f);
+    }
+    table.clear();
+    REQUIRE(table.empty());
+    REQUIRE_FALSE(table.contains(h));
+}
+
+TEST_CASE("flow field", "[spatial]")
+{
+    // A wall across the middle of the grid, with a gap at the top, forces paths from the left half to detour through the gap
+    cost_field costs {{0,0}, 2.0f, {16,16}};
+    for(int y=0; y<14; ++y) costs.set_cost({8,y}, cost_field::impassable);
+    flow_field field {costs, {{12,2}}};
+    REQUIRE(field.get_distance({12,2}) == 0);
+    REQUIRE(field.get_distance({3,2}) > field.get_distance({3,15}));
+    REQUIRE(field.get_next_cell({12,2}) == int2(12,2));
+    REQUIRE(field.get_next_cell({7,14}) == int2(8,14));
+    const float2 direction = field.get_direction(costs.get_cell_center({7,14}) + float2(0,0.5f));
+    REQUIRE(direction.x == Approx(normalize(float2(2,-0.5f)).x));
+    REQUIRE(direction.y == Approx(normalize(float2(2,-0.5f)).y));
+
+    // Following the field from any cell reaches the goal without entering the wall
+    for(int y=0; y<16; ++y) for(int x=0; x<16; ++x)
+    {
+        int2 cell {x,y};
+        for(int steps=0; cell != int2(12,2); ++steps)
+        {
+            REQUIRE(steps < 256);
+            cell = field.get_next_cell(cell);
+            REQUIRE(costs.get_cost(cell) != cost_field::impassable);
+        }
+    }
+
+    // Incremental updates match fields built from scratch, as obstacles are added, removed and reweighted
+    std::mt19937 engine;
+    std::uniform_int_distribution<int> coord_dist {0, 15}, cost_dist {1, 8};
+    for(int i=0; i<50; ++i)
+    {
+        std::vector<int2> changed_cells;
+        for(int j=0; j<5; ++j)
+        {
+            const int2 cell {coord_dist(engine), coord_dist(engine)};
+            const int c = cost_dist(engine);
+            costs.set_cost(cell, c > 5 ? cost_field::impassable : static_cast<uint8_t>(c));
+            changed_cells.push_back(cell);
+        }
+        field.update(costs, changed_cells);
+        const flow_field rebuilt {costs, {{12,2}}};
+        for(int y=0; y<16; ++y) for(int x=0; x<16; ++x)
+        {
+            REQUIRE(field.get_distance({x,y}) == rebuilt.get_distance({x,y}));
+            REQUIRE(field.get_next_cell({x,y}) == rebuilt.get_next_cell({x,y}));
+        }
+    }
+
+    // Fields are shared between requests for the same goal, and discarded once they stop being requested
+    flow_field_cache cache {costs};
+    const flow_field * first = &cache.get_field({3,3});
+    REQUIRE(&cache.get_field({3,3}) == first);
+    cache.set_cost({5,5}, cost_field::impassable);
+    REQUIRE(cache.get_field({3,3}).get_distance({5,5}) == flow_field(cache.get_costs(), {{3,3}}).get_distance({5,5}));
+    cache.update();
+    cache.update();
+    REQUIRE(cache.get_field({3,3}).get_goals()[0] == int2(3,3));
+}
+
+TEST_CASE("rts simulation is independent of thread count", "[rts]")
+{
+    // Flatten everything advance(...) produces into values which can be compared exactly
+    auto get_units = [](const game::state & s)
+    {
+        std::vector<std::tuple<int, int, float2, float2, float>> values;
+        for(auto & u : s.units) values.emplace_back(u.owner, u.hp, u.position, u.direction, u.cooldown);
+        return values;
+    };
+    auto get_bullets = [](const game::state & s)
+    {
+        std::vector<std::tuple<int, float2, float2>> values;
+        for(size_t i=0; i<s.bullets.size(); ++i) { const auto b = game::get_bullet(s.bullets, i); values.emplace_back(b.owner, b.position, b.target); }
+        return values;
+    };
+    auto get_flashes = [](const game::state & s)
+    {
+        std::vector<std::tuple<float3, float3, float>> values;
+        for(size_t i=0; i<s.flashes.size(); ++i) values.emplace_back(s.flashes.column<game::flash_position>()[i], s.flashes.column<game::flash_color>()[i], s.flashes.column<game::flash_life>()[i]);
+        return values;
+    };
+    auto get_bursts = [](const game::state & s)
+    {
+        std::vector<std::tuple<float3, uint32_t, float3, float, float, float, float>> values;
+        for(auto & b : s.particle_bursts) values.emplace_back(b.position, b.count, b.color, b.life, b.speed, b.spread, b.size_per_life);
+        return values;
+    };
+
+    // Advance a state on a single thread alongside a state on several threads, until well after the armies have met
+    thread_pool single_thread {0};
+    for(size_t thread_count : {2, 4, 8})
+    {
+        thread_pool threads {thread_count - 1};
+        game::state expected, actual;
+        size_t bullet_count = 0, flash_count = 0, burst_count = 0;
+        for(int step=0; step<900; ++step)
+        {
+            expected.advance(1.0f/30, single_thread);
+            actual.advance(1.0f/30, threads);
+            REQUIRE(get_units(actual) == get_units(expected));
+            REQUIRE(get_bullets(actual) == get_bullets(expected));
+            REQUIRE(get_flashes(actual) == get_flashes(expected));
+            REQUIRE(get_bursts(actual) == get_bursts(expected));
+            bullet_count += expected.bullets.size();
+            flash_count += expected.flashes.size();
+            burst_count += expected.particle_bursts.size();
+            expected.particle_bursts.clear();
+            actual.particle_bursts.clear();
+        }
+        REQUIRE(bullet_count > 0);
+        REQUIRE(flash_count > 0);
+        REQUIRE(burst_count > 0);
+    }
+}
+
+TEST_CASE("spatial grid nearest enemy benchmark", "[.benchmark]")
+{
+    // Run with "[.benchmark]" to compare nearest enemy queries for every unit against a brute force scan, at unit densities like the RTS
+    std::mt19937 rng;
+    for(size_t count = 64; count <= 100000; count = count < 100000 && count*4 > 100000 ? 100000 : count*4)
+    {
+        const float side = std::sqrt(count * 50.0f);
+        std::uniform_real_distribution<float> coord {0, side};
+        std::vector<float2> positions(count);
+        for(auto & p : positions) p = {coord(rng), coord(rng)};
+        auto is_enemy_of = [](uint32_t a) { return [a](uint32_t b) { return (a & 1) != (b & 1); }; };
+
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        auto get_position = [&](uint32_t i) { return positions[i]; };
+        spatial_grid grid {4.0f};
+        grid.build(count, get_position);
+        std::vector<uint32_t> grid_results(count);
+        for(uint32_t i=0; i<count; ++i) grid_results[i] = *grid.find_nearest(positions[i], get_position, 0, is_enemy_of(i));
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        std::cout << count << " units: grid " << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms";
+
+        // Brute force is quadratic, so only run it while it remains reasonably quick
+        if(count <= 20000)
+        {
+            for(uint32_t i=0; i<count; ++i)
+            {
+                uint32_t best = 0;
+                float best_dist2 = std::numeric_limits<float>::infinity();
+                for(uint32_t j=0; j<count; ++j) if((i & 1) != (j & 1) && distance2(positions[i], positions[j]) < best_dist2) best_dist2 = distance2(positions[i], positions[best = j]);
+                REQUIRE(grid_results[i] == best);
+            }
+            std::cout << ", brute force " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t1).count() << " ms";
+        }
+        std::cout << std::endl;
+    }
+}
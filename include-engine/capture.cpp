@@ -0,0 +1,355 @@
+#include "capture.h"
+#include <cstdio>
+#include <algorithm>
+
+///////////////////////
+// resource_registry //
+///////////////////////
+
+std::pair<const scene_contract *, size_t> resource_registry::get_shared_layout(VkDescriptorSetLayout layout) const
+{
+    for(auto & c : contracts.objects)
+    {
+        auto & layouts = c.second->get_shared_layouts();
+        for(size_t i=0; i<layouts.size(); ++i) if(layouts[i] == layout) return {c.second, i};
+    }
+    throw std::runtime_error("unregistered descriptor set layout");
+}
+
+/////////////////////////
+// frame capture files //
+/////////////////////////
+
+constexpr uint32_t capture_magic = 0x46434549; // "IECF"
+constexpr uint32_t capture_version = 3;
+
+struct capture_writer
+{
+    FILE * f;
+
+    void write_bytes(const void * data, size_t size) { if(size && fwrite(data, size, 1, f) != 1) throw std::runtime_error("failed to write capture"); }
+    void write_size(size_t size) { const uint32_t s = narrow(size); write_bytes(&s, sizeof(s)); }
+    template<class T> void write(const T & value) { static_assert(std::is_trivially_copyable_v<T>); write_bytes(&value, sizeof(T)); }
+    void write(const std::string & s) { write_size(s.size()); write_bytes(s.data(), s.size()); }
+    void write(const std::vector<char> & v) { write_size(v.size()); write_bytes(v.data(), v.size()); }
+    template<class T> void write(const std::vector<T> & v) { write_size(v.size()); for(auto & e : v) write(e); }
+
+    void write(const captured_frame::buffer_ref & b) { write(b.source); write(b.name); write(b.offset); write(b.range); }
+    void write(const captured_frame::descriptor_write & w) { write(w.binding); write(w.array_element); write(w.type); write(w.buffer); write(w.sampler); write(w.image_view); write(w.image_layout); }
+    void write(const captured_frame::descriptor_set & s) { write(s.owner); write(s.shared_index); write(s.writes); }
+    void write(const captured_frame::draw & d) { write(d.set); write(d.vertex_buffers); write(d.index_buffer); write(d.first_index); write(d.index_count); write(d.instance_count); write(d.indirect_buffer); write(d.scissor); }
+    void write(const captured_frame::list & l) { write(l.contract); write(l.draws); }
+    void write(const captured_frame::pass & p) { write(p.list); write(p.render_pass); write(p.shared_sets); }
+};
+
+struct capture_reader
+{
+    const uint8_t * it, * end;
+
+    void read_bytes(void * data, size_t size) { if(size > static_cast<size_t>(end - it)) throw std::runtime_error("truncated capture"); memcpy(data, it, size); it += size; }
+    template<class T> void read(T & value) { static_assert(std::is_trivially_copyable_v<T>); read_bytes(&value, sizeof(T)); }
+    void read(std::string & s) { uint32_t size; read(size); s.resize(size); read_bytes(s.data(), size); }
+    void read(std::vector<char> & v) { uint32_t size; read(size); v.resize(size); read_bytes(v.data(), size); }
+    template<class T> void read(std::vector<T> & v) { uint32_t size; read(size); if(size > static_cast<size_t>(end - it)) throw std::runtime_error("truncated capture"); v.resize(size); for(auto & e : v) read(e); }
+
+    void read(captured_frame::buffer_ref & b) { read(b.source); read(b.name); read(b.offset); read(b.range); }
+    void read(captured_frame::descriptor_write & w) { read(w.binding); read(w.array_element); read(w.type); read(w.buffer); read(w.sampler); read(w.image_view); read(w.image_layout); }
+    void read(captured_frame::descriptor_set & s) { read(s.owner); read(s.shared_index); read(s.writes); }
+    void read(captured_frame::draw & d) { read(d.set); read(d.vertex_buffers); read(d.index_buffer); read(d.first_index); read(d.index_count); read(d.instance_count); read(d.indirect_buffer); read(d.scissor); }
+    void read(captured_frame::list & l) { read(l.contract); read(l.draws); }
+    void read(captured_frame::pass & p) { read(p.list); read(p.render_pass); read(p.shared_sets); }
+};
+
+void save_frame_capture(const char * filename, const captured_frame & frame)
+{
+    FILE * f = fopen(filename, "wb");
+    if(!f) throw std::runtime_error(std::string("failed to open ") + filename);
+    std::unique_ptr<FILE, decltype(&fclose)> file {f, &fclose};
+    capture_writer w {f};
+    w.write(capture_magic);
+    w.write(capture_version);
+    w.write(frame.uniform_data);
+    w.write(frame.vertex_data);
+    w.write(frame.index_data);
+    w.write(frame.sets);
+    w.write(frame.lists);
+    w.write(frame.passes);
+}
+
+captured_frame load_frame_capture(const char * filename)
+{
+    const auto buffer = load_binary_file(filename);
+    capture_reader r {buffer.data(), buffer.data() + buffer.size()};
+    uint32_t magic, version;
+    r.read(magic);
+    r.read(version);
+    if(magic != capture_magic) throw std::runtime_error(std::string("not a frame capture: ") + filename);
+    if(version != capture_version) throw std::runtime_error(std::string("unsupported frame capture version: ") + filename);
+
+    captured_frame frame;
+    r.read(frame.uniform_data);
+    r.read(frame.vertex_data);
+    r.read(frame.index_data);
+    r.read(frame.sets);
+    r.read(frame.lists);
+    r.read(frame.passes);
+    return frame;
+}
+
+////////////////////
+// frame_recorder //
+////////////////////
+
+frame_recorder::frame_recorder(const resource_registry & registry, transient_resource_pool & pool) : frame_recorder{pool}
+{
+    this->registry = &registry;
+}
+
+frame_recorder::frame_recorder(transient_resource_pool & pool) : registry{}, pool{pool}
+{
+    if(pool.get_recorder()) throw std::logic_error("transient_resource_pool is already being recorded");
+    pool.set_recorder(this);
+}
+
+frame_recorder::~frame_recorder()
+{
+    for(auto bundle : observed_bundles) bundle->set_recorder(nullptr);
+    pool.set_recorder(nullptr);
+}
+
+void frame_recorder::observe(draw_bundle & bundle)
+{
+    bundle.set_recorder(this);
+    observed_bundles.push_back(&bundle);
+}
+
+void frame_recorder::on_allocate(VkDescriptorSet set, VkDescriptorSetLayout layout, const scene_material * material)
+{
+    // Handles may be reused once a pool has been recycled, so discard any writes to an earlier set with the same handle
+    std::lock_guard<std::mutex> lock {mutex};
+    sets[set] = {layout, material, {}};
+}
+
+void frame_recorder::on_write_buffer(VkDescriptorSet set, uint32_t binding, uint32_t array_element, VkDescriptorType type, VkDescriptorBufferInfo info)
+{
+    std::lock_guard<std::mutex> lock {mutex};
+    sets[set].writes.push_back({binding, array_element, type, info, {}});
+}
+
+void frame_recorder::on_write_combined_image_sampler(VkDescriptorSet set, uint32_t binding, uint32_t array_element, VkDescriptorImageInfo info)
+{
+    std::lock_guard<std::mutex> lock {mutex};
+    sets[set].writes.push_back({binding, array_element, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, {}, info});
+}
+
+void frame_recorder::on_write_commands(const draw_list & list, const render_pass & render_pass, array_view<scene_descriptor_set> shared_descriptors)
+{
+    std::lock_guard<std::mutex> lock {mutex};
+    add_pass(list, render_pass, shared_descriptors);
+}
+
+void frame_recorder::on_write_bundle(const draw_list & list, const frame_recorder & log, const render_pass & render_pass, array_view<scene_descriptor_set> shared_descriptors)
+{
+    std::lock_guard<std::mutex> lock {mutex};
+    if(std::find(begin(bundle_logs), end(bundle_logs), &log) == end(bundle_logs)) bundle_logs.push_back(&log);
+    add_pass(list, render_pass, shared_descriptors);
+}
+
+void frame_recorder::add_pass(const draw_list & list, const render_pass & render_pass, array_view<scene_descriptor_set> shared_descriptors)
+{
+    // A draw list which is written into several render passes is only captured once
+    auto it = list_indices.find(&list);
+    if(it == list_indices.end())
+    {
+        it = list_indices.insert({&list, lists.size()}).first;
+        lists.push_back({&list.contract, list.items});
+    }
+
+    pass_record pass {it->second, &render_pass};
+    for(auto & s : shared_descriptors) pass.shared_sets.push_back(s.get_descriptor_set());
+    passes.push_back(pass);
+}
+
+const frame_recorder::set_record * frame_recorder::find_set(VkDescriptorSet set) const
+{
+    auto it = sets.find(set);
+    if(it != sets.end()) return &it->second;
+    for(auto log : bundle_logs)
+    {
+        it = log->sets.find(set);
+        if(it != log->sets.end()) return &it->second;
+    }
+    return nullptr;
+}
+
+captured_frame::buffer_ref frame_recorder::get_buffer_ref(const std::vector<data_source> & sources, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) const
+{
+    if(!buffer) return {captured_frame::buffer_source::none, {}, offset, range};
+    for(auto & s : sources)
+    {
+        if(buffer == s.pool->get_uniform_buffer().get_vk_handle()) return {captured_frame::buffer_source::transient_uniforms, {}, s.uniform_base + offset, range};
+        if(buffer == s.pool->get_vertex_buffer().get_vk_handle()) return {captured_frame::buffer_source::transient_vertices, {}, s.vertex_base + offset, range};
+        if(buffer == s.pool->get_index_buffer().get_vk_handle()) return {captured_frame::buffer_source::transient_indices, {}, s.index_base + offset, range};
+    }
+    return {captured_frame::buffer_source::registered, registry->get_buffer_name(buffer), offset, range};
+}
+
+captured_frame frame_recorder::finish() const
+{
+    if(!registry) throw std::logic_error("frame_recorder was created without a registry");
+
+    // The persistent data of each bundle is appended to the frame's transient data, at an offset which satisfies any alignment
+    // requirement for uniform and storage buffers, and buffer references into it are moved to match
+    captured_frame frame;
+    std::vector<data_source> sources;
+    auto append_contents = [](std::vector<char> & data, const dynamic_buffer & buffer) -> VkDeviceSize
+    { 
+        const VkDeviceSize base = (data.size() + 255) & ~VkDeviceSize{255};
+        data.resize(base);
+        data.insert(data.end(), buffer.get_mapped_memory(), buffer.get_mapped_memory() + buffer.get_used_size());
+        return base;
+    };
+    auto add_source = [&](transient_resource_pool & p) { sources.push_back({&p, append_contents(frame.uniform_data, p.get_uniform_buffer()), append_contents(frame.vertex_data, p.get_vertex_buffer()), append_contents(frame.index_data, p.get_index_buffer())}); };
+    add_source(pool);
+    for(auto log : bundle_logs) add_source(log->pool);
+
+    // Only descriptor sets which are referenced by a submitted draw list are captured
+    std::map<VkDescriptorSet, uint32_t> set_indices;
+    auto get_set_index = [&](VkDescriptorSet set) -> uint32_t
+    {
+        auto it = set_indices.find(set);
+        if(it != set_indices.end()) return it->second;
+        auto record = find_set(set);
+        if(!record) throw std::logic_error("descriptor set was allocated before recording began");
+
+        captured_frame::descriptor_set s;
+        if(record->material)
+        {
+            s.owner = registry->get_name(*record->material);
+            s.shared_index = ~0u;
+        }
+        else
+        {
+            auto shared = registry->get_shared_layout(record->layout);
+            s.owner = registry->get_name(*shared.first);
+            s.shared_index = narrow(shared.second);
+        }
+        for(auto & w : record->writes)
+        {
+            captured_frame::descriptor_write write {w.binding, w.array_element, w.type, {}, {}, {}, w.image_info.imageLayout};
+            if(w.type != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) write.buffer = get_buffer_ref(sources, w.buffer_info.buffer, w.buffer_info.offset, w.buffer_info.range);
+            else
+            {
+                write.sampler = registry->get_sampler_name(w.image_info.sampler);
+                write.image_view = registry->get_image_view_name(w.image_info.imageView);
+            }
+            s.writes.push_back(write);
+        }
+        frame.sets.push_back(std::move(s));
+        return set_indices[set] = narrow(frame.sets.size()-1);
+    };
+
+    for(auto & l : lists)
+    {
+        captured_frame::list list {registry->get_name(*l.contract)};
+        for(auto & item : l.items)
+        {
+            captured_frame::draw draw {get_set_index(item.set)};
+            for(uint32_t i=0; i<item.vertex_buffer_count; ++i) draw.vertex_buffers.push_back(get_buffer_ref(sources, item.vertex_buffers[i], item.vertex_buffer_offsets[i], 0));
+            draw.index_buffer = get_buffer_ref(sources, item.index_buffer, item.index_buffer_offset, 0);
+            draw.first_index = item.first_index;
+            draw.index_count = item.index_count;
+            draw.instance_count = item.instance_count;
+            draw.indirect_buffer = get_buffer_ref(sources, item.indirect_buffer, item.indirect_buffer_offset, 0);
+            draw.scissor = item.scissor;
+            list.draws.push_back(draw);
+        }
+        frame.lists.push_back(std::move(list));
+    }
+
+    for(auto & p : passes)
+    {
+        captured_frame::pass pass {narrow(p.list), registry->get_name(*p.pass)};
+        for(auto set : p.shared_sets) pass.shared_sets.push_back(get_set_index(set));
+        frame.passes.push_back(std::move(pass));
+    }
+    return frame;
+}
+
+////////////////////
+// replayed_frame //
+////////////////////
+
+replayed_frame::replayed_frame(const captured_frame & frame, const resource_registry & registry, transient_resource_pool & pool)
+{
+    // Restore transient data at the same offsets it was captured from, so that buffer references remain valid
+    pool.get_uniform_buffer().assign(frame.uniform_data.size(), frame.uniform_data.data());
+    pool.get_vertex_buffer().assign(frame.vertex_data.size(), frame.vertex_data.data());
+    pool.get_index_buffer().assign(frame.index_data.size(), frame.index_data.data());
+    auto get_buffer = [&](const captured_frame::buffer_ref & ref) -> VkBuffer
+    {
+        switch(ref.source)
+        {
+        case captured_frame::buffer_source::none: return VK_NULL_HANDLE;
+        case captured_frame::buffer_source::transient_uniforms: return pool.get_uniform_buffer().get_vk_handle();
+        case captured_frame::buffer_source::transient_vertices: return pool.get_vertex_buffer().get_vk_handle();
+        case captured_frame::buffer_source::transient_indices: return pool.get_index_buffer().get_vk_handle();
+        case captured_frame::buffer_source::registered: return registry.get_buffer(ref.name);
+        default: throw std::runtime_error("corrupt frame capture");
+        }
+    };
+
+    // Recreate and rewrite all descriptor sets
+    std::vector<scene_descriptor_set> sets;
+    for(auto & s : frame.sets)
+    {
+        if(s.shared_index == ~0u) sets.emplace_back(pool, registry.get_material(s.owner));
+        else sets.emplace_back(pool, registry.get_contract(s.owner).get_shared_layouts().at(s.shared_index));
+        for(auto & w : s.writes)
+        {
+            if(w.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) sets.back().write_uniform_buffer(w.binding, w.array_element, {get_buffer(w.buffer), w.buffer.offset, w.buffer.range});
+            else if(w.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) sets.back().write_storage_buffer(w.binding, w.array_element, {get_buffer(w.buffer), w.buffer.offset, w.buffer.range});
+            else if(w.type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) sets.back().write_combined_image_sampler(w.binding, w.array_element, registry.get_sampler(w.sampler), registry.get_image_view(w.image_view), w.image_layout);
+            else throw std::runtime_error("corrupt frame capture");
+        }
+    }
+
+    // Rebuild draw lists
+    for(auto & l : frame.lists)
+    {
+        lists.emplace_back(pool, registry.get_contract(l.contract));
+        for(auto & d : l.draws)
+        {
+            auto & set = sets.at(d.set);
+            if(d.vertex_buffers.size() > countof(draw_item{}.vertex_buffers)) throw std::runtime_error("corrupt frame capture");
+            draw_item item {&set.get_material(), set.get_descriptor_set()};
+            item.vertex_buffer_count = narrow(d.vertex_buffers.size());
+            for(uint32_t i=0; i<item.vertex_buffer_count; ++i)
+            {
+                item.vertex_buffers[i] = get_buffer(d.vertex_buffers[i]);
+                item.vertex_buffer_offsets[i] = d.vertex_buffers[i].offset;
+            }
+            item.index_buffer = get_buffer(d.index_buffer);
+            item.index_buffer_offset = d.index_buffer.offset;
+            item.first_index = d.first_index;
+            item.index_count = d.index_count;
+            item.instance_count = d.instance_count;
+            item.indirect_buffer = get_buffer(d.indirect_buffer);
+            item.indirect_buffer_offset = d.indirect_buffer.offset;
+            item.scissor = d.scissor;
+            lists.back().items.push_back(item);
+        }
+    }
+
+    for(auto & p : frame.passes)
+    {
+        if(p.list >= lists.size()) throw std::runtime_error("corrupt frame capture");
+        passes.push_back({p.list, &registry.get_render_pass(p.render_pass), p.render_pass});
+        for(auto index : p.shared_sets) passes.back().shared_sets.push_back(sets.at(index));
+    }
+}
+
+void replayed_frame::write_commands(VkCommandBuffer cmd, size_t pass, VkRect2D viewport) const
+{
+    lists[passes[pass].list].write_commands(cmd, *passes[pass].target, viewport, passes[pass].shared_sets);
+}
@@ -0,0 +1,151 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "renderer.h"
+
+// A resource_registry assigns stable names to long-lived renderer objects, so that frames which refer to them can be written to disk and reconstructed later
+class resource_registry
+{
+    template<class T> struct name_table
+    {
+        std::map<std::string, T> objects;
+        std::map<T, std::string> names;
+
+        void add(std::string name, T object) { if(!objects.emplace(name, object).second) throw std::logic_error("duplicate resource name: " + name); names[object] = move(name); }
+        const std::string & get_name(T object, const char * kind) const { auto it = names.find(object); if(it == names.end()) throw std::runtime_error(std::string("unregistered ") + kind); return it->second; }
+        T get_object(const std::string & name) const { auto it = objects.find(name); if(it == objects.end()) throw std::runtime_error("unknown resource: " + name); return it->second; }
+    };
+    name_table<const scene_contract *> contracts;
+    name_table<const scene_material *> materials;
+    name_table<const render_pass *> render_passes;
+    name_table<const sampler *> samplers;
+    name_table<VkSampler> sampler_handles;
+    name_table<VkImageView> image_views;
+    name_table<VkBuffer> buffers;
+public:
+    void add(std::string name, const scene_contract & contract) { contracts.add(move(name), &contract); }
+    void add(std::string name, const scene_material & material) { materials.add(move(name), &material); }
+    void add(std::string name, const render_pass & pass) { render_passes.add(move(name), &pass); }
+    void add(std::string name, const sampler & sampler) { samplers.add(name, &sampler); sampler_handles.add(move(name), sampler.get_vk_handle()); }
+    void add(std::string name, const texture & texture) { image_views.add(move(name), texture); }
+    void add(std::string name, const render_target & target) { image_views.add(move(name), target.get_image_view()); }
+    void add(std::string name, const gfx_mesh & mesh) { buffers.add(name + ".vertices", *mesh.vertex_buffer); buffers.add(name + ".indices", *mesh.index_buffer); }
+    void add(std::string name, VkBuffer buffer) { buffers.add(move(name), buffer); }
+
+    const std::string & get_name(const scene_contract & contract) const { return contracts.get_name(&contract, "contract"); }
+    const std::string & get_name(const scene_material & material) const { return materials.get_name(&material, "material"); }
+    const std::string & get_name(const render_pass & pass) const { return render_passes.get_name(&pass, "render pass"); }
+    const std::string & get_sampler_name(VkSampler sampler) const { return sampler_handles.get_name(sampler, "sampler"); }
+    const std::string & get_image_view_name(VkImageView image_view) const { return image_views.get_name(image_view, "image view"); }
+    const std::string & get_buffer_name(VkBuffer buffer) const { return buffers.get_name(buffer, "buffer"); }
+    std::pair<const scene_contract *, size_t> get_shared_layout(VkDescriptorSetLayout layout) const;
+
+    const scene_contract & get_contract(const std::string & name) const { return *contracts.get_object(name); }
+    const scene_material & get_material(const std::string & name) const { return *materials.get_object(name); }
+    const render_pass & get_render_pass(const std::string & name) const { return *render_passes.get_object(name); }
+    const sampler & get_sampler(const std::string & name) const { return *samplers.get_object(name); }
+    VkImageView get_image_view(const std::string & name) const { return image_views.get_object(name); }
+    VkBuffer get_buffer(const std::string & name) const { return buffers.get_object(name); }
+};
+
+// A captured_frame is a self-contained description of the draw lists submitted during a single frame, with all transient
+// data copied out of the transient_resource_pool and all long-lived resources referred to by their registered names
+struct captured_frame
+{
+    enum class buffer_source : uint32_t { none, transient_uniforms, transient_vertices, transient_indices, registered };
+    struct buffer_ref { buffer_source source; std::string name; VkDeviceSize offset, range; };
+    struct descriptor_write
+    {
+        uint32_t binding, array_element;
+        VkDescriptorType type;
+        buffer_ref buffer;                          // For VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER and VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+        std::string sampler, image_view;            // For VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+        VkImageLayout image_layout;
+    };
+    struct descriptor_set
+    {
+        std::string owner;                          // Name of the material for per-object sets, or of the contract for shared sets
+        uint32_t shared_index;                      // Index into the contract's shared layouts, or ~0 for per-object sets
+        std::vector<descriptor_write> writes;
+    };
+    struct draw
+    {
+        uint32_t set;
+        std::vector<buffer_ref> vertex_buffers;
+        buffer_ref index_buffer;
+        uint32_t first_index, index_count, instance_count;
+        buffer_ref indirect_buffer;                 // If not none, the counts above are ignored in favor of arguments written by the GPU
+        VkRect2D scissor;                           // If nonempty, the scissor rect of the draw, otherwise the draw is clipped to the viewport
+    };
+    struct list { std::string contract; std::vector<draw> draws; };
+    struct pass { uint32_t list; std::string render_pass; std::vector<uint32_t> shared_sets; };
+
+    std::vector<char> uniform_data, vertex_data, index_data;
+    std::vector<descriptor_set> sets;
+    std::vector<list> lists;
+    std::vector<pass> passes;
+};
+
+void save_frame_capture(const char * filename, const captured_frame & frame);
+captured_frame load_frame_capture(const char * filename);
+
+// A frame_recorder observes the descriptor writes and draw list submissions made through a transient_resource_pool,
+// and produces a captured_frame once the frame has been recorded. It must be created before the frame's first allocation.
+// It also observes the sub-pools of that pool, and so its callbacks may be invoked from several threads.
+//
+// Draw bundles are built long before the frames which draw them, so each draw_bundle keeps a recorder without a registry, which 
+// only logs the descriptor writes made through its persistent pool. A frame_recorder which observes a bundle captures each use of it
+// as an ordinary draw list, with the bundle's descriptor sets taken from its log and its persistent data appended to the frame's.
+class frame_recorder
+{
+    struct write_record { uint32_t binding, array_element; VkDescriptorType type; VkDescriptorBufferInfo buffer_info; VkDescriptorImageInfo image_info; };
+    struct set_record { VkDescriptorSetLayout layout; const scene_material * material; std::vector<write_record> writes; };
+    struct list_record { const scene_contract * contract; std::vector<draw_item> items; };
+    struct pass_record { size_t list; const render_pass * pass; std::vector<VkDescriptorSet> shared_sets; };
+    struct data_source { transient_resource_pool * pool; VkDeviceSize uniform_base, vertex_base, index_base; };
+
+    const resource_registry * registry;
+    transient_resource_pool & pool;
+    std::map<VkDescriptorSet, set_record> sets;
+    std::map<const draw_list *, size_t> list_indices;
+    std::vector<list_record> lists;
+    std::vector<pass_record> passes;
+    std::vector<draw_bundle *> observed_bundles;
+    std::vector<const frame_recorder *> bundle_logs; // Logs of the bundles drawn during the frame
+    std::mutex mutex; // Descriptor sets may be written from several sub-pools concurrently
+
+    void add_pass(const draw_list & list, const render_pass & render_pass, array_view<scene_descriptor_set> shared_descriptors);
+    const set_record * find_set(VkDescriptorSet set) const;
+    captured_frame::buffer_ref get_buffer_ref(const std::vector<data_source> & sources, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) const;
+public:
+    frame_recorder(const resource_registry & registry, transient_resource_pool & pool);
+    explicit frame_recorder(transient_resource_pool & pool); // Only logs descriptor writes, and cannot finish()
+    ~frame_recorder();
+
+    // Capture each use of the bundle until this recorder is destroyed
+    void observe(draw_bundle & bundle);
+
+    void on_allocate(VkDescriptorSet set, VkDescriptorSetLayout layout, const scene_material * material);
+    void on_write_buffer(VkDescriptorSet set, uint32_t binding, uint32_t array_element, VkDescriptorType type, VkDescriptorBufferInfo info);
+    void on_write_combined_image_sampler(VkDescriptorSet set, uint32_t binding, uint32_t array_element, VkDescriptorImageInfo info);
+    void on_write_commands(const draw_list & list, const render_pass & render_pass, array_view<scene_descriptor_set> shared_descriptors);
+    void on_write_bundle(const draw_list & list, const frame_recorder & log, const render_pass & render_pass, array_view<scene_descriptor_set> shared_descriptors);
+
+    captured_frame finish() const;
+};
+
+// A replayed_frame reconstructs the draw lists of a captured_frame against live resources, using transient storage from the given pool
+class replayed_frame
+{
+    struct pass { size_t list; const render_pass * target; std::string name; std::vector<scene_descriptor_set> shared_sets; };
+    std::vector<draw_list> lists;
+    std::vector<pass> passes;
+public:
+    replayed_frame(const captured_frame & frame, const resource_registry & registry, transient_resource_pool & pool);
+
+    size_t get_pass_count() const { return passes.size(); }
+    const std::string & get_render_pass_name(size_t pass) const { return passes[pass].name; }
+    void write_commands(VkCommandBuffer cmd, size_t pass, VkRect2D viewport) const;
+};
+
+#endif
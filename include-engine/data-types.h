@@ -169,9 +169,9 @@ struct shader_info
     struct matrix_layout { uint32_t stride; bool row_major; };
     struct structure_member { std::string name; std::unique_ptr<const type> type; std::optional<uint32_t> offset; };
     struct numeric { scalar_type scalar; uint32_t row_count, column_count; std::optional<matrix_layout> matrix_layout; };
-    struct sampler { scalar_type channel; VkImageViewType view_type; bool multisampled, shadow; };
+    struct sampler { scalar_type channel; VkImageViewType view_type; bool multisampled, shadow, storage; }; // storage is set for images used without a sampler, which bind to storage images
     struct array { std::unique_ptr<const type> element; uint32_t length; std::optional<uint32_t> stride; };
-    struct structure { std::string name; std::vector<structure_member> members; };
+    struct structure { std::string name; std::vector<structure_member> members; bool storage_block; }; // storage_block is set for buffer blocks, which bind to storage buffers
     struct type { std::variant<sampler, numeric, array, structure> contents; };
     struct descriptor { uint32_t set, binding; std::string name; type type; };
 
@@ -0,0 +1,104 @@
+#include "debug-draw.h"
+
+static byte4 pack_color(const float4 & color) { return byte4(clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f); }
+
+uint32_t debug_draw::add_vertex(batch & b, const float3 & position, const byte4 & color)
+{
+    b.vertices.push_back({position, color});
+    return narrow(b.vertices.size()-1);
+}
+
+void debug_draw::clear()
+{
+    for(auto & b : batches)
+    {
+        b.vertices.clear();
+        b.indices.clear();
+    }
+}
+
+size_t debug_draw::get_line_count() const
+{
+    size_t count = 0;
+    for(auto & b : batches) count += b.indices.size()/2;
+    return count;
+}
+
+void debug_draw::draw_line(const float3 & a, const float3 & b, const float4 & color, debug_depth depth)
+{
+    auto & batch = get_batch(depth);
+    const auto c = pack_color(color);
+    batch.indices.push_back(add_vertex(batch, a, c));
+    batch.indices.push_back(add_vertex(batch, b, c));
+}
+
+void debug_draw::draw_box(const float3 & min_corner, const float3 & max_corner, const float4 & color, debug_depth depth)
+{
+    draw_box(mul(translation_matrix((min_corner + max_corner) / 2.0f), scaling_matrix((max_corner - min_corner) / 2.0f)), color, depth);
+}
+
+// The twelve edges of a cube whose corners are numbered by the bits of their coordinates, with x in bit 0, y in bit 1 and z in bit 2
+static const uint32_t cube_edges[] {0,1, 2,3, 4,5, 6,7, 0,2, 1,3, 4,6, 5,7, 0,4, 1,5, 2,6, 3,7};
+
+void debug_draw::draw_box(const float4x4 & transform, const float4 & color, debug_depth depth)
+{
+    auto & batch = get_batch(depth);
+    const auto c = pack_color(color);
+    const auto base = narrow(batch.vertices.size());
+    for(int i=0; i<8; ++i) add_vertex(batch, transform_point(transform, {i&1 ? 1.0f : -1.0f, i&2 ? 1.0f : -1.0f, i&4 ? 1.0f : -1.0f}), c);
+    for(auto e : cube_edges) batch.indices.push_back(base + e);
+}
+
+void debug_draw::draw_sphere(const float3 & center, float radius, const float4 & color, debug_depth depth, int segments)
+{
+    auto & batch = get_batch(depth);
+    const auto c = pack_color(color);
+    for(int axis=0; axis<3; ++axis)
+    {
+        const auto base = narrow(batch.vertices.size());
+        for(int i=0; i<segments; ++i)
+        {
+            const float angle = 6.28318531f * i / segments;
+            float3 offset;
+            offset[axis] = std::cos(angle) * radius;
+            offset[(axis+1)%3] = std::sin(angle) * radius;
+            offset[(axis+2)%3] = 0;
+            add_vertex(batch, center + offset, c);
+            batch.indices.push_back(base + i);
+            batch.indices.push_back(base + (i+1)%segments);
+        }
+    }
+}
+
+void debug_draw::draw_frustum(const float4x4 & view_proj_matrix, const float4 & color, debug_depth depth)
+{
+    // Unproject the corners of the clip volume, which has the same corner numbering as the cube above
+    const auto inv = inverse(view_proj_matrix);
+    auto & batch = get_batch(depth);
+    const auto c = pack_color(color);
+    const auto base = narrow(batch.vertices.size());
+    for(int i=0; i<8; ++i)
+    {
+        const auto p = mul(inv, float4{i&1 ? 1.0f : -1.0f, i&2 ? 1.0f : -1.0f, i&4 ? 1.0f : 0.0f, 1.0f});
+        add_vertex(batch, p.xyz()/p.w, c);
+    }
+    for(auto e : cube_edges) batch.indices.push_back(base + e);
+}
+
+void debug_draw::draw(draw_list & list, const scene_material & tested_mtl, const scene_material & overlay_mtl) const
+{
+    const scene_material * materials[] {&tested_mtl, &overlay_mtl};
+    for(size_t i=0; i<2; ++i)
+    {
+        auto & b = batches[i];
+        if(b.indices.empty()) continue;
+
+        list.begin_vertices();
+        list.write_vertices(b.vertices.data(), b.vertices.size());
+        const auto vertices = list.end_vertices();
+        list.begin_indices();
+        list.write_indices(b.indices.data(), b.indices.size());
+        const auto indices = list.end_indices();
+        list.draw(list.descriptor_set(*materials[i]), {vertices}, indices, b.indices.size(), 1);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef DEBUG_DRAW_H
+#define DEBUG_DRAW_H
+
+#include "renderer.h"
+
+// Matches the vertex format expected by the debug shaders which accompany example-rts, in assets/debug.vert
+struct debug_vertex { float3 position; byte4 color; };
+
+// Whether debug primitives are hidden by the scene, or drawn over the top of it
+enum class debug_depth { tested, overlay };
+
+// debug_draw accumulates lines, boxes, spheres and frustums in immediate mode, and draws every primitive of each depth mode with a 
+// single indexed line list draw from the transient vertex stream. Each shape shares its corners between its lines. Primitives are 
+// retained until clear(), so that they can be drawn into several draw lists or accumulated across several updates.
+class debug_draw
+{
+    struct batch
+    {
+        std::vector<debug_vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+    batch batches[2];
+
+    batch & get_batch(debug_depth depth) { return batches[static_cast<size_t>(depth)]; }
+    uint32_t add_vertex(batch & b, const float3 & position, const byte4 & color);
+public:
+    void clear();
+    size_t get_line_count() const;
+
+    void draw_line(const float3 & a, const float3 & b, const float4 & color, debug_depth depth=debug_depth::tested);
+    void draw_box(const float3 & min_corner, const float3 & max_corner, const float4 & color, debug_depth depth=debug_depth::tested);
+    void draw_box(const float4x4 & transform, const float4 & color, debug_depth depth=debug_depth::tested); // The transform is applied to the cube from -1 to +1
+    void draw_sphere(const float3 & center, float radius, const float4 & color, debug_depth depth=debug_depth::tested, int segments=32); // Drawn as three great circles
+    void draw_frustum(const float4x4 & view_proj_matrix, const float4 & color, debug_depth depth=debug_depth::tested); // Assumes a depth range of 0 to 1
+
+    // Draw every primitive with the given materials, which should use a line list topology, a vertex format of debug_vertex, and the
+    // shaders which accompany example-rts. The tested material should enable depth testing, and the overlay material should not.
+    void draw(draw_list & list, const scene_material & tested_mtl, const scene_material & overlay_mtl) const;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "distance-field.h"
+#include <algorithm>    // For std::min(...), std::max(...)
+#include <cmath>        // For std::sqrt(...)
+#include <limits>       // For std::numeric_limits<T>
+
+// Pixels with no target in range keep a large finite distance, so that the arithmetic below never produces NaNs
+static const float far_away = 1e20f;
+
+// Replace f with its one dimensional squared distance transform, min over q of (p-q)^2 + f(q), using the lower envelope of 
+// parabolas described by Felzenszwalb and Huttenlocher
+static void transform_1d(float * f, int n, int stride, std::vector<float> & d, std::vector<int> & v, std::vector<float> & z)
+{
+    auto intersect = [&](int q, int p) { return ((f[q*stride] + q*q) - (f[p*stride] + p*p)) / (2.0f*q - 2.0f*p); };
+    int k = 0;
+    v[0] = 0;
+    z[0] = -std::numeric_limits<float>::infinity();
+    z[1] = std::numeric_limits<float>::infinity();
+    for(int q=1; q<n; ++q)
+    {
+        float s = intersect(q, v[k]);
+        while(s <= z[k]) s = intersect(q, v[--k]);
+        v[++k] = q;
+        z[k] = s;
+        z[k+1] = std::numeric_limits<float>::infinity();
+    }
+    k = 0;
+    for(int q=0; q<n; ++q)
+    {
+        while(z[k+1] < q) ++k;
+        d[q] = std::min((q-v[k])*(q-v[k]) + f[v[k]*stride], far_away);
+    }
+    for(int q=0; q<n; ++q) f[q*stride] = d[q];
+}
+
+// Squared distance from every pixel to the nearest pixel which is inside the shape, or outside it
+static std::vector<float> squared_distance_transform(const uint8_t * coverage, int2 dims, bool target_inside)
+{
+    std::vector<float> f(dims.x*dims.y);
+    for(size_t i=0; i<f.size(); ++i) f[i] = (coverage[i] >= 128) == target_inside ? 0.0f : far_away;
+
+    const int n = std::max(dims.x, dims.y);
+    std::vector<float> d(n), z(n+1);
+    std::vector<int> v(n);
+    for(int x=0; x<dims.x; ++x) transform_1d(f.data() + x, dims.y, dims.x, d, v, z);
+    for(int y=0; y<dims.y; ++y) transform_1d(f.data() + y*dims.x, dims.x, 1, d, v, z);
+    return f;
+}
+
+std::vector<uint8_t> compute_signed_distance_field(const uint8_t * coverage, int2 dims, int downsample, float spread)
+{
+    const auto to_inside = squared_distance_transform(coverage, dims, true), to_outside = squared_distance_transform(coverage, dims, false);
+    const int2 out_dims = dims / downsample;
+    std::vector<uint8_t> field(out_dims.x*out_dims.y);
+    for(int y=0; y<out_dims.y; ++y)
+    {
+        for(int x=0; x<out_dims.x; ++x)
+        {
+            // The edge lies halfway between an inside pixel and its outside neighbor
+            float sum = 0;
+            for(int j=y*downsample; j<(y+1)*downsample; ++j)
+            {
+                for(int i=x*downsample; i<(x+1)*downsample; ++i)
+                {
+                    const size_t p = j*dims.x + i;
+                    sum += coverage[p] >= 128 ? std::sqrt(to_outside[p]) - 0.5f : 0.5f - std::sqrt(to_inside[p]);
+                }
+            }
+            const float distance = sum / (downsample*downsample*downsample);
+            field[y*out_dims.x + x] = static_cast<uint8_t>(std::min(std::max(0.5f + distance / (2*spread), 0.0f), 1.0f) * 255 + 0.5f);
+        }
+    }
+    return field;
+}
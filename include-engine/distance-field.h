@@ -0,0 +1,15 @@
+#ifndef DISTANCE_FIELD_H
+#define DISTANCE_FIELD_H
+
+#include <cstdint>      // For uint8_t
+#include <vector>       // For std::vector<T>
+#include <functional>   // For std::hash<T>, specialized by linalg.h
+#include "linalg.h"
+using namespace linalg::aliases;
+
+// Convert an 8-bit coverage bitmap, rasterized at downsample times the desired resolution, into an 8-bit signed distance field of
+// size dims / downsample. Texels hold 0.5 on the edge of the shape, rising to 1 at spread texels inside it and falling to 0 at 
+// spread texels outside it. Distances are measured exactly at full resolution and averaged over each block of downsample^2 pixels.
+std::vector<uint8_t> compute_signed_distance_field(const uint8_t * coverage, int2 dims, int downsample, float spread);
+
+#endif
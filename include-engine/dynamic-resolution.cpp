@@ -0,0 +1,38 @@
+#include "dynamic-resolution.h"
+#include <algorithm>    // For std::min(...), std::max(...)
+#include <stdexcept>    // For std::logic_error
+
+resolution_controller::resolution_controller(uint2 max_dims, float target_seconds, float min_scale, int step_count) :
+    max_dims{max_dims}, target_seconds{target_seconds}, min_scale{min_scale}, step{(1 - min_scale) / step_count}, smoothed_seconds{0}, scale{1}, settle_frames{0}
+{
+    if(target_seconds <= 0) throw std::logic_error("resolution_controller requires a positive target frame time");
+    if(min_scale <= 0 || min_scale > 1) throw std::logic_error("resolution_controller requires a minimum scale between zero and one");
+    if(step_count < 1) throw std::logic_error("resolution_controller requires at least one step");
+}
+
+uint2 resolution_controller::get_viewport_dims() const
+{
+    return max(uint2(float2(max_dims) * scale + 0.5f), uint2{1,1});
+}
+
+void resolution_controller::update(float gpu_seconds)
+{
+    smoothed_seconds = smoothed_seconds > 0 ? smoothed_seconds + (gpu_seconds - smoothed_seconds) * 0.1f : gpu_seconds;
+    if(settle_frames > 0) { --settle_frames; return; }
+
+    // Do nothing while the frame time lies within the band, aiming for its middle when correcting
+    const float low_seconds = target_seconds * 0.85f, desired_seconds = target_seconds * 0.925f;
+    if(smoothed_seconds >= low_seconds && smoothed_seconds <= target_seconds) return;
+    const float desired_scale = scale * std::sqrt(desired_seconds / smoothed_seconds);
+
+    // Round towards the current scale, so that a correction does not overshoot to the opposite side of the band, but move at least one step
+    const float steps = (desired_scale - min_scale) / step;
+    const float stepped_scale = smoothed_seconds > target_seconds ? std::min(min_scale + std::ceil(steps) * step, scale - step) : std::max(min_scale + std::floor(steps) * step, scale + step);
+    const float new_scale = std::min(std::max(stepped_scale, min_scale), 1.0f);
+    if(std::abs(new_scale - scale) < step * 0.5f) return;
+
+    // Predict the frame time at the new scale, so that smoothing continues from a sensible value
+    smoothed_seconds *= (new_scale * new_scale) / (scale * scale);
+    scale = new_scale;
+    settle_frames = 8;
+}
@@ -0,0 +1,32 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <functional>   // For std::hash<T>, specialized by linalg.h
+#include "linalg.h"
+using namespace linalg::aliases;
+
+// Chooses a render resolution for each frame which holds the measured GPU frame time near a target. Scene targets are allocated
+// at max_dims, and each frame renders into the sub-rectangle of size get_viewport_dims() at their origin. GPU time is roughly
+// proportional to pixel count, so when the smoothed frame time leaves a band just below the target, the scale is corrected by
+// the square root of the ratio of the desired time to the measured time. Scales are quantized to a few steps between min_scale
+// and one, so that only a handful of distinct viewports are ever used, and cached command buffers can be reused across frames.
+class resolution_controller
+{
+    uint2 max_dims;
+    float target_seconds, min_scale, step;
+    float smoothed_seconds, scale;
+    int settle_frames;
+public:
+    resolution_controller(uint2 max_dims, float target_seconds, float min_scale=0.5f, int step_count=8);
+
+    float get_scale() const { return scale; }
+    float get_smoothed_seconds() const { return smoothed_seconds; }
+    uint2 get_max_dims() const { return max_dims; }
+    uint2 get_viewport_dims() const;
+
+    // Feed the GPU time of a completed frame. Measurements arrive a few frames late, so the scale is held for a short while after
+    // each change, to avoid reacting again to frames which were rendered before the change took effect.
+    void update(float gpu_seconds);
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "flow-field.h"
+#include <algorithm>    // For std::push_heap(...), std::pop_heap(...), std::max(...)
+#include <cstdlib>      // For std::abs(...)
+#include <stdexcept>    // For std::logic_error
+
+// Straight moves come first, so that ties between equally cheap moves favor them
+static const int2 neighbor_offsets[8] {{1,0}, {0,1}, {-1,0}, {0,-1}, {1,1}, {-1,1}, {-1,-1}, {1,-1}};
+
+// Diagonal moves cost 7/5 as much as straight moves, approximating their true ratio of sqrt(2) in integers
+static uint32_t get_move_cost(int move, uint8_t cost) { return (move < 4 ? 5u : 7u) * cost; }
+
+// Return true if a unit can move from cell to its neighbor along the given move, without entering or cutting the corner of an
+// impassable cell
+static bool can_move(const cost_field & costs, const int2 & cell, int move)
+{
+    const int2 offset = neighbor_offsets[move], next = cell + offset;
+    if(!costs.contains(cell) || !costs.contains(next) || costs.get_cost(next) == cost_field::impassable) return false;
+    if(move < 4) return true;
+    return costs.get_cost({next.x, cell.y}) != cost_field::impassable && costs.get_cost({cell.x, next.y}) != cost_field::impassable;
+}
+
+static int chebyshev_distance(const int2 & a, const int2 & b) { return std::max(std::abs(a.x - b.x), std::abs(a.y - b.y)); }
+
+////////////////
+// cost_field //
+////////////////
+
+cost_field::cost_field(const float2 & origin, float cell_size, const int2 & dims, uint8_t cost) : origin{origin}, cell_size{cell_size}, dims{dims}
+{
+    if(dims.x <= 0 || dims.y <= 0) throw std::logic_error("cost_field requires at least one cell");
+    if(cost == 0) throw std::logic_error("cost_field costs must be at least one");
+    costs.assign(dims.x*dims.y, cost);
+}
+
+void cost_field::set_cost(const int2 & cell, uint8_t cost)
+{
+    if(!contains(cell)) throw std::logic_error("cost_field cell out of range");
+    if(cost == 0) throw std::logic_error("cost_field costs must be at least one");
+    costs[get_index(cell)] = cost;
+}
+
+////////////////
+// flow_field //
+////////////////
+
+// Entries of the queue are pairs of {distance, index}, kept as a min heap
+using queue_entry = std::pair<uint32_t,uint32_t>;
+static void push_entry(std::vector<queue_entry> & queue, uint32_t distance, uint32_t index) { queue.push_back({distance, index}); std::push_heap(begin(queue), end(queue), std::greater<queue_entry>()); }
+
+flow_field::flow_field(const cost_field & costs, std::vector<int2> goals) : goals{std::move(goals)}, origin{costs.get_origin()}, cell_size{costs.get_cell_size()}, dims{costs.get_dims()}
+{
+    distances.assign(dims.x*dims.y, unreachable);
+    moves.assign(dims.x*dims.y, no_move);
+    marks.assign(dims.x*dims.y, 0);
+
+    std::vector<queue_entry> queue;
+    for(auto & g : this->goals)
+    {
+        if(!costs.contains(g)) throw std::logic_error("flow_field goal out of range");
+        distances[costs.get_index(g)] = 0;
+        push_entry(queue, 0, costs.get_index(g));
+    }
+    propagate(costs, queue);
+    changed.clear();
+    for(int y=0; y<dims.y; ++y) for(int x=0; x<dims.x; ++x) update_move(costs, {x,y});
+}
+
+void flow_field::propagate(const cost_field & costs, std::vector<queue_entry> & queue)
+{
+    while(!queue.empty())
+    {
+        std::pop_heap(begin(queue), end(queue), std::greater<queue_entry>());
+        const auto [distance, index] = queue.back();
+        queue.pop_back();
+        if(distance != distances[index]) continue;
+
+        // Relax every cell which can move into this one
+        const int2 cell {static_cast<int>(index % dims.x), static_cast<int>(index / dims.x)};
+        if(costs.get_cost(cell) == cost_field::impassable) continue;
+        for(int m=0; m<8; ++m)
+        {
+            const int2 prev = cell - neighbor_offsets[m];
+            if(!can_move(costs, prev, m)) continue;
+            const uint32_t prev_index = costs.get_index(prev), prev_distance = distance + get_move_cost(m, costs.get_cost(cell));
+            if(prev_distance >= distances[prev_index]) continue;
+            distances[prev_index] = prev_distance;
+            changed.push_back(prev_index);
+            push_entry(queue, prev_distance, prev_index);
+        }
+    }
+}
+
+void flow_field::update_move(const cost_field & costs, const int2 & cell)
+{
+    const uint32_t index = costs.get_index(cell);
+    moves[index] = no_move;
+    if(distances[index] == 0 || distances[index] == unreachable) return;
+    uint32_t best = unreachable;
+    for(int m=0; m<8; ++m)
+    {
+        if(!can_move(costs, cell, m)) continue;
+        const int2 next = cell + neighbor_offsets[m];
+        const uint32_t next_distance = distances[costs.get_index(next)];
+        if(next_distance == unreachable) continue;
+        const uint32_t distance = next_distance + get_move_cost(m, costs.get_cost(next));
+        if(distance < best)
+        {
+            best = distance;
+            moves[index] = static_cast<uint8_t>(m);
+        }
+    }
+}
+
+int2 flow_field::get_next_cell(const int2 & cell) const
+{
+    const uint8_t m = moves[cell.y*dims.x + cell.x];
+    return m == no_move ? cell : cell + neighbor_offsets[m];
+}
+
+float2 flow_field::get_direction(const float2 & p) const
+{
+    const int2 cell = clamp(int2(floor((p - origin) / cell_size)), int2(0,0), dims - 1), next = get_next_cell(cell);
+    if(next == cell) return {0,0};
+    return normalize(origin + (float2(next) + 0.5f) * cell_size - p);
+}
+
+void flow_field::update(const cost_field & costs, const std::vector<int2> & changed_cells)
+{
+    if(costs.get_dims() != dims) throw std::logic_error("flow_field costs have changed size");
+    enum : uint8_t { is_affected = 1, needs_move = 2 };
+    auto get_cell = [&](uint32_t index) { return int2{static_cast<int>(index % dims.x), static_cast<int>(index / dims.x)}; };
+    auto mark_affected = [&](uint32_t index)
+    {
+        if(marks[index] & is_affected) return;
+        marks[index] |= is_affected;
+        affected.push_back(index);
+    };
+
+    // Cells whose first move entered or cut past a changed cell may now have a more expensive path, as may every cell whose path
+    // passed through one of them
+    affected.clear();
+    for(auto & c : changed_cells)
+    {
+        for(auto & offset : neighbor_offsets)
+        {
+            const int2 cell = c + offset;
+            if(costs.contains(cell) && moves[costs.get_index(cell)] != no_move && chebyshev_distance(get_next_cell(cell), c) <= 1) mark_affected(costs.get_index(cell));
+        }
+    }
+    for(size_t i=0; i<affected.size(); ++i)
+    {
+        const int2 cell = get_cell(affected[i]);
+        for(int m=0; m<8; ++m)
+        {
+            const int2 prev = cell - neighbor_offsets[m];
+            if(costs.contains(prev) && moves[costs.get_index(prev)] == m) mark_affected(costs.get_index(prev));
+        }
+    }
+    for(auto i : affected) distances[i] = unreachable;
+
+    // Restart the search from every unaffected cell bordering the affected cells or the changed cells, which covers every cell whose
+    // moves into its neighbors have changed
+    std::vector<queue_entry> queue;
+    auto seed_around = [&](const int2 & cell)
+    {
+        for(int m=-1; m<8; ++m)
+        {
+            const int2 seed = m < 0 ? cell : cell + neighbor_offsets[m];
+            if(!costs.contains(seed)) continue;
+            const uint32_t index = costs.get_index(seed);
+            if(!(marks[index] & is_affected) && distances[index] != unreachable) push_entry(queue, distances[index], index);
+        }
+    };
+    for(auto i : affected) seed_around(get_cell(i));
+    for(auto & c : changed_cells) seed_around(c);
+    changed.clear();
+    propagate(costs, queue);
+
+    // Recompute the first move of every cell next to a cell whose distance or cost has changed
+    std::vector<uint32_t> & touched = affected;
+    touched.insert(end(touched), begin(changed), end(changed));
+    for(auto & c : changed_cells) touched.push_back(costs.get_index(c));
+    const size_t touched_count = touched.size();
+    for(size_t i=0; i<touched_count; ++i)
+    {
+        const int2 cell = get_cell(touched[i]);
+        for(int m=-1; m<8; ++m)
+        {
+            const int2 neighbor = m < 0 ? cell : cell + neighbor_offsets[m];
+            if(!costs.contains(neighbor)) continue;
+            const uint32_t index = costs.get_index(neighbor);
+            if(marks[index] & needs_move) continue;
+            marks[index] |= needs_move;
+            touched.push_back(index);
+        }
+    }
+    for(size_t i=touched_count; i<touched.size(); ++i) update_move(costs, get_cell(touched[i]));
+    for(auto i : touched) marks[i] = 0;
+}
+
+//////////////////////
+// flow_field_cache //
+//////////////////////
+
+flow_field_cache::flow_field_cache(cost_field costs) : costs{std::move(costs)} {}
+
+void flow_field_cache::set_cost(const int2 & cell, uint8_t cost)
+{
+    if(costs.get_cost(cell) == cost) return;
+    costs.set_cost(cell, cost);
+    changed_cells.push_back(cell);
+}
+
+const flow_field & flow_field_cache::get_field(const int2 & goal)
+{
+    if(!changed_cells.empty())
+    {
+        for(auto & f : fields) f.second.field.update(costs, changed_cells);
+        changed_cells.clear();
+    }
+    auto it = fields.find(goal);
+    if(it == fields.end()) it = fields.emplace(goal, entry{flow_field{costs, {goal}}, false}).first;
+    it->second.used = true;
+    return it->second.field;
+}
+
+void flow_field_cache::update()
+{
+    for(auto it=fields.begin(); it!=fields.end(); )
+    {
+        if(!it->second.used) it = fields.erase(it);
+        else
+        {
+            it->second.used = false;
+            ++it;
+        }
+    }
+}
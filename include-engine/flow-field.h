@@ -0,0 +1,107 @@
+#ifndef FLOW_FIELD_H
+#define FLOW_FIELD_H
+
+#include <vector>           // For std::vector<T>
+#include <unordered_map>    // For std::unordered_map<K,V>
+#include <utility>          // For std::pair<T,U>
+#include <cstdint>          // For uint8_t, uint32_t
+#include <functional>       // For std::hash<T>, specialized by linalg.h
+#include "linalg.h"
+using namespace linalg::aliases;
+
+// The cost of entering each cell of a uniform grid over a rectangle of the plane, where cost_field::impassable cells cannot be entered
+class cost_field
+{
+    float2 origin;
+    float cell_size;
+    int2 dims;
+    std::vector<uint8_t> costs;
+public:
+    static constexpr uint8_t impassable = 255;
+
+    // Every cell starts with the given cost, which must be at least one
+    cost_field(const float2 & origin, float cell_size, const int2 & dims, uint8_t cost=1);
+
+    const float2 & get_origin() const { return origin; }
+    float get_cell_size() const { return cell_size; }
+    const int2 & get_dims() const { return dims; }
+    bool contains(const int2 & cell) const { return cell.x >= 0 && cell.y >= 0 && cell.x < dims.x && cell.y < dims.y; }
+    uint32_t get_index(const int2 & cell) const { return cell.y*dims.x + cell.x; }
+
+    // Return the cell containing p, clamped to the grid
+    int2 get_cell(const float2 & p) const { return clamp(int2(floor((p - origin) / cell_size)), int2(0,0), dims - 1); }
+    float2 get_cell_center(const int2 & cell) const { return origin + (float2(cell) + 0.5f) * cell_size; }
+
+    uint8_t get_cost(const int2 & cell) const { return costs[get_index(cell)]; }
+    void set_cost(const int2 & cell, uint8_t cost);
+};
+
+// Directs movement from every cell of a cost_field towards the nearest of a set of goal cells. The integration field holds the cost
+// of the cheapest path from each cell to a goal, found by Dijkstra's algorithm over moves to the eight neighboring cells, where a
+// straight move costs 5 and a diagonal move costs 7 times the cost of the cell entered, and diagonal moves may not cut the corner of
+// an impassable cell. Distances are integers, so they do not depend on the order in which paths were found. The direction field
+// stores the first move of a cheapest path from each cell, so that any number of units can look up where to go in constant time.
+class flow_field
+{
+    std::vector<int2> goals;
+    std::vector<uint32_t> distances;
+    std::vector<uint8_t> moves;     // Index into the neighbor offsets of the first move from each cell, or no_move
+    float2 origin;
+    float cell_size;
+    int2 dims;
+
+    // Scratch space for update(...)
+    std::vector<uint8_t> marks;
+    std::vector<uint32_t> affected, changed;
+
+    void propagate(const cost_field & costs, std::vector<std::pair<uint32_t,uint32_t>> & queue);
+    void update_move(const cost_field & costs, const int2 & cell);
+public:
+    static constexpr uint32_t unreachable = ~0u;
+    static constexpr uint8_t no_move = 255;
+
+    flow_field(const cost_field & costs, std::vector<int2> goals);
+
+    const std::vector<int2> & get_goals() const { return goals; }
+    uint32_t get_distance(const int2 & cell) const { return distances[cell.y*dims.x + cell.x]; }
+
+    // Return the neighboring cell to move to from cell, or cell itself if cell is a goal or no goal can be reached from it
+    int2 get_next_cell(const int2 & cell) const;
+
+    // Return the unit vector from p towards the center of the next cell along a cheapest path, or {0,0} if p is in a goal cell or no
+    // goal can be reached from it. Positions outside the grid are treated as being in the nearest cell.
+    float2 get_direction(const float2 & p) const;
+
+    // Bring the field up to date after the costs of changed_cells have changed. Cells whose cheapest path entered a changed cell are
+    // recomputed along with every cell whose path passed through them, and improvements spread outwards from the changed cells, so
+    // the result is identical to building a new field, but only touches the cells whose paths have changed.
+    void update(const cost_field & costs, const std::vector<int2> & changed_cells);
+};
+
+// Shares one flow_field between every caller heading to the same goal cell, and keeps each field up to date as costs change
+class flow_field_cache
+{
+    struct entry
+    {
+        flow_field field;
+        bool used;
+    };
+    cost_field costs;
+    std::vector<int2> changed_cells;
+    std::unordered_map<int2, entry> fields;
+public:
+    explicit flow_field_cache(cost_field costs);
+
+    const cost_field & get_costs() const { return costs; }
+
+    // Changes are applied to cached fields the next time any field is requested
+    void set_cost(const int2 & cell, uint8_t cost);
+
+    // Return the field leading to goal, building it if needed. The reference remains valid until the next call to update().
+    const flow_field & get_field(const int2 & goal);
+
+    // Discard fields which have not been requested since the last call to update()
+    void update();
+};
+
+#endif
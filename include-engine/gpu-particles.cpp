@@ -0,0 +1,121 @@
+#include "gpu-particles.h"
+
+// Matches the std140 ParticleUpdate uniform block of the particle shaders
+struct particle_update
+{
+    float3 gravity; float restitution;
+    float3 ground_normal; float ground_offset;
+    float timestep;
+    uint32_t max_particles, current_list, emit_count, burst_count, seed, index_count;
+};
+
+static void memory_barrier(VkCommandBuffer cmd, VkPipelineStageFlags src_stages, VkAccessFlags src_access, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access)
+{
+    const VkMemoryBarrier barrier {VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, src_access, dst_access};
+    vkCmdPipelineBarrier(cmd, src_stages, dst_stages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+static void compute_barrier(VkCommandBuffer cmd) { memory_barrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT|VK_ACCESS_SHADER_WRITE_BIT); }
+
+static void bind_pipeline(VkCommandBuffer cmd, const compute_pipeline & pipeline, const scene_descriptor_set & descriptors)
+{
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.get_vk_handle());
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.get_pipeline_layout(), 0, {descriptors.get_descriptor_set()}, {});
+}
+
+static uint32_t get_group_count(uint32_t invocations) { return (invocations + gpu_particles::group_size - 1) / gpu_particles::group_size; }
+
+gpu_particles::gpu_particles(renderer & r, uint32_t max_particles, uint32_t index_count, std::shared_ptr<shader> reset_shader, std::shared_ptr<shader> emit_shader, 
+    std::shared_ptr<shader> prepare_shader, std::shared_ptr<shader> simulate_shader) : max_particles{max_particles}, index_count{index_count}
+{
+    if(max_particles == 0) throw std::logic_error("gpu_particles requires room for at least one particle");
+    reset = r.create_compute_pipeline(reset_shader);
+    emit = r.create_compute_pipeline(emit_shader);
+    prepare = r.create_compute_pipeline(prepare_shader);
+    simulate = r.create_compute_pipeline(simulate_shader);
+
+    // Counters hold the dead count and the simulation count, followed by indirect dispatch arguments at 16 and indirect draw arguments at 32
+    const VkMemoryPropertyFlags memory = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    counters = std::make_unique<static_buffer>(r.ctx, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, memory, 32 + sizeof(VkDrawIndexedIndirectCommand), nullptr);
+    particles = std::make_unique<static_buffer>(r.ctx, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, memory, max_particles * sizeof(float) * 12, nullptr);
+    dead_list = std::make_unique<static_buffer>(r.ctx, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, memory, max_particles * sizeof(uint32_t), nullptr);
+    alive_lists = std::make_unique<static_buffer>(r.ctx, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, memory, max_particles * sizeof(uint32_t) * 2, nullptr);
+    instances = std::make_unique<static_buffer>(r.ctx, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, memory, max_particles * sizeof(particle_instance), nullptr);
+}
+
+void gpu_particles::clear(VkCommandBuffer cmd, transient_resource_pool & pool)
+{
+    particle_update u {};
+    u.max_particles = max_particles;
+    u.index_count = index_count;
+    scene_descriptor_set set {pool, reset->get_descriptor_set_layout()};
+    set.write_uniform_buffer(0, 0, pool.write_data(u));
+    set.write_storage_buffer(1, 0, {*counters, 0, VK_WHOLE_SIZE});
+    set.write_storage_buffer(3, 0, {*dead_list, 0, VK_WHOLE_SIZE});
+    bind_pipeline(cmd, *reset, set);
+    vkCmdDispatch(cmd, get_group_count(max_particles), 1, 1);
+    memory_barrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT|VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 
+        VK_ACCESS_SHADER_READ_BIT|VK_ACCESS_SHADER_WRITE_BIT|VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+    needs_reset = false;
+}
+
+void gpu_particles::update(VkCommandBuffer cmd, transient_resource_pool & pool, float timestep, const particle_physics & physics, const std::vector<particle_burst> & bursts)
+{
+    // Assign each burst its range of the particles emitted by this update
+    std::vector<particle_burst> emitted;
+    uint32_t emit_count = 0;
+    for(auto b : bursts)
+    {
+        if(b.count == 0) continue;
+        b.first = emit_count;
+        emit_count += b.count;
+        emitted.push_back(b);
+    }
+
+    const particle_update u {physics.gravity, physics.restitution, physics.ground_normal, physics.ground_offset, timestep, max_particles, current_list, emit_count, static_cast<uint32_t>(emitted.size()), seed++, index_count};
+    const auto uniforms = pool.write_data(u);
+    const VkDescriptorBufferInfo counter_info {*counters, 0, VK_WHOLE_SIZE}, particle_info {*particles, 0, VK_WHOLE_SIZE}, dead_info {*dead_list, 0, VK_WHOLE_SIZE};
+    const VkDescriptorBufferInfo alive_info {*alive_lists, 0, VK_WHOLE_SIZE}, instance_info {*instances, 0, VK_WHOLE_SIZE};
+
+    // Wait for the previous update's writes, and for earlier draws to finish reading instances and arguments before they are overwritten
+    memory_barrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT|VK_PIPELINE_STAGE_VERTEX_INPUT_BIT|VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_WRITE_BIT, 
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT|VK_ACCESS_SHADER_WRITE_BIT);
+
+    if(needs_reset) clear(cmd, pool);
+
+    if(emit_count)
+    {
+        scene_descriptor_set set {pool, emit->get_descriptor_set_layout()};
+        set.write_uniform_buffer(0, 0, uniforms);
+        set.write_storage_buffer(1, 0, counter_info);
+        set.write_storage_buffer(2, 0, particle_info);
+        set.write_storage_buffer(3, 0, dead_info);
+        set.write_storage_buffer(4, 0, alive_info);
+        set.write_storage_buffer(6, 0, pool.write_data(emitted.size() * sizeof(particle_burst), emitted.data()));
+        bind_pipeline(cmd, *emit, set);
+        vkCmdDispatch(cmd, get_group_count(emit_count), 1, 1);
+        compute_barrier(cmd);
+    }
+
+    // Size the simulation to the alive list on the GPU, so the CPU never needs to read back the particle count
+    scene_descriptor_set prepare_set {pool, prepare->get_descriptor_set_layout()};
+    prepare_set.write_uniform_buffer(0, 0, uniforms);
+    prepare_set.write_storage_buffer(1, 0, counter_info);
+    bind_pipeline(cmd, *prepare, prepare_set);
+    vkCmdDispatch(cmd, 1, 1, 1);
+    memory_barrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT|VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 
+        VK_ACCESS_SHADER_READ_BIT|VK_ACCESS_SHADER_WRITE_BIT|VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+    scene_descriptor_set simulate_set {pool, simulate->get_descriptor_set_layout()};
+    simulate_set.write_uniform_buffer(0, 0, uniforms);
+    simulate_set.write_storage_buffer(1, 0, counter_info);
+    simulate_set.write_storage_buffer(2, 0, particle_info);
+    simulate_set.write_storage_buffer(3, 0, dead_info);
+    simulate_set.write_storage_buffer(4, 0, alive_info);
+    simulate_set.write_storage_buffer(5, 0, instance_info);
+    bind_pipeline(cmd, *simulate, simulate_set);
+    vkCmdDispatchIndirect(cmd, *counters, 16);
+    memory_barrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT|VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT|VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+    current_list = 1 - current_list;
+}
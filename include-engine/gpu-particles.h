@@ -0,0 +1,39 @@
+#ifndef GPU_PARTICLES_H
+#define GPU_PARTICLES_H
+
+#include "renderer.h"
+#include "particle-pool.h"
+
+// Simulates particles entirely on the GPU. Particle state lives in device local storage buffers alongside a list of dead particles
+// and a pair of alive lists. Each update emits the requested bursts into the dead particles, integrates every live particle, returns
+// expired particles to the dead list, and compacts survivors into the other alive list while writing their instance data, so that
+// they can be drawn with an indirect draw whose instance count never leaves the GPU. The CPU only uploads burst requests.
+class gpu_particles
+{
+    std::shared_ptr<compute_pipeline> reset, emit, prepare, simulate;
+    std::unique_ptr<static_buffer> counters, particles, dead_list, alive_lists, instances;
+    uint32_t max_particles, index_count, current_list {}, seed {};
+    bool needs_reset {true};
+public:
+    // Groups of the particle shaders must be 64 invocations, except for the single invocation preparation shader
+    static constexpr uint32_t group_size = 64;
+
+    // Shader bindings are described in the shaders which accompany example-rts, in assets/particle_*.comp. Each particle is drawn 
+    // as an instance of a mesh with index_count indices.
+    gpu_particles(renderer & r, uint32_t max_particles, uint32_t index_count, std::shared_ptr<shader> reset_shader, std::shared_ptr<shader> emit_shader, 
+        std::shared_ptr<shader> prepare_shader, std::shared_ptr<shader> simulate_shader);
+
+    // Per-instance vertex buffer and VkDrawIndexedIndirectCommand arguments for draw_list::draw_indirect(...), valid after update(...)
+    VkDescriptorBufferInfo get_instances() const { return {*instances, 0, max_particles * sizeof(particle_instance)}; }
+    VkDescriptorBufferInfo get_draw_arguments() const { return {*counters, 32, sizeof(VkDrawIndexedIndirectCommand)}; }
+
+    // Records a dispatch into cmd, outside of any render pass, which kills every particle and zeroes the instance count of the draw
+    // arguments. The first update(...) records it automatically, but it must be recorded explicitly before drawing from buffers which
+    // no update(...) has written, such as when replaying a captured frame.
+    void clear(VkCommandBuffer cmd, transient_resource_pool & pool);
+
+    // Records all dispatches into cmd, outside of any render pass. Bursts beyond the capacity of the dead list are dropped.
+    void update(VkCommandBuffer cmd, transient_resource_pool & pool, float timestep, const particle_physics & physics, const std::vector<particle_burst> & bursts);
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "light-clusters.h"
+#include <algorithm>    // For std::min(...), std::max(...)
+#include <stdexcept>    // For std::logic_error
+
+light_clusters::light_clusters(uint3 dims, float near_depth, float far_depth, size_t max_lights, size_t max_light_indices) :
+    dims{dims}, max_lights{max_lights}, max_light_indices{max_light_indices}
+{
+    if(dims.x == 0 || dims.y == 0 || dims.z == 0) throw std::logic_error("light_clusters requires at least one froxel");
+    if(near_depth <= 0 || far_depth <= near_depth) throw std::logic_error("light_clusters requires 0 < near_depth < far_depth");
+    depth_scale = dims.z / std::log(far_depth / near_depth);
+    depth_bias = -std::log(near_depth) * depth_scale;
+}
+
+void light_clusters::assign(const float4x4 & view_proj_matrix, const std::vector<clustered_light> & lights)
+{
+    // Transform light centers into clip space
+    const size_t n = std::min(lights.size(), max_lights);
+    const float4 row_x = view_proj_matrix.row(0), row_y = view_proj_matrix.row(1), row_w = view_proj_matrix.row(3);
+    clip_x.resize(n); clip_y.resize(n); clip_w.resize(n);
+    for(size_t i=0; i<n; ++i)
+    {
+        const float4 p {lights[i].position, 1};
+        clip_x[i] = dot(row_x, p);
+        clip_y[i] = dot(row_y, p);
+        clip_w[i] = dot(row_w, p);
+    }
+
+    // Compute a conservative range of froxels for each light, by treating the light's bounding box as a set of intervals in clip space
+    const float extent_x = length(row_x.xyz()), extent_y = length(row_y.xyz()), extent_w = length(row_w.xyz());
+    const int3 max_index = int3(dims) - 1;
+    min_froxel.resize(n); max_froxel.resize(n);
+    for(size_t i=0; i<n; ++i)
+    {
+        const float r = lights[i].radius, x0 = clip_x[i] - r*extent_x, x1 = clip_x[i] + r*extent_x, y0 = clip_y[i] - r*extent_y, y1 = clip_y[i] + r*extent_y;
+        const float w0 = clip_w[i] - r*extent_w, w1 = clip_w[i] + r*extent_w;
+
+        // Fragments nearer or further than the grid are clamped to its first or last slice, so lights are clamped the same way
+        const float z0 = std::log(std::max(w0, 1e-6f)) * depth_scale + depth_bias, z1 = std::log(std::max(w1, 1e-6f)) * depth_scale + depth_bias;
+
+        // Lights which reach the plane of the eye can project anywhere on screen
+        const bool straddles_eye = w0 <= 0;
+        const float ndc_x0 = straddles_eye ? -1 : std::min(x0/w0, x0/w1), ndc_x1 = straddles_eye ? 1 : std::max(x1/w0, x1/w1);
+        const float ndc_y0 = straddles_eye ? -1 : std::min(y0/w0, y0/w1), ndc_y1 = straddles_eye ? 1 : std::max(y1/w0, y1/w1);
+        const int3 lo {static_cast<int>(std::floor((ndc_x0*0.5f+0.5f)*dims.x)), static_cast<int>(std::floor((ndc_y0*0.5f+0.5f)*dims.y)), static_cast<int>(std::floor(z0))};
+        const int3 hi {static_cast<int>(std::floor((ndc_x1*0.5f+0.5f)*dims.x)), static_cast<int>(std::floor((ndc_y1*0.5f+0.5f)*dims.y)), static_cast<int>(std::floor(z1))};
+
+        // Lights entirely behind the eye or off the sides of the screen get an empty range
+        const bool culled = w1 <= 0 || hi.x < 0 || hi.y < 0 || lo.x > max_index.x || lo.y > max_index.y;
+        min_froxel[i] = culled ? int3{1,1,1} : clamp(lo, int3{0,0,0}, max_index);
+        max_froxel[i] = culled ? int3{0,0,0} : clamp(hi, int3{0,0,0}, max_index);
+    }
+
+    // Accept lights in order until the index list would overflow
+    this->lights.clear();
+    size_t total_indices = 0;
+    for(size_t i=0; i<n; ++i)
+    {
+        const int3 size = max(max_froxel[i] - min_froxel[i] + 1, int3{0,0,0});
+        const size_t count = static_cast<size_t>(size.x) * size.y * size.z;
+        if(total_indices + count > max_light_indices) break;
+        total_indices += count;
+        this->lights.push_back(lights[i]);
+    }
+
+    // Count the lights touching each froxel, then lay out each froxel's range of indices contiguously
+    ranges.assign(dims.x*dims.y*dims.z, uint2{0,0});
+    for(size_t i=0; i<this->lights.size(); ++i)
+    {
+        for(int z=min_froxel[i].z; z<=max_froxel[i].z; ++z)
+        for(int y=min_froxel[i].y; y<=max_froxel[i].y; ++y)
+        for(int x=min_froxel[i].x; x<=max_froxel[i].x; ++x) ++ranges[get_cluster_index(uint3(int3{x,y,z}))].y;
+    }
+    uint32_t first = 0;
+    for(auto & range : ranges)
+    {
+        range.x = first;
+        first += range.y;
+        range.y = 0;
+    }
+
+    // Write light indices, in increasing order within each froxel
+    light_indices.resize(total_indices);
+    for(size_t i=0; i<this->lights.size(); ++i)
+    {
+        for(int z=min_froxel[i].z; z<=max_froxel[i].z; ++z)
+        for(int y=min_froxel[i].y; y<=max_froxel[i].y; ++y)
+        for(int x=min_froxel[i].x; x<=max_froxel[i].x; ++x)
+        {
+            auto & range = ranges[get_cluster_index(uint3(int3{x,y,z}))];
+            light_indices[range.x + range.y++] = static_cast<uint32_t>(i);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <vector>       // For std::vector<T>
+#include <functional>   // For std::hash<T>, specialized by linalg.h
+#include "linalg.h"
+using namespace linalg::aliases;
+
+// A point light with a finite radius of influence, laid out to match a std430 struct { vec3 position; float radius; vec3 color; }
+struct clustered_light
+{
+    float3 position;
+    float radius;
+    float3 color;
+    float padding;
+};
+
+// Divides a view frustum into a grid of froxels, with dims.x by dims.y tiles in normalized device coordinates and dims.z slices
+// spaced exponentially in view depth between near_depth and far_depth, and assigns point lights to every froxel they might touch.
+// The result is a {first, count} range per froxel into a compact list of light indices, suitable for upload to storage buffers.
+class light_clusters
+{
+    uint3 dims;
+    float depth_scale, depth_bias;                  // Depth slice of a fragment is floor(log(depth) * depth_scale + depth_bias)
+    size_t max_lights, max_light_indices;
+
+    std::vector<float> clip_x, clip_y, clip_w;      // Per-light scratch data, kept in structure-of-arrays form so that the
+    std::vector<int3> min_froxel, max_froxel;       // bounds computation can be vectorized by the compiler
+    std::vector<uint2> ranges;
+    std::vector<uint32_t> light_indices;
+    std::vector<clustered_light> lights;
+public:
+    light_clusters(uint3 dims, float near_depth, float far_depth, size_t max_lights, size_t max_light_indices);
+
+    uint3 get_dims() const { return dims; }
+    float get_depth_scale() const { return depth_scale; }
+    float get_depth_bias() const { return depth_bias; }
+    size_t get_cluster_index(const uint3 & froxel) const { return (froxel.z*dims.y + froxel.y)*dims.x + froxel.x; }
+
+    // Bin lights for the view with the given view-projection matrix, whose w output must be view depth. Lights beyond max_lights,
+    // or which would overflow max_light_indices, are dropped in order, so more important lights should be listed first.
+    void assign(const float4x4 & view_proj_matrix, const std::vector<clustered_light> & lights);
+
+    const std::vector<uint2> & get_ranges() const { return ranges; }
+    const std::vector<uint32_t> & get_light_indices() const { return light_indices; }
+    const std::vector<clustered_light> & get_lights() const { return lights; } // The lights which were accepted by the last call to assign(...)
+};
+
+#endif
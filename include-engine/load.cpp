@@ -306,19 +306,21 @@ struct spirv_module
             auto sampled = type.contents[5]; // 0 - unknown, 1 - used with sampler, 2 - used without sampler (i.e. storage image)
             switch(dim)
             {
-            case spv::Dim1D: return {shader_info::sampler{n.scalar, arrayed ? VK_IMAGE_VIEW_TYPE_1D_ARRAY : VK_IMAGE_VIEW_TYPE_1D, multisampled, shadow}};
-            case spv::Dim2D: return {shader_info::sampler{n.scalar, arrayed ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D, multisampled, shadow}};
-            case spv::Dim3D: return {shader_info::sampler{n.scalar, arrayed ? throw std::runtime_error("unsupported image type") : VK_IMAGE_VIEW_TYPE_3D, multisampled, shadow}};
-            case spv::DimCube: return {shader_info::sampler{n.scalar, arrayed ? VK_IMAGE_VIEW_TYPE_CUBE_ARRAY : VK_IMAGE_VIEW_TYPE_CUBE, multisampled, shadow}};
-            case spv::DimRect: return {shader_info::sampler{n.scalar, arrayed ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D, multisampled, shadow}};
+            case spv::Dim1D: return {shader_info::sampler{n.scalar, arrayed ? VK_IMAGE_VIEW_TYPE_1D_ARRAY : VK_IMAGE_VIEW_TYPE_1D, multisampled, shadow, sampled == 2}};
+            case spv::Dim2D: return {shader_info::sampler{n.scalar, arrayed ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D, multisampled, shadow, sampled == 2}};
+            case spv::Dim3D: return {shader_info::sampler{n.scalar, arrayed ? throw std::runtime_error("unsupported image type") : VK_IMAGE_VIEW_TYPE_3D, multisampled, shadow, sampled == 2}};
+            case spv::DimCube: return {shader_info::sampler{n.scalar, arrayed ? VK_IMAGE_VIEW_TYPE_CUBE_ARRAY : VK_IMAGE_VIEW_TYPE_CUBE, multisampled, shadow, sampled == 2}};
+            case spv::DimRect: return {shader_info::sampler{n.scalar, arrayed ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D, multisampled, shadow, sampled == 2}};
             default: throw std::runtime_error("unsupported image type"); // Buffer, SubpassData
             }
         }
         if(type.op == spv::OpTypeSampledImage) return get_type(type.contents[0], matrix_layout);
         if(type.op == spv::OpTypeArray) return {shader_info::array{std::make_unique<shader_info::type>(get_type(type.contents[0], matrix_layout)), get_array_length(type.contents[1]), meta.get_decoration(spv::DecorationArrayStride)}};
+        if(type.op == spv::OpTypeRuntimeArray) return {shader_info::array{std::make_unique<shader_info::type>(get_type(type.contents[0], matrix_layout)), 0, meta.get_decoration(spv::DecorationArrayStride)}}; // Length of zero indicates a runtime sized array
         if(type.op == spv::OpTypeStruct)
         {
             shader_info::structure s {meta.name};
+            s.storage_block = meta.has_decoration(spv::DecorationBufferBlock);
             // meta.has_decoration(spv::DecorationBlock) is true if this struct is used for VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER/VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
             // meta.has_decoration(spv::DecorationBufferBlock) is true if this struct is used for VK_DESCRIPTOR_TYPE_STORAGE_BUFFER/VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC
             for(size_t i=0; i<type.contents.size(); ++i)
@@ -437,7 +439,7 @@ shader_compiler::~shader_compiler()
     glslang::FinalizeProcess();
 }
 
-std::vector<uint32_t> shader_compiler::compile_glsl(VkShaderStageFlagBits stage, const char * filename)
+std::vector<uint32_t> shader_compiler::compile_glsl(VkShaderStageFlagBits stage, const char * filename, const char * preamble)
 {    
     glslang::TShader shader([stage]()
     {
@@ -457,6 +459,7 @@ std::vector<uint32_t> shader_compiler::compile_glsl(VkShaderStageFlagBits stage,
     const char * s = buffer.data();
     int l = static_cast<int>(buffer.size());
     shader.setStringsWithLengthsAndNames(&s, &l, &filename, 1);
+    if(preamble) shader.setPreamble(preamble);
 
     if(!shader.parse(&glslang::DefaultTBuiltInResource, 450, ENoProfile, false, false, static_cast<EShMessages>(EShMsgSpvRules|EShMsgVulkanRules), *impl))
     {
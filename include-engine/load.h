@@ -24,7 +24,8 @@ public:
     shader_compiler();
     ~shader_compiler();
 
-    std::vector<uint32_t> compile_glsl(VkShaderStageFlagBits stage, const char * filename);
+    // The preamble, if any, is inserted ahead of the source, and may hold preprocessor definitions which select a variant of the shader
+    std::vector<uint32_t> compile_glsl(VkShaderStageFlagBits stage, const char * filename, const char * preamble=nullptr);
 };
 
 #endif
@@ -0,0 +1,99 @@
+#include "particle-pool.h"
+#include <algorithm>    // For std::min(...), std::max(...), std::fill(...)
+#include <cmath>        // For std::sqrt(...)
+
+particle_pool::particle_pool(uint32_t seed)
+{
+    // Every lane must start from a distinct, nonzero state
+    for(size_t i=0; i<lane_count; ++i) rng_state[i] = (seed + static_cast<uint32_t>(i)) * 2654435761u | 1;
+}
+
+void particle_pool::resize(size_t size)
+{
+    for(auto * a : {&position[0], &position[1], &position[2], &velocity[0], &velocity[1], &velocity[2], &color[0], &color[1], &color[2], &life, &size_per_life}) a->resize(size);
+}
+
+void particle_pool::emit(const particle_burst & burst)
+{
+    const size_t first = size(), last = first + burst.count;
+    resize(last);
+
+    // Draw each component of the direction as the sum of four uniform samples, rescaled to zero mean and unit variance
+    for(size_t i=first; i<last; i+=lane_count)
+    {
+        for(auto & component : velocity)
+        {
+            float sum[lane_count] {};
+            for(int k=0; k<4; ++k)
+            {
+                for(size_t j=0; j<lane_count; ++j)
+                {
+                    uint32_t x = rng_state[j];
+                    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+                    rng_state[j] = x;
+                    sum[j] += static_cast<float>(x >> 8) * (1.0f / 16777216);
+                }
+            }
+            float * dir = component.data();
+            for(size_t j=0, n=std::min(lane_count, last-i); j<n; ++j) dir[i+j] = (sum[j] - 2) * 1.7320508f;
+        }
+    }
+
+    float * vx = velocity[0].data(), * vy = velocity[1].data(), * vz = velocity[2].data();
+    for(size_t i=first; i<last; ++i)
+    {
+        const float scale = burst.spread + burst.speed / std::max(std::sqrt(vx[i]*vx[i] + vy[i]*vy[i] + vz[i]*vz[i]), 1e-6f);
+        vx[i] *= scale; vy[i] *= scale; vz[i] *= scale;
+    }
+    for(int c=0; c<3; ++c)
+    {
+        std::fill(position[c].begin() + first, position[c].end(), burst.position[c]);
+        std::fill(color[c].begin() + first, color[c].end(), burst.color[c]);
+    }
+    std::fill(life.begin() + first, life.end(), burst.life);
+    std::fill(size_per_life.begin() + first, size_per_life.end(), burst.size_per_life);
+}
+
+void particle_pool::integrate(float timestep, const particle_physics & physics)
+{
+    const float3 drift = physics.gravity * (timestep*timestep/2), dv = physics.gravity * timestep, n = physics.ground_normal;
+    const float bounce = 1 + physics.restitution;
+    float * px = position[0].data(), * py = position[1].data(), * pz = position[2].data();
+    float * vx = velocity[0].data(), * vy = velocity[1].data(), * vz = velocity[2].data();
+    float * l = life.data();
+    for(size_t i=0, count=size(); i<count; ++i)
+    {
+        px[i] += vx[i] * timestep + drift.x;
+        py[i] += vy[i] * timestep + drift.y;
+        pz[i] += vz[i] * timestep + drift.z;
+        vx[i] += dv.x;
+        vy[i] += dv.y;
+        vz[i] += dv.z;
+
+        // Reflect the velocity of particles which are below the ground and still moving into it, without branching
+        const float height = px[i]*n.x + py[i]*n.y + pz[i]*n.z - physics.ground_offset, speed = vx[i]*n.x + vy[i]*n.y + vz[i]*n.z;
+        const float impulse = height < 0 && speed < 0 ? speed * bounce : 0.0f;
+        vx[i] -= n.x * impulse;
+        vy[i] -= n.y * impulse;
+        vz[i] -= n.z * impulse;
+        l[i] -= timestep;
+    }
+
+    // Remove dead particles by moving the last particle into their place
+    size_t count = size();
+    for(size_t i=0; i<count; )
+    {
+        if(life[i] > 0) { ++i; continue; }
+        --count;
+        for(auto * a : {&position[0], &position[1], &position[2], &velocity[0], &velocity[1], &velocity[2], &color[0], &color[1], &color[2], &life, &size_per_life}) (*a)[i] = (*a)[count];
+    }
+    resize(count);
+}
+
+void particle_pool::write_instances(particle_instance * instances) const
+{
+    for(size_t i=0, count=size(); i<count; ++i)
+    {
+        instances[i] = {{position[0][i], position[1][i], position[2][i]}, life[i] * size_per_life[i], {color[0][i], color[1][i], color[2][i]}, 0};
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef PARTICLE_POOL_H
+#define PARTICLE_POOL_H
+
+#include <vector>       // For std::vector<T>
+#include <functional>   // For std::hash<T>, specialized by linalg.h
+#include "linalg.h"
+using namespace linalg::aliases;
+
+// A burst of particles flying outwards from a point, laid out to match the std430 particle_burst struct of the particle shaders. Each
+// particle's velocity is a normally distributed vector scaled by spread, plus the unit vector along it scaled by speed, and its size 
+// shrinks along with its remaining life.
+struct particle_burst
+{
+    float3 position; uint32_t count;
+    float3 color; float life;
+    float speed, spread, size_per_life; 
+    uint32_t first; // Assigned by gpu_particles::update(...)
+};
+
+// Particles accelerate under gravity, and bounce off the ground plane of points p where dot(p, ground_normal) == ground_offset
+struct particle_physics
+{
+    float3 gravity; float restitution;
+    float3 ground_normal; float ground_offset;
+};
+
+// Per-instance vertex data of each live particle, laid out to match the std430 particle_instance struct of the particle shaders
+struct particle_instance
+{
+    float3 position; float size;
+    float3 color; float padding;
+};
+
+// Simulates particles on the CPU, for cases where the GPU simulation of gpu_particles is not wanted. State is stored as a structure
+// of arrays, with dead particles removed by swapping in the last particle, so that spawning, integration and instance generation are
+// simple loops over contiguous floats which the compiler can vectorize. Random directions come from several interleaved xorshift 
+// generators, approximating a normal distribution by a sum of uniform samples, which avoids transcendental functions entirely.
+class particle_pool
+{
+    static constexpr size_t lane_count = 8;
+    std::vector<float> position[3], velocity[3], color[3], life, size_per_life;
+    uint32_t rng_state[lane_count];
+
+    void resize(size_t size);
+public:
+    explicit particle_pool(uint32_t seed=1);
+
+    size_t size() const { return life.size(); }
+    float3 get_position(size_t i) const { return {position[0][i], position[1][i], position[2][i]}; }
+    float3 get_velocity(size_t i) const { return {velocity[0][i], velocity[1][i], velocity[2][i]}; }
+    float get_life(size_t i) const { return life[i]; }
+
+    void emit(const particle_burst & burst);
+
+    // Advance all particles by timestep, then remove those whose life has run out. Removal does not preserve the order of particles.
+    void integrate(float timestep, const particle_physics & physics);
+
+    // Write size() instances, one per particle, to a contiguous array, such as a range of a mapped vertex buffer
+    void write_instances(particle_instance * instances) const;
+};
+
+#endif
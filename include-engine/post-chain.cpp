@@ -0,0 +1,137 @@
+#include "post-chain.h"
+
+// Make storage image writes from earlier dispatches visible to later dispatches
+static void compute_barrier(VkCommandBuffer cmd)
+{
+    const VkMemoryBarrier barrier {VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT};
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+// Matches the std140 PostRegion uniform block of the post shaders
+struct post_region
+{
+    int2 dest_dims;
+    float2 source_scale;
+};
+
+static post_region get_region(uint2 dest_dims, uint2 source_dims, uint2 source_max_dims) { return {int2(dest_dims), float2(source_dims) / float2(source_max_dims)}; }
+
+static void dispatch_pipeline(VkCommandBuffer cmd, const compute_pipeline & pipeline, const scene_descriptor_set & descriptors, uint3 group_count)
+{
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.get_vk_handle());
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.get_pipeline_layout(), 0, {descriptors.get_descriptor_set()}, {});
+    vkCmdDispatch(cmd, group_count.x, group_count.y, group_count.z);
+}
+
+static uint2 get_level_dims(const uint2 & upper_dims) { return max(upper_dims / 2u, uint2{1,1}); }
+
+static uint3 get_pixel_groups(const uint2 & dims) { return {(dims.x + post_chain::pixel_group_size - 1) / post_chain::pixel_group_size, (dims.y + post_chain::pixel_group_size - 1) / post_chain::pixel_group_size, 1}; }
+
+VkFormat post_chain::select_bloom_format(const renderer & r)
+{
+    // Bloom is never negative and has no use for alpha, so B10G11R11 holds it in half the memory of RGBA16F
+    const VkFormatFeatureFlags features = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT|VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return r.supports_format(VK_FORMAT_B10G11R11_UFLOAT_PACK32, features) ? VK_FORMAT_B10G11R11_UFLOAT_PACK32 : VK_FORMAT_R16G16B16A16_SFLOAT;
+}
+
+const char * post_chain::get_shader_preamble(VkFormat bloom_format)
+{
+    switch(bloom_format)
+    {
+    case VK_FORMAT_B10G11R11_UFLOAT_PACK32: return "#define BLOOM_FORMAT r11f_g11f_b10f\n";
+    case VK_FORMAT_R16G16B16A16_SFLOAT: return "#define BLOOM_FORMAT rgba16f\n";
+    default: throw std::logic_error("unsupported post_chain bloom format");
+    }
+}
+
+post_chain::post_chain(renderer & r, uint2 max_dims, size_t bloom_level_count, VkFormat bloom_format, std::shared_ptr<shader> threshold_shader, std::shared_ptr<shader> downsample_shader,
+    std::shared_ptr<shader> horizontal_blur_shader, std::shared_ptr<shader> vertical_blur_shader, std::shared_ptr<shader> vertical_blur_add_shader, std::shared_ptr<shader> composite_shader) : max_dims{max_dims}, bloom_format{bloom_format}
+{
+    if(bloom_level_count == 0) throw std::logic_error("post_chain requires at least one bloom level");
+    get_shader_preamble(bloom_format); // Throws if the shaders have no image format qualifier for bloom_format
+    threshold = r.create_compute_pipeline(threshold_shader);
+    downsample = r.create_compute_pipeline(downsample_shader);
+    horizontal_blur = r.create_compute_pipeline(horizontal_blur_shader);
+    vertical_blur = r.create_compute_pipeline(vertical_blur_shader);
+    vertical_blur_add = r.create_compute_pipeline(vertical_blur_add_shader);
+    composite = r.create_compute_pipeline(composite_shader);
+
+    const VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT|VK_IMAGE_USAGE_SAMPLED_BIT;
+    for(size_t i=0; i<bloom_level_count; ++i)
+    {
+        level l;
+        l.max_dims = get_level_dims(i ? levels.back().max_dims : max_dims);
+        l.color = std::make_unique<render_target>(r.ctx, l.max_dims, bloom_format, usage, VK_IMAGE_ASPECT_COLOR_BIT);
+        l.scratch = std::make_unique<render_target>(r.ctx, l.max_dims, bloom_format, usage, VK_IMAGE_ASPECT_COLOR_BIT);
+        levels.push_back(std::move(l));
+    }
+    // The output is always RGBA16F, the only suitable format which every device supports for storage images
+    output = std::make_unique<render_target>(r.ctx, max_dims, VK_FORMAT_R16G16B16A16_SFLOAT, usage, VK_IMAGE_ASPECT_COLOR_BIT);
+}
+
+void post_chain::dispatch(VkCommandBuffer cmd, transient_resource_pool & pool, const sampler & linear_sampler, VkImageView scene_color, uint2 viewport_dims, const post_grading & grading) const
+{
+    if(viewport_dims.x == 0 || viewport_dims.y == 0 || viewport_dims.x > max_dims.x || viewport_dims.y > max_dims.y) throw std::logic_error("post_chain viewport out of range");
+    std::vector<uint2> dims(levels.size());
+    for(size_t i=0; i<levels.size(); ++i) dims[i] = get_level_dims(i ? dims[i-1] : viewport_dims);
+
+    // Every intermediate image is completely overwritten each frame
+    for(auto & l : levels)
+    {
+        transition_layout(cmd, l.color->get_image(), 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+        transition_layout(cmd, l.scratch->get_image(), 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+    }
+    transition_layout(cmd, output->get_image(), 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+    const auto grading_uniforms = pool.write_data(grading);
+
+    // Threshold the scene while downsampling it into the first level, then downsample each level into the next
+    scene_descriptor_set threshold_set {pool, threshold->get_descriptor_set_layout()};
+    threshold_set.write_uniform_buffer(0, 0, pool.write_data(get_region(dims[0], viewport_dims, max_dims)));
+    threshold_set.write_uniform_buffer(1, 0, grading_uniforms);
+    threshold_set.write_combined_image_sampler(2, 0, linear_sampler, scene_color);
+    threshold_set.write_storage_image(3, 0, levels[0].color->get_image_view());
+    dispatch_pipeline(cmd, *threshold, threshold_set, get_pixel_groups(dims[0]));
+    for(size_t i=1; i<levels.size(); ++i)
+    {
+        compute_barrier(cmd);
+        scene_descriptor_set set {pool, downsample->get_descriptor_set_layout()};
+        set.write_uniform_buffer(0, 0, pool.write_data(get_region(dims[i], dims[i-1], levels[i-1].max_dims)));
+        set.write_combined_image_sampler(1, 0, linear_sampler, levels[i-1].color->get_image_view(), VK_IMAGE_LAYOUT_GENERAL);
+        set.write_storage_image(2, 0, levels[i].color->get_image_view());
+        dispatch_pipeline(cmd, *downsample, set, get_pixel_groups(dims[i]));
+    }
+
+    // Starting from the smallest level, blur each level, adding the accumulated bloom from the level below it during the vertical pass
+    for(size_t i=levels.size(); i--; )
+    {
+        const auto & l = levels[i];
+        const bool add_lower = i+1 < levels.size();
+        const auto region = pool.write_data(add_lower ? get_region(dims[i], dims[i+1], levels[i+1].max_dims) : get_region(dims[i], dims[i], l.max_dims));
+        compute_barrier(cmd);
+        scene_descriptor_set horizontal_set {pool, horizontal_blur->get_descriptor_set_layout()};
+        horizontal_set.write_uniform_buffer(0, 0, region);
+        horizontal_set.write_combined_image_sampler(1, 0, linear_sampler, l.color->get_image_view(), VK_IMAGE_LAYOUT_GENERAL);
+        horizontal_set.write_storage_image(2, 0, l.scratch->get_image_view());
+        dispatch_pipeline(cmd, *horizontal_blur, horizontal_set, get_pixel_groups(dims[i]));
+
+        compute_barrier(cmd);
+        const auto & pipeline = add_lower ? *vertical_blur_add : *vertical_blur;
+        scene_descriptor_set vertical_set {pool, pipeline.get_descriptor_set_layout()};
+        vertical_set.write_uniform_buffer(0, 0, region);
+        vertical_set.write_combined_image_sampler(1, 0, linear_sampler, l.scratch->get_image_view(), VK_IMAGE_LAYOUT_GENERAL);
+        vertical_set.write_storage_image(2, 0, l.color->get_image_view());
+        if(add_lower) vertical_set.write_combined_image_sampler(3, 0, linear_sampler, levels[i+1].color->get_image_view(), VK_IMAGE_LAYOUT_GENERAL);
+        dispatch_pipeline(cmd, pipeline, vertical_set, get_pixel_groups(dims[i]));
+    }
+
+    // Composite bloom over the scene, then tonemap and grade the result, in a single pass
+    compute_barrier(cmd);
+    scene_descriptor_set composite_set {pool, composite->get_descriptor_set_layout()};
+    composite_set.write_uniform_buffer(0, 0, pool.write_data(get_region(viewport_dims, dims[0], levels[0].max_dims)));
+    composite_set.write_uniform_buffer(1, 0, grading_uniforms);
+    composite_set.write_combined_image_sampler(2, 0, linear_sampler, scene_color);
+    composite_set.write_combined_image_sampler(3, 0, linear_sampler, levels[0].color->get_image_view(), VK_IMAGE_LAYOUT_GENERAL);
+    composite_set.write_storage_image(4, 0, output->get_image_view());
+    dispatch_pipeline(cmd, *composite, composite_set, get_pixel_groups(viewport_dims));
+    transition_layout(cmd, output->get_image(), 0, 0, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
@@ -0,0 +1,58 @@
+#ifndef POST_CHAIN_H
+#define POST_CHAIN_H
+
+#include "renderer.h"
+
+// Exposure, bloom and color grading parameters, laid out to match the std140 PostGrading uniform block of the post shaders
+struct post_grading
+{
+    float exposure {1}, bloom_strength {1}, bloom_threshold {1}, saturation {1};
+    alignas(16) float3 lift {0,0,0};
+    alignas(16) float3 gamma {1,1,1};
+    alignas(16) float3 gain {1,1,1};
+};
+
+// Post processes a scene color buffer with compute shaders, fusing adjacent per-pixel steps into single dispatches so that each
+// intermediate image makes one round trip through memory. Thresholding is fused with the first bloom downsample, adding each
+// bloom level to the level above it is fused with that level's vertical blur, and the bloom composite, tonemapping and color
+// grading all happen in one final dispatch. Blurs apply a 9 tap kernel in 5 fetches, by reading each pair of outer taps with a 
+// single bilinear fetch. Bloom levels are B10G11R11 where the device supports it, which halves their bandwidth against RGBA16F.
+// Images are allocated for the maximum render resolution, and each frame processes only the active region at their origin.
+class post_chain
+{
+    struct level
+    {
+        uint2 max_dims;
+        std::unique_ptr<render_target> color, scratch;
+    };
+    std::shared_ptr<compute_pipeline> threshold, downsample, horizontal_blur, vertical_blur, vertical_blur_add, composite;
+    std::vector<level> levels;
+    uint2 max_dims;
+    VkFormat bloom_format;
+    std::unique_ptr<render_target> output;
+public:
+    // Groups of every shader must be 8x8 invocations
+    static constexpr uint32_t pixel_group_size = 8;
+
+    // Bloom levels are B10G11R11 if the device can use it for storage images with linear filtering, and RGBA16F otherwise. Every 
+    // shader which writes a bloom level must be compiled with get_shader_preamble(bloom_format), which defines BLOOM_FORMAT as the
+    // matching image format qualifier.
+    static VkFormat select_bloom_format(const renderer & r);
+    static const char * get_shader_preamble(VkFormat bloom_format);
+
+    // Shader bindings are described in the shaders which accompany example-rts, in assets/post_*.comp
+    post_chain(renderer & r, uint2 max_dims, size_t bloom_level_count, VkFormat bloom_format, std::shared_ptr<shader> threshold_shader, std::shared_ptr<shader> downsample_shader,
+        std::shared_ptr<shader> horizontal_blur_shader, std::shared_ptr<shader> vertical_blur_shader, std::shared_ptr<shader> vertical_blur_add_shader, std::shared_ptr<shader> composite_shader);
+
+    // Image view containing the graded, tonemapped result, in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL after dispatch(...). Only the
+    // region of size viewport_dims at its origin is written, which covers viewport_dims / get_max_dims() of its texture coordinates.
+    VkImageView get_output_view() const { return output->get_image_view(); }
+    uint2 get_max_dims() const { return max_dims; }
+    VkFormat get_bloom_format() const { return bloom_format; }
+
+    // Records all dispatches into cmd, outside of any render pass. The scene color image must be max_dims in size, with its active 
+    // region of viewport_dims at its origin. The sampler should use linear filtering and clamp to edge addressing.
+    void dispatch(VkCommandBuffer cmd, transient_resource_pool & pool, const sampler & linear_sampler, VkImageView scene_color, uint2 viewport_dims, const post_grading & grading) const;
+};
+
+#endif
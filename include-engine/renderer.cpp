@@ -1,4 +1,5 @@
 #include "renderer.h"
+#include "capture.h"
 #include "utility.h"
 #include <stdexcept>
 
@@ -15,6 +16,7 @@ struct physical_device_selection
 struct context
 {
     std::function<void(const char *)> debug_callback;
+    bool headless {};
     VkInstance instance {};
     PFN_vkDestroyDebugReportCallbackEXT vkDestroyDebugReportCallbackEXT {};
     VkDebugReportCallbackEXT callback {};
@@ -28,7 +30,7 @@ struct context
     void * mapped_staging_memory {};
     VkCommandPool staging_pool {};
 
-    context(std::function<void(const char *)> debug_callback);
+    context(std::function<void(const char *)> debug_callback, bool headless);
     ~context();
 
     uint32_t select_memory_type(const VkMemoryRequirements & reqs, VkMemoryPropertyFlags props) const;
@@ -158,16 +160,42 @@ physical_device_selection select_physical_device(VkInstance instance, const std:
     throw std::runtime_error("no suitable Vulkan device present");
 }
 
+physical_device_selection select_headless_physical_device(VkInstance instance)
+{
+    uint32_t device_count = 0;
+    check(vkEnumeratePhysicalDevices(instance, &device_count, nullptr));
+    std::vector<VkPhysicalDevice> physical_devices(device_count);
+    check(vkEnumeratePhysicalDevices(instance, &device_count, physical_devices.data()));
+    for(auto & d : physical_devices)
+    {
+        // Without a surface to present to, any queue family that supports graphics will do
+        uint32_t queue_family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(d, &queue_family_count, nullptr);
+        std::vector<VkQueueFamilyProperties> queue_family_props(queue_family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(d, &queue_family_count, queue_family_props.data());
+        for(uint32_t i=0; i<queue_family_props.size(); ++i)
+        {
+            if(queue_family_props[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) return {d, i, {VK_FORMAT_R8G8B8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR}, VK_PRESENT_MODE_FIFO_KHR, 0, VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR};
+        }
+    }
+    throw std::runtime_error("no suitable Vulkan device present");
+}
+
 /////////////
 // context //
 /////////////
 
-context::context(std::function<void(const char *)> debug_callback) : debug_callback{debug_callback}
+context::context(std::function<void(const char *)> debug_callback, bool headless) : debug_callback{debug_callback}, headless{headless}
 {
-    if(glfwInit() == GLFW_FALSE) throw std::runtime_error("glfwInit() failed");
-    uint32_t extension_count = 0;
-    auto ext = glfwGetRequiredInstanceExtensions(&extension_count);
-    std::vector<const char *> extensions{ext, ext+extension_count};
+    // Headless contexts do not depend on GLFW, and cannot be used to create windows
+    std::vector<const char *> extensions;
+    if(!headless)
+    {
+        if(glfwInit() == GLFW_FALSE) throw std::runtime_error("glfwInit() failed");
+        uint32_t extension_count = 0;
+        auto ext = glfwGetRequiredInstanceExtensions(&extension_count);
+        extensions.assign(ext, ext+extension_count);
+    }
 
     const VkApplicationInfo app_info {VK_STRUCTURE_TYPE_APPLICATION_INFO, nullptr, "simple-scene", VK_MAKE_VERSION(1,0,0), "No Engine", VK_MAKE_VERSION(0,0,0), VK_API_VERSION_1_0};
     const char * layers[] {"VK_LAYER_LUNARG_standard_validation"};
@@ -186,8 +214,9 @@ context::context(std::function<void(const char *)> debug_callback) : debug_callb
         }, this};
     check(vkCreateDebugReportCallbackEXT(instance, &callback_info, nullptr, &callback));
 
-    std::vector<const char *> device_extensions {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
-    selection = select_physical_device(instance, device_extensions);
+    std::vector<const char *> device_extensions;
+    if(!headless) device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    selection = headless ? select_headless_physical_device(instance) : select_physical_device(instance, device_extensions);
     const float queue_priorities[] {1.0f};
     const VkDeviceQueueCreateInfo queue_infos[] {{VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO, nullptr, {}, selection.queue_family, narrow(countof(queue_priorities)), queue_priorities}};
     const VkDeviceCreateInfo device_info {VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO, nullptr, {}, narrow(countof(queue_infos)), queue_infos, narrow(countof(layers)), layers, narrow(countof(device_extensions)), device_extensions.data()};
@@ -309,6 +338,7 @@ void context::end_transient(VkCommandBuffer command_buffer)
 
 window::window(std::shared_ptr<context> ctx, uint2 dims, const char * title) : ctx{ctx}, dims{dims}
 {
+    if(ctx->headless) throw std::logic_error("cannot create a window from a headless context");
     glfwDefaultWindowHints();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
@@ -454,15 +484,48 @@ render_target::~render_target()
 // texture_2d //
 ////////////////
 
-void transition_layout(VkCommandBuffer command_buffer, VkImage image, uint32_t mip_level, uint32_t array_layer, VkImageLayout old_layout, VkImageLayout new_layout);
+void transition_layout(VkCommandBuffer command_buffer, VkImage image, uint32_t mip_level, uint32_t array_layer, VkImageLayout old_layout, VkImageLayout new_layout, VkImageAspectFlags aspect=VK_IMAGE_ASPECT_COLOR_BIT);
 
-texture::texture(std::shared_ptr<context> ctx, VkFormat format, VkExtent3D extent, array_view<const void *> layer_data, VkImageViewType view_type) : ctx{ctx}
+// Generate mip levels of one layer of an image using blits, starting from mip level zero in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, and
+// leaving every level in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+static void generate_mip_levels(VkCommandBuffer cmd, VkImage image, uint32_t layer, VkExtent3D extent, uint32_t mip_levels)
+{
+    VkImageSubresourceLayers layers {};
+    layers.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    layers.baseArrayLayer = layer;
+    layers.layerCount = 1;
+
+    VkOffset3D dims {narrow(extent.width), narrow(extent.height), narrow(extent.depth)};
+    for(uint32_t i=1; i<mip_levels; ++i)
+    {
+        VkImageBlit blit {};
+        blit.srcSubresource = layers;
+        blit.srcSubresource.mipLevel = i-1;
+        blit.srcOffsets[1] = dims;
+
+        dims.x = std::max(dims.x/2,1);
+        dims.y = std::max(dims.y/2,1);
+        dims.z = std::max(dims.z/2,1);
+        blit.dstSubresource = layers;
+        blit.dstSubresource.mipLevel = i;
+        blit.dstOffsets[1] = dims;
+
+        transition_layout(cmd, image, i-1, layer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+        transition_layout(cmd, image, i, layer, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        vkCmdBlitImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+        transition_layout(cmd, image, i-1, layer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+    transition_layout(cmd, image, mip_levels-1, layer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+texture::texture(std::shared_ptr<context> ctx, VkFormat format, VkExtent3D extent, array_view<const void *> layer_data, VkImageViewType view_type) : 
+    ctx{ctx}, format{format}, extent{extent}, mip_levels{1+static_cast<uint32_t>(std::ceil(std::log2(std::max({extent.width, extent.height, extent.depth}))))}
 {
     VkImageCreateInfo image_info {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
     image_info.imageType = extent.depth > 1 ? VK_IMAGE_TYPE_3D : extent.height > 1 ? VK_IMAGE_TYPE_2D : VK_IMAGE_TYPE_1D;
     image_info.format = format;
     image_info.extent = extent;
-    image_info.mipLevels = 1+static_cast<uint32_t>(std::ceil(std::log2(std::max({extent.width, extent.height, extent.depth}))));
+    image_info.mipLevels = mip_levels;
     image_info.arrayLayers = layer_data.size;
     image_info.samples = VK_SAMPLE_COUNT_1_BIT;
     image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
@@ -493,29 +556,7 @@ texture::texture(std::shared_ptr<context> ctx, VkFormat format, VkExtent3D exten
         copy_region.imageSubresource = layers;
         copy_region.imageExtent = extent;
         vkCmdCopyBufferToImage(cmd, ctx->staging_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
-
-        // Generate mip levels using blits
-        VkOffset3D dims {narrow(extent.width), narrow(extent.height), narrow(extent.depth)};
-        for(uint32_t i=1; i<image_info.mipLevels; ++i)
-        {
-            VkImageBlit blit {};
-            blit.srcSubresource = layers;
-            blit.srcSubresource.mipLevel = i-1;
-            blit.srcOffsets[1] = dims;
-
-            dims.x = std::max(dims.x/2,1);
-            dims.y = std::max(dims.y/2,1);
-            dims.z = std::max(dims.z/2,1);
-            blit.dstSubresource = layers;
-            blit.dstSubresource.mipLevel = i;
-            blit.dstOffsets[1] = dims;
-
-            transition_layout(cmd, image, i-1, layer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-            transition_layout(cmd, image, i, layer, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-            vkCmdBlitImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
-            transition_layout(cmd, image, i-1, layer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-        }
-        transition_layout(cmd, image, image_info.mipLevels-1, layer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        generate_mip_levels(cmd, image, narrow(layer), extent, mip_levels);
         ctx->end_transient(cmd);
     }
 
@@ -538,14 +579,33 @@ texture::~texture()
     vkFreeMemory(ctx->device, device_memory, nullptr);
 }
 
+void texture::update_region(uint32_t layer, int2 offset, const ::image & contents)
+{
+    if(contents.get_format() != format || offset.x < 0 || offset.y < 0 || offset.x + contents.get_width() > static_cast<int>(extent.width) || offset.y + contents.get_height() > static_cast<int>(extent.height))
+    {
+        throw std::logic_error("texture::update_region(...) must write within the texture, in its format");
+    }
+    if(contents.get_width() == 0 || contents.get_height() == 0) return;
+    memcpy(ctx->mapped_staging_memory, contents.get_pixels(), compute_image_size({contents.get_width(), contents.get_height()}, format));
+
+    // Mip level zero keeps its contents outside of the region, while the remaining levels are regenerated entirely
+    auto cmd = ctx->begin_transient();
+    transition_layout(cmd, image, 0, layer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    VkBufferImageCopy copy_region {};
+    copy_region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, layer, 1};
+    copy_region.imageOffset = {offset.x, offset.y, 0};
+    copy_region.imageExtent = {narrow(contents.get_width()), narrow(contents.get_height()), 1};
+    vkCmdCopyBufferToImage(cmd, ctx->staging_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+    generate_mip_levels(cmd, image, layer, extent, mip_levels);
+    ctx->end_transient(cmd);
+}
+
 ///////////////////
 // static_buffer //
 ///////////////////
 
 static_buffer::static_buffer(std::shared_ptr<context> ctx, VkBufferUsageFlags usage, VkMemoryPropertyFlags memory_properties, VkDeviceSize size, const void * initial_data) : ctx{ctx}
 {
-    memcpy(ctx->mapped_staging_memory, initial_data, size);
-
     VkBufferCreateInfo buffer_info {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
     buffer_info.size = size;
     buffer_info.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
@@ -556,7 +616,9 @@ static_buffer::static_buffer(std::shared_ptr<context> ctx, VkBufferUsageFlags us
     vkGetBufferMemoryRequirements(ctx->device, buffer, &mem_reqs);
     device_memory = ctx->allocate(mem_reqs, memory_properties);
     vkBindBufferMemory(ctx->device, buffer, device_memory, 0);
+    if(!initial_data) return;
 
+    memcpy(ctx->mapped_staging_memory, initial_data, size);
     auto cmd = ctx->begin_transient();
     const VkBufferCopy copy {0, 0, size};
     vkCmdCopyBuffer(cmd, ctx->staging_buffer, buffer, 1, &copy);
@@ -573,7 +635,7 @@ static_buffer::~static_buffer()
 // dynamic_buffer //
 ////////////////////
 
-dynamic_buffer::dynamic_buffer(std::shared_ptr<context> ctx, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memory_properties) : ctx{ctx}
+dynamic_buffer::dynamic_buffer(std::shared_ptr<context> ctx, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memory_properties) : ctx{ctx}, size{size}, limit{size}
 {
     VkBufferCreateInfo buffer_info {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
     buffer_info.size = size;
@@ -587,8 +649,15 @@ dynamic_buffer::dynamic_buffer(std::shared_ptr<context> ctx, VkDeviceSize size,
     check(vkMapMemory(ctx->device, device_memory, 0, size, 0, reinterpret_cast<void**>(&mapped_memory)));
 }
 
+dynamic_buffer::dynamic_buffer(dynamic_buffer & parent) : 
+    ctx{parent.ctx}, parent{&parent}, buffer{parent.buffer}, mem_reqs(parent.mem_reqs), mapped_memory{parent.mapped_memory}, size{parent.size}
+{
+
+}
+
 dynamic_buffer::~dynamic_buffer()
 {
+    if(parent) return;
     vkDestroyBuffer(ctx->device, buffer, nullptr);
     vkUnmapMemory(ctx->device, device_memory);        
     vkFreeMemory(ctx->device, device_memory, nullptr);
@@ -597,6 +666,7 @@ dynamic_buffer::~dynamic_buffer()
 void dynamic_buffer::reset() 
 { 
     offset = range = 0; 
+    limit = parent ? 0 : size;
 }
 
 void dynamic_buffer::begin() 
@@ -607,8 +677,15 @@ void dynamic_buffer::begin()
 
 void dynamic_buffer::write(size_t size, const void * data)
 {
-    memcpy(mapped_memory + offset + range, data, size); 
+    memcpy(reserve(size), data, size); 
+}
+
+void * dynamic_buffer::reserve(size_t size)
+{
+    if(offset + range + size > limit) grow(size);
+    void * data = mapped_memory + offset + range;
     range += size;
+    return data;
 }
 
 VkDescriptorBufferInfo dynamic_buffer::end()
@@ -623,15 +700,73 @@ VkDescriptorBufferInfo dynamic_buffer::upload(size_t size, const void * data)
     return end();
 }
 
+void dynamic_buffer::update(VkDescriptorBufferInfo range, size_t size, const void * data)
+{
+    if(range.buffer != buffer || size > range.range) throw std::logic_error("dynamic_buffer::update(...) must write within a previously written range");
+    memcpy(mapped_memory + range.offset, data, size);
+}
+
+void dynamic_buffer::assign(size_t size, const void * data)
+{
+    if(size > this->size) throw std::runtime_error("dynamic_buffer overflow");
+    memcpy(mapped_memory, data, size);
+    offset = 0;
+    range = size;
+}
+
+VkDescriptorBufferInfo dynamic_buffer::carve(VkDeviceSize size)
+{
+    std::lock_guard<std::mutex> lock {mutex};
+    begin();
+    if(offset + size > limit) throw std::runtime_error("dynamic_buffer overflow");
+    range = size;
+    return end();
+}
+
+void dynamic_buffer::grow(size_t size)
+{
+    if(!parent) throw std::runtime_error("dynamic_buffer overflow");
+
+    // Move the range currently being written into a fresh chunk of the parent buffer
+    const VkDeviceSize min_chunk_size = 64*1024;
+    const auto chunk = parent->carve(std::max<VkDeviceSize>(range + size, min_chunk_size));
+    memmove(mapped_memory + chunk.offset, mapped_memory + offset, range);
+    offset = chunk.offset;
+    limit = chunk.offset + chunk.range;
+}
+
 /////////////////////////////
 // transient_resource_pool //
 /////////////////////////////
 
 transient_resource_pool::transient_resource_pool(std::shared_ptr<context> ctx, array_view<VkDescriptorPoolSize> descriptor_pool_sizes, uint32_t max_descriptor_sets) : 
     ctx{ctx}, 
-    uniform_buffer{ctx, 1024*1024, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT}, 
+    descriptor_pool_sizes{descriptor_pool_sizes.begin(), descriptor_pool_sizes.end()},
+    max_descriptor_sets{max_descriptor_sets},
+    uniform_buffer{ctx, 4*1024*1024, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT}, 
     vertex_buffer{ctx, 1024*1024, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT},
     index_buffer{ctx, 1024*1024, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT}
+{
+    create_pools();
+
+    VkFenceCreateInfo fence_info {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    check(vkCreateFence(ctx->device, &fence_info, nullptr, &fence));
+}
+
+transient_resource_pool::transient_resource_pool(transient_resource_pool & parent) :
+    ctx{parent.ctx},
+    parent{&parent},
+    descriptor_pool_sizes{parent.descriptor_pool_sizes},
+    max_descriptor_sets{parent.max_descriptor_sets},
+    uniform_buffer{parent.uniform_buffer},
+    vertex_buffer{parent.vertex_buffer},
+    index_buffer{parent.index_buffer}
+{
+    create_pools();
+}
+
+void transient_resource_pool::create_pools()
 {
     VkCommandPoolCreateInfo command_pool_info {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
     command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -640,28 +775,38 @@ transient_resource_pool::transient_resource_pool(std::shared_ptr<context> ctx, a
     check(vkCreateCommandPool(ctx->device, &command_pool_info, nullptr, &command_pool));
 
     VkDescriptorPoolCreateInfo descriptor_pool_info {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
-    descriptor_pool_info.poolSizeCount = narrow(descriptor_pool_sizes.size);
-    descriptor_pool_info.pPoolSizes = descriptor_pool_sizes.data;
+    descriptor_pool_info.poolSizeCount = narrow(descriptor_pool_sizes.size());
+    descriptor_pool_info.pPoolSizes = descriptor_pool_sizes.data();
     descriptor_pool_info.maxSets = max_descriptor_sets;
     descriptor_pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
     check(vkCreateDescriptorPool(ctx->device, &descriptor_pool_info, nullptr, &descriptor_pool));
-
-    VkFenceCreateInfo fence_info {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
-    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-    check(vkCreateFence(ctx->device, &fence_info, nullptr, &fence));
 }
 
 transient_resource_pool::~transient_resource_pool()
 {
-    vkDestroyFence(ctx->device, fence, nullptr);
+    sub_pools.clear();
+    if(fence) vkDestroyFence(ctx->device, fence, nullptr);
     vkDestroyDescriptorPool(ctx->device, descriptor_pool, nullptr);
     vkDestroyCommandPool(ctx->device, command_pool, nullptr);
 }
 
+transient_resource_pool & transient_resource_pool::get_sub_pool(size_t index)
+{
+    std::lock_guard<std::mutex> lock {sub_pool_mutex};
+    while(sub_pools.size() <= index) sub_pools.push_back(std::make_unique<transient_resource_pool>(*this));
+    return *sub_pools[index];
+}
+
 void transient_resource_pool::reset()
 {
+    if(parent) throw std::logic_error("sub-pools are reset along with their parent");
     check(vkWaitForFences(ctx->device, 1, &fence, VK_TRUE, UINT64_MAX));
     check(vkResetFences(ctx->device, 1, &fence));
+    recycle();
+}
+
+void transient_resource_pool::recycle()
+{
     if(!command_buffers.empty())
     {
         vkFreeCommandBuffers(ctx->device, command_pool, narrow(command_buffers.size()), command_buffers.data());
@@ -677,13 +822,14 @@ void transient_resource_pool::reset()
     uniform_buffer.reset();
     vertex_buffer.reset();
     index_buffer.reset();
+    for(auto & sub_pool : sub_pools) sub_pool->recycle();
 }
 
-VkCommandBuffer transient_resource_pool::allocate_command_buffer()
+VkCommandBuffer transient_resource_pool::allocate_command_buffer(VkCommandBufferLevel level)
 {
     VkCommandBufferAllocateInfo alloc_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
     alloc_info.commandPool = command_pool;
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.level = level;
     alloc_info.commandBufferCount = 1;
 
     VkCommandBuffer command_buffer;
@@ -709,17 +855,18 @@ VkDescriptorSet transient_resource_pool::allocate_descriptor_set(VkDescriptorSet
 // transition_layout(...) //
 ////////////////////////////
 
-void transition_layout(VkCommandBuffer command_buffer, VkImage image, uint32_t mip_level, uint32_t array_layer, VkImageLayout old_layout, VkImageLayout new_layout)
+void transition_layout(VkCommandBuffer command_buffer, VkImage image, uint32_t mip_level, uint32_t array_layer, VkImageLayout old_layout, VkImageLayout new_layout, VkImageAspectFlags aspect)
 {
-    VkPipelineStageFlags src_stage_mask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    VkPipelineStageFlags dst_stage_mask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    // Access masks are only honored for the stages named in the barrier, so wait on and block all commands
+    VkPipelineStageFlags src_stage_mask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkPipelineStageFlags dst_stage_mask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
     VkImageMemoryBarrier barrier {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
     barrier.oldLayout = old_layout;
     barrier.newLayout = new_layout;
     barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barrier.image = image;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.aspectMask = aspect;
     barrier.subresourceRange.baseMipLevel = mip_level;
     barrier.subresourceRange.levelCount = 1;
     barrier.subresourceRange.baseArrayLayer = array_layer;
@@ -727,19 +874,25 @@ void transition_layout(VkCommandBuffer command_buffer, VkImage image, uint32_t m
     switch(old_layout)
     {
     case VK_IMAGE_LAYOUT_UNDEFINED: break; // No need to wait for anything, contents can be discarded
+    case VK_IMAGE_LAYOUT_GENERAL: barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT; break; // Wait for storage image writes to complete before changing layout
     case VK_IMAGE_LAYOUT_PREINITIALIZED: barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT; break; // Wait for host writes to complete before changing layout    
     case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT; break; // Wait for transfer reads to complete before changing layout
     case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT; break; // Wait for transfer writes to complete before changing layout
     case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT; break; // Wait for color attachment writes to complete before changing layout
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: barrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT; break; // Wait for depth attachment writes to complete before changing layout
     case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT; break; // Wait for shader reads to complete before changing layout
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL: barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT; break; // Wait for shader reads to complete before changing layout
     default: throw std::logic_error("unsupported layout transition");
     }
     switch(new_layout)
     {
+    case VK_IMAGE_LAYOUT_GENERAL: barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT|VK_ACCESS_SHADER_WRITE_BIT; break; // Storage image reads and writes should wait for layout change to complete
     case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT; break; // Transfer reads should wait for layout change to complete
     case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT; break; // Transfer writes should wait for layout change to complete
     case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT; break; // Writes to color attachments should wait for layout change to complete
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT|VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT; break; // Depth tests and writes should wait for layout change to complete
     case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT; break; // Shader reads should wait for layout change to complete
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL: barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT; break; // Shader reads should wait for layout change to complete
     case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT; break; // Memory reads should wait for layout change to complete
     default: throw std::logic_error("unsupported layout transition");
     }
@@ -747,10 +900,10 @@ void transition_layout(VkCommandBuffer command_buffer, VkImage image, uint32_t m
 }
 
 
-VkPipeline make_pipeline(VkDevice device, const render_pass & render_pass, VkPipelineLayout layout, VkPipelineVertexInputStateCreateInfo vertex_input_state, array_view<VkPipelineShaderStageCreateInfo> stages, bool depth_write, bool depth_test, VkBlendFactor src_factor, VkBlendFactor dst_factor)
+VkPipeline make_pipeline(VkDevice device, const render_pass & render_pass, VkPipelineLayout layout, VkPipelineVertexInputStateCreateInfo vertex_input_state, array_view<VkPipelineShaderStageCreateInfo> stages, bool depth_write, bool depth_test, VkBlendFactor src_factor, VkBlendFactor dst_factor, VkPrimitiveTopology topology)
 {
     VkPipelineInputAssemblyStateCreateInfo inputAssembly {VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO};
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssembly.topology = topology;
     inputAssembly.primitiveRestartEnable = VK_FALSE;
 
     const VkViewport viewport {};
@@ -845,14 +998,14 @@ void vkUpdateDescriptorSets(VkDevice device, array_view<VkWriteDescriptorSet> de
     vkUpdateDescriptorSets(device, narrow(descriptorWrites.size), descriptorWrites.data, narrow(descriptorCopies.size), descriptorCopies.data);
 }
 
-void vkWriteDescriptorBufferInfo(VkDevice device, VkDescriptorSet set, uint32_t binding, uint32_t array_element, VkDescriptorBufferInfo info)
+void vkWriteDescriptorBufferInfo(VkDevice device, VkDescriptorSet set, uint32_t binding, uint32_t array_element, VkDescriptorBufferInfo info, VkDescriptorType type)
 {
-    vkUpdateDescriptorSets(device, {{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr, set, binding, array_element, 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, nullptr, &info, nullptr}}, {});
+    vkUpdateDescriptorSets(device, {{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr, set, binding, array_element, 1, type, nullptr, &info, nullptr}}, {});
 }
 
-void vkWriteDescriptorCombinedImageSamplerInfo(VkDevice device, VkDescriptorSet set, uint32_t binding, uint32_t array_element, VkDescriptorImageInfo info)
+void vkWriteDescriptorCombinedImageSamplerInfo(VkDevice device, VkDescriptorSet set, uint32_t binding, uint32_t array_element, VkDescriptorImageInfo info, VkDescriptorType type)
 {
-    vkUpdateDescriptorSets(device, {{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr, set, binding, array_element, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &info, nullptr, nullptr}}, {});
+    vkUpdateDescriptorSets(device, {{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr, set, binding, array_element, 1, type, &info, nullptr, nullptr}}, {});
 }
 
 void vkCmdBindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint, VkPipelineLayout layout, uint32_t firstSet, array_view<VkDescriptorSet> descriptorSets, array_view<uint32_t> dynamicOffsets)
@@ -878,7 +1031,7 @@ void vkCmdSetScissor(VkCommandBuffer commandBuffer, VkRect2D scissor)
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 }
 
-void vkCmdBeginRenderPass(VkCommandBuffer cmd, VkRenderPass renderPass, VkFramebuffer framebuffer, VkRect2D renderArea, array_view<VkClearValue> clearValues)
+void vkCmdBeginRenderPass(VkCommandBuffer cmd, VkRenderPass renderPass, VkFramebuffer framebuffer, VkRect2D renderArea, array_view<VkClearValue> clearValues, VkSubpassContents contents)
 {
     VkRenderPassBeginInfo pass_begin_info {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
     pass_begin_info.renderPass = renderPass;
@@ -886,7 +1039,8 @@ void vkCmdBeginRenderPass(VkCommandBuffer cmd, VkRenderPass renderPass, VkFrameb
     pass_begin_info.renderArea = renderArea;
     pass_begin_info.clearValueCount = narrow(clearValues.size);
     pass_begin_info.pClearValues = clearValues.data;
-    vkCmdBeginRenderPass(cmd, &pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(cmd, &pass_begin_info, contents);
+    if(contents != VK_SUBPASS_CONTENTS_INLINE) return; // Secondary command buffers must set their own dynamic state
     vkCmdSetViewport(cmd, renderArea);
     vkCmdSetScissor(cmd, renderArea);
 }
@@ -933,6 +1087,57 @@ sampler::~sampler()
     vkDestroySampler(ctx->device, handle, nullptr);
 }
 
+///////////////
+// gpu_timer //
+///////////////
+
+gpu_timer::gpu_timer(std::shared_ptr<context> ctx, uint32_t frame_count) : ctx{ctx}, written(frame_count)
+{
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(ctx->selection.physical_device, &props);
+    seconds_per_tick = props.limits.timestampPeriod * 1e-9;
+
+    uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx->selection.physical_device, &queue_family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(ctx->selection.physical_device, &queue_family_count, queue_families.data());
+    const uint32_t valid_bits = queue_families[ctx->selection.queue_family].timestampValidBits;
+    valid_mask = valid_bits >= 64 ? ~uint64_t{0} : (uint64_t{1} << valid_bits) - 1;
+
+    VkQueryPoolCreateInfo create_info {VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    create_info.queryCount = frame_count * 2;
+    check(vkCreateQueryPool(ctx->device, &create_info, nullptr, &query_pool));
+}
+
+gpu_timer::~gpu_timer()
+{
+    vkDestroyQueryPool(ctx->device, query_pool, nullptr);
+}
+
+std::optional<double> gpu_timer::get_elapsed_seconds(uint32_t frame) const
+{
+    if(!valid_mask || !written[frame]) return std::nullopt;
+    uint64_t timestamps[2];
+    const VkResult result = vkGetQueryPoolResults(ctx->device, query_pool, frame*2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if(result == VK_NOT_READY) return std::nullopt;
+    check(result);
+    return ((timestamps[1] - timestamps[0]) & valid_mask) * seconds_per_tick;
+}
+
+void gpu_timer::begin(VkCommandBuffer cmd, uint32_t frame)
+{
+    // Queries must be reset outside of a render pass before they can be written again
+    vkCmdResetQueryPool(cmd, query_pool, frame*2, 2);
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, frame*2);
+    written[frame] = true;
+}
+
+void gpu_timer::end(VkCommandBuffer cmd, uint32_t frame)
+{
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, frame*2+1);
+}
+
 /////////////////
 // render_pass //
 /////////////////
@@ -1022,11 +1227,12 @@ VkDescriptorSetLayoutBinding get_descriptor_set_layout_binding(uint32_t binding,
         b.descriptorCount *= a->length;
         return b;
     }
-    if(auto * s = std::get_if<shader_info::sampler>(&type.contents)) return {binding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, stage_flags};
+    if(auto * s = std::get_if<shader_info::sampler>(&type.contents)) return {binding, s->storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, stage_flags};
+    if(auto * s = std::get_if<shader_info::structure>(&type.contents); s && s->storage_block) return {binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stage_flags};
     return {binding, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, stage_flags};
 }
 
-scene_material::scene_material(std::shared_ptr<context> ctx, std::shared_ptr<scene_contract> contract, std::shared_ptr<vertex_format> format, array_view<std::shared_ptr<shader>> stages, bool depth_write, bool depth_test, VkBlendFactor src_factor, VkBlendFactor dst_factor) : 
+scene_material::scene_material(std::shared_ptr<context> ctx, std::shared_ptr<scene_contract> contract, std::shared_ptr<vertex_format> format, array_view<std::shared_ptr<shader>> stages, bool depth_write, bool depth_test, VkBlendFactor src_factor, VkBlendFactor dst_factor, VkPrimitiveTopology topology) : 
     ctx{ctx}, contract{contract}
 {
     // Determine the full set of per object descriptors across all stages
@@ -1062,7 +1268,7 @@ scene_material::scene_material(std::shared_ptr<context> ctx, std::shared_ptr<sce
     pipeline_layout = ctx->create_pipeline_layout(set_layouts);
     for(auto & p : contract->render_passes)
     {
-        pipelines.push_back(make_pipeline(ctx->device, *p, pipeline_layout, format->get_vertex_input_state(), p->has_color_attachments() ? shader_stages : shader_stages_no_frag, depth_write, depth_test, src_factor, dst_factor));
+        pipelines.push_back(make_pipeline(ctx->device, *p, pipeline_layout, format->get_vertex_input_state(), p->has_color_attachments() ? shader_stages : shader_stages_no_frag, depth_write, depth_test, src_factor, dst_factor, topology));
     }
 }
     
@@ -1073,21 +1279,74 @@ scene_material::~scene_material()
     vkDestroyDescriptorSetLayout(ctx->device, per_object_layout, nullptr);
 }
 
+//////////////////////
+// compute_pipeline //
+//////////////////////
+
+compute_pipeline::compute_pipeline(std::shared_ptr<context> ctx, const shader & compute_shader) : ctx{ctx}
+{
+    const auto stage = compute_shader.get_shader_stage();
+    if(stage.stage != VK_SHADER_STAGE_COMPUTE_BIT) throw std::logic_error("compute_pipeline requires a compute shader");
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    for(auto & descriptor : compute_shader.get_descriptors())
+    {
+        if(descriptor.set != 0) throw std::runtime_error("compute shader descriptors must be in set 0");
+        bindings.push_back(get_descriptor_set_layout_binding(descriptor.binding, descriptor.type, stage.stage));
+    }
+    descriptor_set_layout = ctx->create_descriptor_set_layout(bindings);
+    pipeline_layout = ctx->create_pipeline_layout({descriptor_set_layout});
+
+    VkComputePipelineCreateInfo pipeline_info {VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+    pipeline_info.stage = stage;
+    pipeline_info.layout = pipeline_layout;
+    check(vkCreateComputePipelines(ctx->device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline));
+}
+
+compute_pipeline::~compute_pipeline()
+{
+    vkDestroyPipeline(ctx->device, pipeline, nullptr);
+    vkDestroyPipelineLayout(ctx->device, pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(ctx->device, descriptor_set_layout, nullptr);
+}
+
 //////////////////////////
 // scene_descriptor_set //
 //////////////////////////
 
-scene_descriptor_set::scene_descriptor_set(transient_resource_pool & pool, VkDescriptorSetLayout layout) : material{}, layout{layout}, set{pool.allocate_descriptor_set(layout)}, device{pool.get_context().device} {}
-scene_descriptor_set::scene_descriptor_set(transient_resource_pool & pool, const scene_material & material) : scene_descriptor_set(pool, material.get_per_object_descriptor_set_layout()) { this->material = &material; }
+scene_descriptor_set::scene_descriptor_set(transient_resource_pool & pool, VkDescriptorSetLayout layout) : material{}, layout{layout}, set{pool.allocate_descriptor_set(layout)}, device{pool.get_context().device}, recorder{pool.get_recorder()}
+{
+    if(recorder) recorder->on_allocate(set, layout, material);
+}
+
+scene_descriptor_set::scene_descriptor_set(transient_resource_pool & pool, const scene_material & material) : scene_descriptor_set(pool, material.get_per_object_descriptor_set_layout()) 
+{ 
+    this->material = &material; 
+    if(recorder) recorder->on_allocate(set, layout, &material);
+}
 
 void scene_descriptor_set::write_uniform_buffer(uint32_t binding, uint32_t array_element, VkDescriptorBufferInfo info)
 {
-    vkWriteDescriptorBufferInfo(device, set, binding, array_element, info);
+    vkWriteDescriptorBufferInfo(device, set, binding, array_element, info, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    if(recorder) recorder->on_write_buffer(set, binding, array_element, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, info);
+}
+
+void scene_descriptor_set::write_storage_buffer(uint32_t binding, uint32_t array_element, VkDescriptorBufferInfo info)
+{
+    vkWriteDescriptorBufferInfo(device, set, binding, array_element, info, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    if(recorder) recorder->on_write_buffer(set, binding, array_element, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, info);
 }
 
 void scene_descriptor_set::write_combined_image_sampler(uint32_t binding, uint32_t array_element, const sampler & sampler, VkImageView image_view, VkImageLayout image_layout)
 {
-    vkWriteDescriptorCombinedImageSamplerInfo(device, set, binding, array_element, {sampler.get_vk_handle(), image_view, image_layout});
+    const VkDescriptorImageInfo info {sampler.get_vk_handle(), image_view, image_layout};
+    vkWriteDescriptorCombinedImageSamplerInfo(device, set, binding, array_element, info);
+    if(recorder) recorder->on_write_combined_image_sampler(set, binding, array_element, info);
+}
+
+void scene_descriptor_set::write_storage_image(uint32_t binding, uint32_t array_element, VkImageView image_view, VkImageLayout image_layout)
+{
+    // Storage images are only used by compute work, which frame captures do not include
+    vkWriteDescriptorCombinedImageSamplerInfo(device, set, binding, array_element, {VK_NULL_HANDLE, image_view, image_layout}, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
 }
 
 ///////////////
@@ -1099,6 +1358,7 @@ void draw_list::draw(const scene_descriptor_set & descriptors, std::initializer_
     if(&descriptors.get_material().get_contract() != &contract) fail_fast();
 
     draw_item item {&descriptors.get_material(), descriptors.get_descriptor_set()};
+    item.scissor = scissor;
     item.vertex_buffer_count = vertex_buffers.size();
     for(size_t i=0; i<vertex_buffers.size() && i<4; ++i)
     {
@@ -1118,6 +1378,7 @@ void draw_list::draw(const scene_descriptor_set & descriptors, const gfx_mesh &
     if(&descriptors.get_material().get_contract() != &contract) fail_fast();
 
     draw_item item {&descriptors.get_material(), descriptors.get_descriptor_set()};
+    item.scissor = scissor;
     item.vertex_buffer_count = instance_stride ? 2 : 1;
     item.vertex_buffers[0] = *mesh.vertex_buffer;
     item.vertex_buffers[1] = instances.buffer;
@@ -1151,43 +1412,185 @@ void draw_list::draw(const scene_descriptor_set & descriptors, const gfx_mesh &
     draw(descriptors, mesh, {}, 0);
 }
 
-void draw_list::write_commands(VkCommandBuffer cmd, const render_pass & render_pass, array_view<scene_descriptor_set> shared_descriptors) const
+void draw_list::draw_indirect(const scene_descriptor_set & descriptors, const gfx_mesh & mesh, VkDescriptorBufferInfo instances, VkDescriptorBufferInfo arguments)
+{
+    if(&descriptors.get_material().get_contract() != &contract) fail_fast();
+
+    draw_item item {&descriptors.get_material(), descriptors.get_descriptor_set()};
+    item.scissor = scissor;
+    item.vertex_buffer_count = 2;
+    item.vertex_buffers[0] = *mesh.vertex_buffer;
+    item.vertex_buffers[1] = instances.buffer;
+    item.vertex_buffer_offsets[0] = 0;
+    item.vertex_buffer_offsets[1] = instances.offset;
+    item.index_buffer = *mesh.index_buffer;
+    item.index_buffer_offset = 0;
+    item.indirect_buffer = arguments.buffer;
+    item.indirect_buffer_offset = arguments.offset;
+    items.push_back(item);
+}
+
+void draw_list::append(const draw_list & shard)
+{
+    if(&shard.contract != &contract) throw std::logic_error("contract mismatch");
+    items.insert(items.end(), shard.items.begin(), shard.items.end());
+}
+
+void draw_list::sort_by_material()
+{
+    std::stable_sort(items.begin(), items.end(), [](const draw_item & a, const draw_item & b) { return std::less<const scene_material *>{}(a.material, b.material); });
+}
+
+void draw_list::write_commands(VkCommandBuffer cmd, const render_pass & render_pass, VkRect2D viewport, array_view<scene_descriptor_set> shared_descriptors) const
+{
+    const auto shared_sets = get_shared_descriptor_sets(shared_descriptors);
+    if(auto recorder = pool.get_recorder()) recorder->on_write_commands(*this, render_pass, shared_descriptors);
+    vkCmdSetViewport(cmd, viewport);
+    vkCmdSetScissor(cmd, viewport);
+    write_items(cmd, contract.get_render_pass_index(render_pass), viewport, shared_sets, 0, items.size());
+}
+
+void draw_list::write_commands(VkCommandBuffer cmd, const render_pass & render_pass, const framebuffer & framebuffer, VkRect2D viewport, array_view<scene_descriptor_set> shared_descriptors, thread_pool & threads) const
+{
+    const auto shared_sets = get_shared_descriptor_sets(shared_descriptors);
+    if(auto recorder = pool.get_recorder()) recorder->on_write_commands(*this, render_pass, shared_descriptors);
+    const auto render_pass_index = contract.get_render_pass_index(render_pass);
+
+    // Split items into contiguous ranges, with enough items per range to amortize the cost of a secondary command buffer
+    const size_t min_items_per_buffer = 64;
+    const size_t buffer_count = std::max<size_t>(std::min(threads.get_thread_count(), items.size() / min_items_per_buffer), 1);
+    std::vector<VkCommandBuffer> buffers(buffer_count);
+    threads.run(buffer_count, [&](size_t i)
+    {
+        // Each range is recorded from its own sub-pool, so no two threads ever share a command pool
+        buffers[i] = pool.get_sub_pool(i).allocate_command_buffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+        VkCommandBufferInheritanceInfo inheritance_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+        inheritance_info.renderPass = render_pass.get_vk_handle();
+        inheritance_info.subpass = 0;
+        inheritance_info.framebuffer = framebuffer.get_vk_handle();
+        VkCommandBufferBeginInfo begin_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        begin_info.pInheritanceInfo = &inheritance_info;
+        check(vkBeginCommandBuffer(buffers[i], &begin_info));
+        vkCmdSetViewport(buffers[i], viewport);
+        vkCmdSetScissor(buffers[i], viewport);
+        write_items(buffers[i], render_pass_index, viewport, shared_sets, items.size()*i/buffer_count, items.size()*(i+1)/buffer_count);
+        check(vkEndCommandBuffer(buffers[i]));
+    });
+    vkCmdExecuteCommands(cmd, narrow(buffers.size()), buffers.data());
+}
+
+std::vector<VkDescriptorSet> draw_list::get_shared_descriptor_sets(array_view<scene_descriptor_set> shared_descriptors) const
 {
-    // Validate and bind shared descriptor sets
     auto & contract_layouts = contract.get_shared_layouts();
     if(shared_descriptors.size != contract_layouts.size()) throw std::runtime_error("contract violation");
-    if(shared_descriptors.size > 0)
+    std::vector<VkDescriptorSet> sets;    
+    for(uint32_t i=0; i<shared_descriptors.size; ++i) 
     {
-        std::vector<VkDescriptorSet> sets;    
-        for(uint32_t i=0; i<shared_descriptors.size; ++i) 
-        {
-            if(shared_descriptors[i].get_descriptor_set_layout() != contract_layouts[i]) throw std::runtime_error("contract violation");
-            sets.push_back(shared_descriptors[i].get_descriptor_set());
-        }
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, contract.get_example_layout(), 0, sets, {});
+        if(shared_descriptors[i].get_descriptor_set_layout() != contract_layouts[i]) throw std::runtime_error("contract violation");
+        sets.push_back(shared_descriptors[i].get_descriptor_set());
     }
+    return sets;
+}
+
+static bool equal_rects(const VkRect2D & a, const VkRect2D & b)
+{
+    return a.offset.x == b.offset.x && a.offset.y == b.offset.y && a.extent.width == b.extent.width && a.extent.height == b.extent.height;
+}
 
-    // Issue draw calls
-    auto render_pass_index = contract.get_render_pass_index(render_pass);
-    for(auto & item : items)
+void draw_list::write_items(VkCommandBuffer cmd, size_t render_pass_index, VkRect2D viewport, array_view<VkDescriptorSet> shared_sets, size_t first_item, size_t last_item) const
+{
+    if(shared_sets.size > 0) vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, contract.get_example_layout(), 0, shared_sets, {});
+
+    // Issue draw calls, skipping redundant pipeline binds between consecutive items of the same material. The caller has set the
+    // scissor rect to the viewport, and each item's scissor rect is only set when it differs from the previous item's.
+    VkPipeline bound_pipeline {};
+    VkRect2D bound_scissor = viewport;
+    for(size_t i=first_item; i<last_item; ++i)
     {
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, item.material->get_pipeline(render_pass_index));
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, item.material->get_pipeline_layout(), narrow(shared_descriptors.size), {item.set}, {});
+        auto & item = items[i];
+        const auto pipeline = item.material->get_pipeline(render_pass_index);
+        if(pipeline != bound_pipeline) vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, bound_pipeline = pipeline);
+        const VkRect2D scissor = item.scissor.extent.width && item.scissor.extent.height ? item.scissor : viewport;
+        if(!equal_rects(scissor, bound_scissor)) vkCmdSetScissor(cmd, bound_scissor = scissor);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, item.material->get_pipeline_layout(), narrow(shared_sets.size), {item.set}, {});
         vkCmdBindVertexBuffers(cmd, 0, item.vertex_buffer_count, item.vertex_buffers, item.vertex_buffer_offsets);
         vkCmdBindIndexBuffer(cmd, item.index_buffer, item.index_buffer_offset, VkIndexType::VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexed(cmd, item.index_count, item.instance_count, item.first_index, 0, 0);
+        if(item.indirect_buffer) vkCmdDrawIndexedIndirect(cmd, item.indirect_buffer, item.indirect_buffer_offset, 1, 0);
+        else vkCmdDrawIndexed(cmd, item.index_count, item.instance_count, item.first_index, 0, 0);
+    }
+}
+
+/////////////////
+// draw_bundle //
+/////////////////
+
+draw_bundle::draw_bundle(std::shared_ptr<context> ctx, const scene_contract & contract, array_view<VkDescriptorPoolSize> descriptor_pool_sizes, uint32_t max_descriptor_sets) :
+    pool{ctx, descriptor_pool_sizes, max_descriptor_sets}, list{pool, contract}, log{std::make_unique<frame_recorder>(pool)}
+{
+
+}
+
+draw_bundle::~draw_bundle() {}
+
+void draw_bundle::write_commands(VkCommandBuffer cmd, const render_pass & render_pass, const framebuffer & framebuffer, VkRect2D viewport, array_view<scene_descriptor_set> shared_descriptors)
+{
+    const auto shared_sets = list.get_shared_descriptor_sets(shared_descriptors);
+    auto it = std::find_if(begin(recordings), end(recordings), [&](const recording & r) 
+    { 
+        return r.pass == &render_pass && r.framebuffer == framebuffer.get_vk_handle() && r.shared_sets == shared_sets && equal_rects(r.viewport, viewport);
+    });
+    if(it == end(recordings))
+    {
+        // Simultaneous use allows the same commands to be pending in several frames at once
+        VkCommandBuffer secondary = pool.allocate_command_buffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+        VkCommandBufferInheritanceInfo inheritance_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+        inheritance_info.renderPass = render_pass.get_vk_handle();
+        inheritance_info.subpass = 0;
+        inheritance_info.framebuffer = framebuffer.get_vk_handle();
+        VkCommandBufferBeginInfo begin_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        begin_info.pInheritanceInfo = &inheritance_info;
+        check(vkBeginCommandBuffer(secondary, &begin_info));
+        vkCmdSetViewport(secondary, viewport);
+        vkCmdSetScissor(secondary, viewport);
+        list.write_items(secondary, list.contract.get_render_pass_index(render_pass), viewport, shared_sets, 0, list.items.size());
+        check(vkEndCommandBuffer(secondary));
+        it = recordings.insert(end(recordings), {&render_pass, framebuffer.get_vk_handle(), viewport, shared_sets, secondary});
     }
+    if(recorder) recorder->on_write_bundle(list, *log, render_pass, shared_descriptors);
+    vkCmdExecuteCommands(cmd, 1, &it->cmd);
+}
+
+void draw_bundle::invalidate()
+{
+    // The recorder holds on to the log until it finishes, so the log must outlive the capture
+    if(recorder) throw std::logic_error("draw_bundle::invalidate() called while a frame_recorder observes the bundle");
+    check(vkDeviceWaitIdle(pool.ctx->device));
+    recordings.clear();
+    list.items.clear();
+    log.reset();
+    pool.recycle();
+    log = std::make_unique<frame_recorder>(pool);
 }
 
 //////////////
 // renderer //
 //////////////
 
-renderer::renderer(std::function<void(const char *)> debug_callback) : ctx{std::make_shared<context>(debug_callback)} 
+renderer::renderer(std::function<void(const char *)> debug_callback, bool headless) : ctx{std::make_shared<context>(debug_callback, headless)} 
 {
 
 }
 
+void renderer::submit(array_view<VkCommandBuffer> commands, VkFence fence)
+{
+    VkSubmitInfo submit_info {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit_info.commandBufferCount = narrow(commands.size);
+    submit_info.pCommandBuffers = commands.data;
+    check(vkQueueSubmit(ctx->queue, 1, &submit_info, fence));
+}
+
 void renderer::wait_until_device_idle()
 {
     vkDeviceWaitIdle(ctx->device);
@@ -1198,11 +1601,30 @@ VkFormat renderer::get_swapchain_surface_format() const
     return ctx->selection.surface_format.format;
 }
 
+bool renderer::supports_format(VkFormat format, VkFormatFeatureFlags optimal_tiling_features) const
+{
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(ctx->selection.physical_device, format, &props);
+    return (props.optimalTilingFeatures & optimal_tiling_features) == optimal_tiling_features;
+}
+
 std::shared_ptr<texture> renderer::create_texture_2d(uint32_t width, uint32_t height, VkFormat format, const void * initial_data)
 {
     return std::make_shared<texture>(ctx, format, VkExtent3D{width,height,1}, array_view<const void *>{initial_data}, VK_IMAGE_VIEW_TYPE_2D);
 }
 
+std::shared_ptr<texture> renderer::create_texture_2d_array(const std::vector<image> & layers)
+{
+    if(layers.empty()) throw std::logic_error("texture array requires at least one layer");
+    std::vector<const void *> layer_data;
+    for(auto & layer : layers)
+    {
+        if(layer.get_width() != layers[0].get_width() || layer.get_height() != layers[0].get_height() || layer.get_format() != layers[0].get_format()) throw std::logic_error("texture array layers must match");
+        layer_data.push_back(layer.get_pixels());
+    }
+    return std::make_shared<texture>(ctx, layers[0].get_format(), VkExtent3D{narrow(layers[0].get_width()),narrow(layers[0].get_height()),1}, layer_data, VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+}
+
 std::shared_ptr<texture> renderer::create_texture_cube(const image & posx, const image & negx, const image & posy, const image & negy, const image & posz, const image & negz)
 {
     const VkFormat format = posx.get_format(); const uint32_t side_length = posx.get_width();
@@ -1225,9 +1647,9 @@ std::shared_ptr<framebuffer> renderer::create_framebuffer(std::shared_ptr<const
     return std::make_shared<framebuffer>(ctx, pass, attachments, dims);
 }
 
-std::shared_ptr<shader> renderer::create_shader(VkShaderStageFlagBits stage, const char * filename)
+std::shared_ptr<shader> renderer::create_shader(VkShaderStageFlagBits stage, const char * filename, const char * preamble)
 {
-    return std::make_shared<shader>(ctx, compiler.compile_glsl(stage, filename));
+    return std::make_shared<shader>(ctx, compiler.compile_glsl(stage, filename, preamble));
 }
 
 std::shared_ptr<vertex_format> renderer::create_vertex_format(array_view<VkVertexInputBindingDescription> bindings, array_view<VkVertexInputAttributeDescription> attributes)
@@ -1240,7 +1662,12 @@ std::shared_ptr<scene_contract> renderer::create_contract(array_view<std::shared
     return std::make_shared<scene_contract>(ctx, render_passes, shared_descriptor_sets);
 }
 
-std::shared_ptr<scene_material> renderer::create_material(std::shared_ptr<scene_contract> contract, std::shared_ptr<vertex_format> format, array_view<std::shared_ptr<shader>> stages, bool depth_write, bool depth_test, VkBlendFactor src_factor, VkBlendFactor dst_factor)
+std::shared_ptr<scene_material> renderer::create_material(std::shared_ptr<scene_contract> contract, std::shared_ptr<vertex_format> format, array_view<std::shared_ptr<shader>> stages, bool depth_write, bool depth_test, VkBlendFactor src_factor, VkBlendFactor dst_factor, VkPrimitiveTopology topology)
+{
+    return std::make_shared<scene_material>(ctx, contract, format, stages, depth_write, depth_test, src_factor, dst_factor, topology);
+}
+
+std::shared_ptr<compute_pipeline> renderer::create_compute_pipeline(std::shared_ptr<shader> compute_shader)
 {
-    return std::make_shared<scene_material>(ctx, contract, format, stages, depth_write, depth_test, src_factor, dst_factor);
+    return std::make_shared<compute_pipeline>(ctx, *compute_shader);
 }
\ No newline at end of file
@@ -2,11 +2,13 @@
 #define RENDERER_H
 
 #include "data-types.h"
+#include "thread-pool.h"
 
 const char * to_string(VkResult result);
 void check(VkResult result);
 
 struct context;
+class frame_recorder;
 
 class window
 {
@@ -56,6 +58,9 @@ inline render_target make_depth_buffer(std::shared_ptr<context> ctx, uint2 dims)
 class texture
 {
     std::shared_ptr<context> ctx;
+    VkFormat format;
+    VkExtent3D extent;
+    uint32_t mip_levels;
     VkImage image;
     VkImageView image_view;
     VkDeviceMemory device_memory;
@@ -65,6 +70,10 @@ public:
 
     VkImage get_image() { return image; }
     operator VkImageView () const { return image_view; }
+
+    // Overwrite a region of mip level zero of a layer of a 2D texture, then regenerate the remaining mip levels of that layer. Waits 
+    // for all work on the queue to finish, so the texture may be in use by earlier frames.
+    void update_region(uint32_t layer, int2 offset, const ::image & contents);
 };
 
 class static_buffer
@@ -73,6 +82,7 @@ class static_buffer
     VkBuffer buffer;
     VkDeviceMemory device_memory;
 public:
+    // If initial_data is null, the contents of the buffer are left undefined, for buffers which are only ever written by the GPU
     static_buffer(std::shared_ptr<context> ctx, VkBufferUsageFlags usage, VkMemoryPropertyFlags memory_properties, VkDeviceSize size, const void * initial_data);
     ~static_buffer();
 
@@ -82,28 +92,47 @@ public:
 class dynamic_buffer
 {
     std::shared_ptr<context> ctx;
+    dynamic_buffer * parent {};
     VkBuffer buffer {};
     VkMemoryRequirements mem_reqs {};
     VkDeviceMemory device_memory {};
     char * mapped_memory {};
-    VkDeviceSize offset {}, range {};
+    VkDeviceSize size {}, offset {}, range {}, limit {};
+    std::mutex mutex;
+
+    void grow(size_t size);
 public:
     dynamic_buffer(std::shared_ptr<context> ctx, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memory_properties);
+    dynamic_buffer(dynamic_buffer & parent); // Writes into chunks carved out of the parent buffer, and can be used on a different thread than the parent
     ~dynamic_buffer();
 
     void reset();
     
     void begin();
     void write(size_t size, const void * data);
+    void * reserve(size_t size); // Append size bytes to the current range and return them for writing, valid until the next write or reserve
     VkDescriptorBufferInfo end();
 
     VkDescriptorBufferInfo upload(size_t size, const void * data);
+    void update(VkDescriptorBufferInfo range, size_t size, const void * data); // Overwrite the start of a previously written range in place
+
+    // Reserve a range of this buffer, safe to call concurrently with other calls to carve(...), but not with writes to this buffer
+    VkDescriptorBufferInfo carve(VkDeviceSize size);
+
+    // Access to the raw contents of the buffer, used to capture and replay frames
+    VkBuffer get_vk_handle() const { return buffer; }
+    const char * get_mapped_memory() const { return mapped_memory; }
+    VkDeviceSize get_used_size() const { return offset + range; }
+    void assign(size_t size, const void * data);
 };
 
 // Manages the allocation of short-lived resources which can be recycled in a single call, protected by a fence
 class transient_resource_pool
 {
     std::shared_ptr<context> ctx;
+    transient_resource_pool * parent {};
+    std::vector<VkDescriptorPoolSize> descriptor_pool_sizes;
+    uint32_t max_descriptor_sets;
     dynamic_buffer uniform_buffer;
     dynamic_buffer vertex_buffer;
     dynamic_buffer index_buffer;
@@ -111,48 +140,78 @@ class transient_resource_pool
     std::vector<VkCommandBuffer> command_buffers;
     VkDescriptorPool descriptor_pool;
     std::vector<VkDescriptorSet> descriptor_sets;
-    VkFence fence;
+    VkFence fence {};
+    frame_recorder * recorder {};
+    std::mutex sub_pool_mutex;
+    std::vector<std::unique_ptr<transient_resource_pool>> sub_pools;
+
+    void create_pools();
+    void recycle();
+    friend class draw_bundle; // Recycles its persistent pool without a fence
 public:
     transient_resource_pool(std::shared_ptr<context> ctx, array_view<VkDescriptorPoolSize> descriptor_pool_sizes, uint32_t max_descriptor_sets);
+    transient_resource_pool(transient_resource_pool & parent);
     ~transient_resource_pool();
 
+    // Sub-pools allow other threads to allocate transient resources. Their buffer memory is carved out of this pool's buffers, and 
+    // they are recycled when this pool is reset. Each sub-pool may only be used by one thread at a time, and this pool should not be
+    // used to write transient data while its sub-pools are in use.
+    transient_resource_pool & get_sub_pool(size_t index);
+
     void reset();
-    VkCommandBuffer allocate_command_buffer();
+    VkCommandBuffer allocate_command_buffer(VkCommandBufferLevel level=VK_COMMAND_BUFFER_LEVEL_PRIMARY);
     VkDescriptorSet allocate_descriptor_set(VkDescriptorSetLayout layout);
     VkDescriptorBufferInfo write_data(size_t size, const void * data) { return uniform_buffer.upload(size, data); }
 
+    // Data can be written one element at a time, in bulk, or generated in place by reserving count elements and filling them before the
+    // next write to the same buffer. Reserved elements may be filled from any thread, but are not initialized.
     void begin_indices() { index_buffer.begin(); }
     template<class T> void write_indices(const T & indices) { index_buffer.write(sizeof(indices), &indices); }
+    template<class T> void write_indices(const T * indices, size_t count) { index_buffer.write(sizeof(T)*count, indices); }
+    template<class T> T * reserve_indices(size_t count) { return reinterpret_cast<T *>(index_buffer.reserve(sizeof(T)*count)); }
     VkDescriptorBufferInfo end_indices() { return index_buffer.end(); }
 
     void begin_vertices() { vertex_buffer.begin(); }
     template<class T> void write_vertex(const T & vertex) { vertex_buffer.write(sizeof(vertex), &vertex); }
+    template<class T> void write_vertices(const T * vertices, size_t count) { vertex_buffer.write(sizeof(T)*count, vertices); }
+    template<class T> T * reserve_vertices(size_t count) { return reinterpret_cast<T *>(vertex_buffer.reserve(sizeof(T)*count)); }
     VkDescriptorBufferInfo end_vertices() { return vertex_buffer.end(); }
 
     void begin_instances() { begin_vertices(); }
     template<class T> void write_instance(const T & instance) { write_vertex(instance); }
+    template<class T> void write_instances(const T * instances, size_t count) { write_vertices(instances, count); }
+    template<class T> T * reserve_instances(size_t count) { return reserve_vertices<T>(count); }
     VkDescriptorBufferInfo end_instances() { return end_vertices(); }
 
     context & get_context() { return *ctx; }
-    VkFence get_fence() { return fence; }
+    VkFence get_fence() { return parent ? parent->get_fence() : fence; }
+    dynamic_buffer & get_uniform_buffer() { return uniform_buffer; }
+    dynamic_buffer & get_vertex_buffer() { return vertex_buffer; }
+    dynamic_buffer & get_index_buffer() { return index_buffer; }
+
+    // If set, the recorder is notified of all descriptor writes and draw list submissions made using this pool
+    void set_recorder(frame_recorder * recorder) { this->recorder = recorder; }
+    frame_recorder * get_recorder() const { return parent ? parent->get_recorder() : recorder; }
 
     template<class T> VkDescriptorBufferInfo write_data(const T & data) { return write_data(sizeof(data), &data); }
+    template<class T> void update_data(VkDescriptorBufferInfo range, const T & data) { uniform_buffer.update(range, sizeof(data), &data); }
+    template<class T> void update_data(VkDescriptorBufferInfo range, const std::vector<T> & data) { uniform_buffer.update(range, data.size()*sizeof(T), data.data()); }
 };
 
 // Other utility functions
-void transition_layout(VkCommandBuffer command_buffer, VkImage image, uint32_t mip_level, uint32_t array_layer, VkImageLayout old_layout, VkImageLayout new_layout);
+void transition_layout(VkCommandBuffer command_buffer, VkImage image, uint32_t mip_level, uint32_t array_layer, VkImageLayout old_layout, VkImageLayout new_layout, VkImageAspectFlags aspect=VK_IMAGE_ASPECT_COLOR_BIT);
 
 // Convenience wrappers around Vulkan calls
 void vkUpdateDescriptorSets(VkDevice device, array_view<VkWriteDescriptorSet> descriptorWrites, array_view<VkCopyDescriptorSet> descriptorCopies);
-void vkWriteDescriptorCombinedImageSamplerInfo(VkDevice device, VkDescriptorSet set, uint32_t binding, uint32_t array_element, VkDescriptorImageInfo info);
-void vkWriteDescriptorBufferInfo(VkDevice device, VkDescriptorSet set, uint32_t binding, uint32_t array_element, VkDescriptorBufferInfo info);
+void vkWriteDescriptorCombinedImageSamplerInfo(VkDevice device, VkDescriptorSet set, uint32_t binding, uint32_t array_element, VkDescriptorImageInfo info, VkDescriptorType type=VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+void vkWriteDescriptorBufferInfo(VkDevice device, VkDescriptorSet set, uint32_t binding, uint32_t array_element, VkDescriptorBufferInfo info, VkDescriptorType type=VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
 
 void vkCmdBindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint, VkPipelineLayout layout, uint32_t firstSet, array_view<VkDescriptorSet> descriptorSets, array_view<uint32_t> dynamicOffsets);
 void vkCmdBindVertexBuffers(VkCommandBuffer commandBuffer, uint32_t firstBinding, array_view<VkBuffer> buffers, array_view<VkDeviceSize> offsets);
 
 void vkCmdSetViewport(VkCommandBuffer commandBuffer, VkRect2D viewport);
 void vkCmdSetScissor(VkCommandBuffer commandBuffer, VkRect2D scissor);
-void vkCmdBeginRenderPass(VkCommandBuffer cmd, VkRenderPass renderPass, VkFramebuffer framebuffer, VkRect2D renderArea, array_view<VkClearValue> clearValues);
+void vkCmdBeginRenderPass(VkCommandBuffer cmd, VkRenderPass renderPass, VkFramebuffer framebuffer, VkRect2D renderArea, array_view<VkClearValue> clearValues, VkSubpassContents contents=VK_SUBPASS_CONTENTS_INLINE);
 
 #include "load.h"   // For shader_compiler
 #include <map>
@@ -223,6 +282,26 @@ public:
     VkSampler get_vk_handle() const { return handle; }
 };
 
+// Measures GPU time between two points of a frame with a pair of timestamp queries, for each of several frames in flight
+class gpu_timer
+{
+    std::shared_ptr<context> ctx;
+    VkQueryPool query_pool;
+    std::vector<bool> written;
+    uint64_t valid_mask;
+    double seconds_per_tick;
+public:
+    gpu_timer(std::shared_ptr<context> ctx, uint32_t frame_count);
+    ~gpu_timer();
+
+    // Returns nothing if the device cannot write timestamps, or if the frame has not yet finished on the GPU
+    std::optional<double> get_elapsed_seconds(uint32_t frame) const;
+
+    // The slot for a frame should only be reused once its previous commands have completed, e.g. after transient_resource_pool::reset()
+    void begin(VkCommandBuffer cmd, uint32_t frame);
+    void end(VkCommandBuffer cmd, uint32_t frame);
+};
+
 class render_pass
 {
     std::shared_ptr<context> ctx;
@@ -287,7 +366,7 @@ class scene_material
     VkPipelineLayout pipeline_layout;
     std::vector<VkPipeline> pipelines;
 public:
-    scene_material(std::shared_ptr<context> ctx, std::shared_ptr<scene_contract> contract, std::shared_ptr<vertex_format> format, array_view<std::shared_ptr<shader>> stages, bool depth_write, bool depth_test, VkBlendFactor src_factor, VkBlendFactor dst_factor);
+    scene_material(std::shared_ptr<context> ctx, std::shared_ptr<scene_contract> contract, std::shared_ptr<vertex_format> format, array_view<std::shared_ptr<shader>> stages, bool depth_write, bool depth_test, VkBlendFactor src_factor, VkBlendFactor dst_factor, VkPrimitiveTopology topology);
     ~scene_material();
 
     const scene_contract & get_contract() const { return *contract; }
@@ -296,6 +375,22 @@ public:
     VkPipeline get_pipeline(size_t render_pass_index) const { return pipelines[render_pass_index]; }    
 };
 
+// A compute pipeline runs a single compute shader, all of whose descriptors must live in set 0
+class compute_pipeline
+{
+    std::shared_ptr<context> ctx;
+    VkDescriptorSetLayout descriptor_set_layout;
+    VkPipelineLayout pipeline_layout;
+    VkPipeline pipeline;
+public:
+    compute_pipeline(std::shared_ptr<context> ctx, const shader & compute_shader);
+    ~compute_pipeline();
+
+    VkDescriptorSetLayout get_descriptor_set_layout() const { return descriptor_set_layout; }
+    VkPipelineLayout get_pipeline_layout() const { return pipeline_layout; }
+    VkPipeline get_vk_handle() const { return pipeline; }
+};
+
 class renderer
 {
 public:
@@ -303,22 +398,26 @@ public:
 private:
     shader_compiler compiler;
 public:
-    renderer(std::function<void(const char *)> debug_callback);
+    renderer(std::function<void(const char *)> debug_callback, bool headless=false);
 
+    void submit(array_view<VkCommandBuffer> commands, VkFence fence);
     void wait_until_device_idle();
     VkFormat get_swapchain_surface_format() const;
+    bool supports_format(VkFormat format, VkFormatFeatureFlags optimal_tiling_features) const;
 
     std::shared_ptr<texture> create_texture_2d(uint32_t width, uint32_t height, VkFormat format, const void * initial_data);
     std::shared_ptr<texture> create_texture_2d(const image & contents) { return create_texture_2d(contents.get_width(), contents.get_height(), contents.get_format(), contents.get_pixels()); }
+    std::shared_ptr<texture> create_texture_2d_array(const std::vector<image> & layers);
     std::shared_ptr<texture> create_texture_cube(const image & posx, const image & negx, const image & posy, const image & negy, const image & posz, const image & negz);
 
     std::shared_ptr<render_pass> create_render_pass(array_view<VkAttachmentDescription> color_attachments, std::optional<VkAttachmentDescription> depth_attachment, bool invert_faces=false);
     std::shared_ptr<framebuffer> create_framebuffer(std::shared_ptr<const render_pass> render_pass, array_view<VkImageView> attachments, uint2 dims);
 
-    std::shared_ptr<shader> create_shader(VkShaderStageFlagBits stage, const char * filename);
+    std::shared_ptr<shader> create_shader(VkShaderStageFlagBits stage, const char * filename, const char * preamble=nullptr);
     std::shared_ptr<vertex_format> create_vertex_format(array_view<VkVertexInputBindingDescription> bindings, array_view<VkVertexInputAttributeDescription> attributes);
     std::shared_ptr<scene_contract> create_contract(array_view<std::shared_ptr<const render_pass>> render_passes, array_view<array_view<VkDescriptorSetLayoutBinding>> shared_descriptor_sets);
-    std::shared_ptr<scene_material> create_material(std::shared_ptr<scene_contract> contract, std::shared_ptr<vertex_format> format, array_view<std::shared_ptr<shader>> stages, bool depth_write, bool depth_test, VkBlendFactor src_factor, VkBlendFactor dst_factor);
+    std::shared_ptr<scene_material> create_material(std::shared_ptr<scene_contract> contract, std::shared_ptr<vertex_format> format, array_view<std::shared_ptr<shader>> stages, bool depth_write, bool depth_test, VkBlendFactor src_factor, VkBlendFactor dst_factor, VkPrimitiveTopology topology=VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    std::shared_ptr<compute_pipeline> create_compute_pipeline(std::shared_ptr<shader> compute_shader);
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -331,6 +430,7 @@ class scene_descriptor_set
     VkDescriptorSetLayout layout;
     VkDescriptorSet set;
     VkDevice device;
+    frame_recorder * recorder;
 public:
     scene_descriptor_set(transient_resource_pool & pool, VkDescriptorSetLayout layout);
     scene_descriptor_set(transient_resource_pool & pool, const scene_material & material);
@@ -345,7 +445,9 @@ public:
     VkDescriptorSet get_descriptor_set() const { return set; }
 
     void write_uniform_buffer(uint32_t binding, uint32_t array_element, VkDescriptorBufferInfo info);
+    void write_storage_buffer(uint32_t binding, uint32_t array_element, VkDescriptorBufferInfo info);
     void write_combined_image_sampler(uint32_t binding, uint32_t array_element, const sampler & sampler, VkImageView image_view, VkImageLayout image_layout=VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    void write_storage_image(uint32_t binding, uint32_t array_element, VkImageView image_view, VkImageLayout image_layout=VK_IMAGE_LAYOUT_GENERAL);
 };
 
 struct draw_item 
@@ -359,6 +461,9 @@ struct draw_item
     VkDeviceSize index_buffer_offset;
     uint32_t first_index, index_count;
     uint32_t instance_count;
+    VkBuffer indirect_buffer;               // If set, the draw arguments are read from a VkDrawIndexedIndirectCommand in this buffer instead
+    VkDeviceSize indirect_buffer_offset;
+    VkRect2D scissor;                       // If nonempty, the scissor rect for this item, otherwise the item is clipped to the viewport
 };
 
 struct draw_list
@@ -366,21 +471,33 @@ struct draw_list
     transient_resource_pool & pool;
     const scene_contract & contract;
     std::vector<draw_item> items;
+    VkRect2D scissor {};
     
     draw_list(transient_resource_pool & pool, const scene_contract & contract) : pool{pool}, contract{contract} {}
 
+    // Items drawn after this call are clipped to the given rect in framebuffer pixels, or to the viewport they are drawn into if it is empty
+    void set_scissor(const VkRect2D & rect) { scissor = rect; }
+
     template<class T> VkDescriptorBufferInfo upload_uniforms(const T & uniforms) { return pool.write_data(uniforms); }
+    // Zero sized buffers cannot be bound, so an empty array is uploaded as a single default constructed element
+    template<class T> VkDescriptorBufferInfo upload_storage(const std::vector<T> & elements) { return elements.empty() ? pool.write_data(T{}) : pool.write_data(elements.size()*sizeof(T), elements.data()); }
 
     void begin_indices() { pool.begin_indices(); }
     template<class T> void write_indices(const T & indices) { pool.write_indices(indices); }
+    template<class T> void write_indices(const T * indices, size_t count) { pool.write_indices(indices, count); }
+    template<class T> T * reserve_indices(size_t count) { return pool.reserve_indices<T>(count); }
     VkDescriptorBufferInfo end_indices() { return pool.end_indices(); }
 
     void begin_vertices() { pool.begin_vertices(); }
     template<class T> void write_vertex(const T & vertex) { pool.write_vertex(vertex); }
+    template<class T> void write_vertices(const T * vertices, size_t count) { pool.write_vertices(vertices, count); }
+    template<class T> T * reserve_vertices(size_t count) { return pool.reserve_vertices<T>(count); }
     VkDescriptorBufferInfo end_vertices() { return pool.end_vertices(); }
 
     void begin_instances() { pool.begin_instances(); }
     template<class T> void write_instance(const T & instance) { pool.write_instance(instance); }
+    template<class T> void write_instances(const T * instances, size_t count) { pool.write_instances(instances, count); }
+    template<class T> T * reserve_instances(size_t count) { return pool.reserve_instances<T>(count); }
     VkDescriptorBufferInfo end_instances() { return pool.end_instances(); }
 
     scene_descriptor_set shared_descriptor_set(size_t index) { return {pool, contract.get_shared_layouts()[index]}; }
@@ -391,7 +508,63 @@ struct draw_list
     void draw(const scene_descriptor_set & descriptors, const gfx_mesh & mesh, VkDescriptorBufferInfo instances, size_t instance_stride);
     void draw(const scene_descriptor_set & descriptors, const gfx_mesh & mesh, std::vector<size_t> mtls);
     void draw(const scene_descriptor_set & descriptors, const gfx_mesh & mesh);
-    void write_commands(VkCommandBuffer cmd, const render_pass & render_pass, array_view<scene_descriptor_set> shared_descriptors) const;
+    // Draw instances of a mesh with index and instance counts written by the GPU, such as by a compute shader, into arguments
+    void draw_indirect(const scene_descriptor_set & descriptors, const gfx_mesh & mesh, VkDescriptorBufferInfo instances, VkDescriptorBufferInfo arguments);
+
+    // Append the items of a shard recorded on another thread, typically from a sub-pool of this list's pool
+    void append(const draw_list & shard);
+    // Reorder items to minimize pipeline changes, preserving the relative order of items which share a material
+    void sort_by_material();
+
+    // Items are drawn into the given viewport, which is also the scissor rect of every item without a scissor rect of its own
+    void write_commands(VkCommandBuffer cmd, const render_pass & render_pass, VkRect2D viewport, array_view<scene_descriptor_set> shared_descriptors) const;
+    // Record items in parallel into secondary command buffers allocated from sub-pools of this list's pool, and execute them from cmd. 
+    // The render pass must have been begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. Items are drawn into the given viewport,
+    // as above, so the result is the same as writing them on a single thread.
+    void write_commands(VkCommandBuffer cmd, const render_pass & render_pass, const framebuffer & framebuffer, VkRect2D viewport, array_view<scene_descriptor_set> shared_descriptors, thread_pool & threads) const;
+private:
+    friend class draw_bundle;
+    std::vector<VkDescriptorSet> get_shared_descriptor_sets(array_view<scene_descriptor_set> shared_descriptors) const;
+    void write_items(VkCommandBuffer cmd, size_t render_pass_index, VkRect2D viewport, array_view<VkDescriptorSet> shared_sets, size_t first_item, size_t last_item) const;
+};
+
+// A draw_bundle holds a draw_list whose contents do not change from frame to frame. Its data lives in a persistent pool, and it is 
+// recorded once into secondary command buffers for each combination of render pass, framebuffer, viewport and shared descriptor sets, which 
+// are then executed each frame until invalidate() is called. Since recorded commands refer to fixed descriptor sets, per-frame shared 
+// uniforms should be stored in persistent ranges from reserve_uniforms() and overwritten with update_uniforms() once the GPU is done with them.
+// Descriptor writes made through the bundle are logged, so that a frame_recorder which observes the bundle can capture its draws.
+class draw_bundle
+{
+    struct recording { const render_pass * pass; VkFramebuffer framebuffer; VkRect2D viewport; std::vector<VkDescriptorSet> shared_sets; VkCommandBuffer cmd; };
+    transient_resource_pool pool;
+    draw_list list;
+    std::vector<recording> recordings;
+    std::unique_ptr<frame_recorder> log;
+    frame_recorder * recorder {};
+public:
+    draw_bundle(std::shared_ptr<context> ctx, const scene_contract & contract, array_view<VkDescriptorPoolSize> descriptor_pool_sizes, uint32_t max_descriptor_sets);
+    ~draw_bundle();
+
+    // The list should be populated while empty(), and should not be modified afterwards without calling invalidate()
+    bool empty() const { return list.items.empty(); }
+    draw_list & get_list() { return list; }
+
+    scene_descriptor_set shared_descriptor_set(size_t index) { return list.shared_descriptor_set(index); }
+    template<class T> VkDescriptorBufferInfo reserve_uniforms() { return list.upload_uniforms(T{}); }
+    template<class T> void update_uniforms(VkDescriptorBufferInfo range, const T & uniforms) { pool.update_data(range, uniforms); }
+    VkDescriptorBufferInfo reserve_storage(size_t size) { return list.upload_storage(std::vector<char>(size)); }
+    template<class T> void update_storage(VkDescriptorBufferInfo range, const std::vector<T> & elements) { pool.update_data(range, elements); }
+
+    // The render pass must have been begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. Each distinct viewport is recorded
+    // separately, so callers which vary the viewport should draw it from a small set of values.
+    void write_commands(VkCommandBuffer cmd, const render_pass & render_pass, const framebuffer & framebuffer, VkRect2D viewport, array_view<scene_descriptor_set> shared_descriptors);
+
+    // Waits for the device to go idle, then discards the list, all recorded commands, and all persistent descriptor sets and uniforms.
+    // Must not be called while a frame_recorder observes the bundle.
+    void invalidate();
+
+    // If set, the recorder is notified of each use of the bundle, typically by frame_recorder::observe(...)
+    void set_recorder(frame_recorder * recorder) { this->recorder = recorder; }
 };
 
 #endif
@@ -0,0 +1,82 @@
+#include "shadow-cascades.h"
+#include <algorithm>    // For std::min(...), std::max(...)
+#include <limits>       // For std::numeric_limits<T>
+#include <stdexcept>    // For std::logic_error
+
+shadow_cascades::shadow_cascades(size_t cascade_count, uint32_t tile_size, float split_lambda) :
+    tile_size{tile_size}, tiles_per_row{static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(cascade_count))))}, split_lambda{split_lambda}, static_invalid{true}, cascades(cascade_count)
+{
+    if(cascade_count == 0) throw std::logic_error("shadow_cascades requires at least one cascade");
+    for(size_t i=0; i<cascades.size(); ++i) cascades[i].tile_offset = uint2{static_cast<uint32_t>(i % tiles_per_row), static_cast<uint32_t>(i / tiles_per_row)} * tile_size;
+}
+
+void shadow_cascades::invalidate_static()
+{
+    static_invalid = true;
+}
+
+void shadow_cascades::update(const float4x4 & camera_view_proj_matrix, float near_depth, float far_depth, const float3 & light_direction, const float3 & caster_min, const float3 & caster_max)
+{
+    // Find the edges of the view frustum, as rays from the near plane to the far plane of the camera's projection
+    const float4x4 inv_view_proj_matrix = inverse(camera_view_proj_matrix);
+    const float4 depth_row = camera_view_proj_matrix.row(3);
+    float3 ray_origins[4], ray_directions[4]; // Directions are scaled to advance one unit of view depth
+    for(int i=0; i<4; ++i)
+    {
+        const float2 ndc {i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f};
+        const float4 n = mul(inv_view_proj_matrix, float4{ndc.x, ndc.y, 0, 1}), f = mul(inv_view_proj_matrix, float4{ndc.x, ndc.y, 1, 1});
+        ray_origins[i] = n.xyz()/n.w;
+        ray_directions[i] = (f.xyz()/f.w - ray_origins[i]) / (dot(depth_row, float4{f.xyz()/f.w, 1}) - dot(depth_row, float4{ray_origins[i], 1}));
+        ray_origins[i] -= ray_directions[i] * dot(depth_row, float4{ray_origins[i], 1});
+    }
+
+    // Choose a light space basis which depends only on the light direction, with cross(right, down) == forward as in Vulkan clip space
+    const float3 forward = normalize(light_direction);
+    const float3 right = normalize(cross(forward, std::abs(forward.z) < 0.99f ? float3{0,0,1} : float3{1,0,0}));
+    const float3 down = cross(forward, right);
+
+    // The depth range of every cascade covers all potential casters
+    float min_z = std::numeric_limits<float>::max(), max_z = std::numeric_limits<float>::lowest();
+    for(int i=0; i<8; ++i)
+    {
+        const float z = dot(forward, float3{i & 1 ? caster_max.x : caster_min.x, i & 2 ? caster_max.y : caster_min.y, i & 4 ? caster_max.z : caster_min.z});
+        min_z = std::min(min_z, z);
+        max_z = std::max(max_z, z);
+    }
+
+    const uint2 atlas_size = get_atlas_size();
+    for(size_t i=0; i<cascades.size(); ++i)
+    {
+        auto & c = cascades[i];
+
+        // Blend between uniform and logarithmic split distances
+        auto split = [&](size_t j) { const float t = static_cast<float>(j) / cascades.size(); const float uniform = near_depth + (far_depth - near_depth) * t, logarithmic = near_depth * std::pow(far_depth / near_depth, t); return uniform + (logarithmic - uniform) * split_lambda; };
+        c.near_depth = split(i);
+        c.far_depth = split(i+1);
+
+        // Bound the slice of the frustum with a sphere, whose radius does not change as the camera rotates
+        float3 corners[8], center;
+        for(int j=0; j<8; ++j) center += corners[j] = ray_origins[j%4] + ray_directions[j%4] * (j < 4 ? c.near_depth : c.far_depth);
+        center /= 8.0f;
+        float radius = 0;
+        for(auto & corner : corners) radius = std::max(radius, length(corner - center));
+        radius = std::ceil(radius * 16) / 16;
+
+        // Snap the center of the cascade to whole texels in light space
+        const float texel_size = 2 * radius / tile_size;
+        const float center_x = std::floor(dot(right, center) / texel_size) * texel_size, center_y = std::floor(dot(down, center) / texel_size) * texel_size;
+        const float4x4 view_proj_matrix = transpose(float4x4{
+            {right / radius, -center_x / radius},
+            {down / radius, -center_y / radius},
+            {forward / (max_z - min_z), -min_z / (max_z - min_z)},
+            {0, 0, 0, 1}
+        });
+        c.static_dirty = static_invalid || view_proj_matrix != c.view_proj_matrix;
+        c.view_proj_matrix = view_proj_matrix;
+
+        // Map clip space into this cascade's tile of the atlas
+        const float2 scale = float2(0.5f * tile_size) / float2(atlas_size), offset = (float2(0.5f * tile_size) + float2(c.tile_offset)) / float2(atlas_size);
+        c.atlas_matrix = mul(float4x4{{scale.x,0,0,0}, {0,scale.y,0,0}, {0,0,1,0}, {offset.x,offset.y,0,1}}, view_proj_matrix);
+    }
+    static_invalid = false;
+}
@@ -0,0 +1,47 @@
+#ifndef SHADOW_CASCADES_H
+#define SHADOW_CASCADES_H
+
+#include <vector>       // For std::vector<T>
+#include <functional>   // For std::hash<T>, specialized by linalg.h
+#include "linalg.h"
+using namespace linalg::aliases;
+
+// Fits a set of orthographic shadow map cascades for a directional light to slices of a camera's view frustum. The cascades are
+// laid out as square tiles of a single shadow atlas. Each cascade is bounded by a sphere and snapped to whole texels in a light
+// space basis which depends only on the light direction, so that shadow edges do not shimmer as the camera moves, and so that a
+// cascade's matrix stays exactly the same, and its cached rendering of static casters stays valid, until it moves by a whole texel.
+class shadow_cascades
+{
+public:
+    struct cascade
+    {
+        float near_depth, far_depth;    // Range of view depths covered by this cascade
+        float4x4 view_proj_matrix;      // Maps world space into this cascade's clip space, for rendering casters
+        float4x4 atlas_matrix;          // Maps world space into shadow atlas texture coordinates and depth, for sampling
+        uint2 tile_offset;              // Position of this cascade's tile within the atlas, in texels
+        bool static_dirty;              // True if the last update moved this cascade, so static casters must be rendered into its cache again
+    };
+private:
+    uint32_t tile_size, tiles_per_row;
+    float split_lambda;
+    bool static_invalid;
+    std::vector<cascade> cascades;
+public:
+    // split_lambda blends between uniform (0) and logarithmic (1) split distances
+    shadow_cascades(size_t cascade_count, uint32_t tile_size, float split_lambda=0.8f);
+
+    uint32_t get_tile_size() const { return tile_size; }
+    uint2 get_atlas_size() const { return {tiles_per_row*tile_size, static_cast<uint32_t>((cascades.size()+tiles_per_row-1)/tiles_per_row)*tile_size}; }
+    size_t get_cascade_count() const { return cascades.size(); }
+    const cascade & get_cascade(size_t index) const { return cascades[index]; }
+
+    // Fit cascades to the view frustum between near_depth and far_depth of a camera whose clip space has a zero to one depth range
+    // and a w coordinate equal to view depth. light_direction points from the light into the scene, and casters must lie within
+    // the axis aligned box from caster_min to caster_max.
+    void update(const float4x4 & camera_view_proj_matrix, float near_depth, float far_depth, const float3 & light_direction, const float3 & caster_min, const float3 & caster_max);
+
+    // Mark all cascades as dirty on the next update, for instance after static geometry has changed
+    void invalidate_static();
+};
+
+#endif
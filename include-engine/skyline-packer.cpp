@@ -0,0 +1,60 @@
+#include "skyline-packer.h"
+#include <algorithm>    // For std::max(...)
+#include <climits>      // For INT_MAX
+
+skyline_packer::skyline_packer(int2 dims) : dims{dims}, skyline{{0, 0, dims.x}}
+{
+
+}
+
+int skyline_packer::get_used_height() const
+{
+    int height = 0;
+    for(auto & s : skyline) height = std::max(height, s.y);
+    return height;
+}
+
+std::optional<int2> skyline_packer::insert(int2 size)
+{
+    if(size.x <= 0 || size.y <= 0) return int2{0,0};
+
+    // Find the lowest position along the skyline where the rectangle fits, resting on the highest segment beneath it
+    size_t best_index = skyline.size();
+    int best_y = INT_MAX;
+    for(size_t i=0; i<skyline.size() && skyline[i].x + size.x <= dims.x; ++i)
+    {
+        int y = 0;
+        for(size_t j=i; j<skyline.size() && skyline[j].x < skyline[i].x + size.x; ++j) y = std::max(y, skyline[j].y);
+        if(y + size.y <= dims.y && y < best_y)
+        {
+            best_index = i;
+            best_y = y;
+        }
+    }
+    if(best_index == skyline.size()) return std::nullopt;
+
+    // Raise the skyline over the placed rectangle, trimming or removing the segments it covers
+    const int2 position {skyline[best_index].x, best_y};
+    skyline.insert(skyline.begin() + best_index, {position.x, position.y + size.y, size.x});
+    for(size_t i=best_index+1; i<skyline.size(); )
+    {
+        const int overlap = position.x + size.x - skyline[i].x;
+        if(overlap <= 0) break;
+        if(overlap < skyline[i].width)
+        {
+            skyline[i].x += overlap;
+            skyline[i].width -= overlap;
+            break;
+        }
+        skyline.erase(skyline.begin() + i);
+    }
+
+    // Merge adjacent segments of equal height
+    for(size_t i=1; i<skyline.size(); )
+    {
+        if(skyline[i-1].y != skyline[i].y) { ++i; continue; }
+        skyline[i-1].width += skyline[i].width;
+        skyline.erase(skyline.begin() + i);
+    }
+    return position;
+}
@@ -0,0 +1,29 @@
+#ifndef SKYLINE_PACKER_H
+#define SKYLINE_PACKER_H
+
+#include <vector>       // For std::vector<T>
+#include <optional>     // For std::optional<T>
+#include <functional>   // For std::hash<T>, specialized by linalg.h
+#include "linalg.h"
+using namespace linalg::aliases;
+
+// Packs rectangles into a fixed size area one at a time, without moving rectangles which have already been placed. The packer tracks
+// the skyline formed by the tops of the placed rectangles as a list of horizontal segments, and places each new rectangle at the 
+// lowest position along the skyline where it fits, preferring positions further to the left. Space beneath overhangs is not reused.
+class skyline_packer
+{
+    struct segment { int x, y, width; };
+    int2 dims;
+    std::vector<segment> skyline;
+public:
+    explicit skyline_packer(int2 dims);
+
+    int2 get_dims() const { return dims; }
+    int get_used_height() const;
+
+    // Returns the position of the corner of the placed rectangle nearest the origin, or std::nullopt if it does not fit. Empty rectangles
+    // always fit, and consume no space.
+    std::optional<int2> insert(int2 size);
+};
+
+#endif
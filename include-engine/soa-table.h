@@ -0,0 +1,121 @@
+#ifndef SOA_TABLE_H
+#define SOA_TABLE_H
+
+#include <vector>       // For std::vector<T>
+#include <tuple>        // For std::tuple<T...>
+#include <optional>     // For std::optional<T>
+#include <utility>      // For std::index_sequence<I...>
+#include <cstdint>      // For uint32_t
+
+// Refers to a row of a soa_table for as long as that row exists. Each slot counts the rows which have occupied it, so a handle to a
+// removed row never resolves to a later row which reuses its slot. A default constructed handle never resolves to any row.
+struct soa_handle
+{
+    uint32_t slot {0}, generation {0};
+
+    bool operator == (const soa_handle & h) const { return slot == h.slot && generation == h.generation; }
+    bool operator != (const soa_handle & h) const { return !(*this == h); }
+};
+
+// Stores rows of values as a structure of arrays, with one contiguous column per type, so that loops which touch a few fields of every
+// row only stream through the columns they use. Rows are kept dense, and removing a row moves the last row into its place, so removal
+// is constant time but does not preserve the order of rows. Rows can be addressed by their current position, which changes when rows
+// are removed, or by a handle, which is stable for the lifetime of the row.
+template<class... T> class soa_table
+{
+    static constexpr uint32_t no_slot = ~0u;
+    std::tuple<std::vector<T>...> columns;
+    std::vector<uint32_t> row_slots;        // Slot of each row
+    std::vector<uint32_t> slot_rows;        // Row occupying each slot, or the next free slot if the slot is free
+    std::vector<uint32_t> slot_generations; // Generation of the current or most recent occupant of each slot
+    uint32_t first_free_slot = no_slot;
+
+    template<size_t... I> void push_row(std::index_sequence<I...>, T... values) { (std::get<I>(columns).push_back(std::move(values)), ...); }
+    template<size_t... I> void move_row(std::index_sequence<I...>, size_t from, size_t to) { ((std::get<I>(columns)[to] = std::move(std::get<I>(columns)[from])), ...); }
+    template<size_t... I> void pop_row(std::index_sequence<I...>) { (std::get<I>(columns).pop_back(), ...); }
+    template<size_t... I> void reserve_rows(std::index_sequence<I...>, size_t count) { (std::get<I>(columns).reserve(count), ...); }
+public:
+    size_t size() const { return row_slots.size(); }
+    bool empty() const { return row_slots.empty(); }
+
+    // Pointer to the first element of column I, which holds one element per row. Invalidated by insert(...) and reserve(...).
+    template<size_t I> auto * column() { return std::get<I>(columns).data(); }
+    template<size_t I> const auto * column() const { return std::get<I>(columns).data(); }
+
+    soa_handle get_handle(size_t row) const { return {row_slots[row], slot_generations[row_slots[row]]}; }
+
+    // Return the current position of the row referred to by h, or std::nullopt if that row has been removed
+    std::optional<size_t> find(const soa_handle & h) const
+    {
+        if(h.slot >= slot_rows.size() || slot_generations[h.slot] != h.generation) return std::nullopt;
+        return slot_rows[h.slot];
+    }
+    bool contains(const soa_handle & h) const { return find(h).has_value(); }
+
+    void reserve(size_t count)
+    {
+        reserve_rows(std::index_sequence_for<T...>{}, count);
+        row_slots.reserve(count);
+    }
+
+    // Append a row, reusing the most recently freed slot if there is one
+    soa_handle insert(T... values)
+    {
+        uint32_t slot = first_free_slot;
+        if(slot != no_slot) first_free_slot = slot_rows[slot];
+        else
+        {
+            slot = static_cast<uint32_t>(slot_rows.size());
+            slot_rows.push_back(0);
+            slot_generations.push_back(0);
+        }
+        slot_rows[slot] = static_cast<uint32_t>(size());
+        row_slots.push_back(slot);
+        push_row(std::index_sequence_for<T...>{}, std::move(values)...);
+        return {slot, ++slot_generations[slot]};
+    }
+
+    // Remove the row at position row, moving the last row into its place
+    void erase_row(size_t row)
+    {
+        const uint32_t slot = row_slots[row];
+        const size_t last = size() - 1;
+        if(row != last)
+        {
+            move_row(std::index_sequence_for<T...>{}, last, row);
+            row_slots[row] = row_slots[last];
+            slot_rows[row_slots[row]] = static_cast<uint32_t>(row);
+        }
+        pop_row(std::index_sequence_for<T...>{});
+        row_slots.pop_back();
+
+        // Bump the generation so that existing handles to this row no longer resolve
+        ++slot_generations[slot];
+        slot_rows[slot] = first_free_slot;
+        first_free_slot = slot;
+    }
+
+    // Remove the row referred to by h, returning false if it had already been removed
+    bool erase(const soa_handle & h)
+    {
+        auto row = find(h);
+        if(!row) return false;
+        erase_row(*row);
+        return true;
+    }
+
+    // Remove every row for which f(row) returns true. Each row is visited exactly once, including rows which have been moved into the
+    // place of a removed row.
+    template<class F> void erase_rows_if(F f)
+    {
+        for(size_t row=0; row<size(); )
+        {
+            if(f(row)) erase_row(row);
+            else ++row;
+        }
+    }
+
+    void clear() { while(!empty()) erase_row(size() - 1); }
+};
+
+#endif
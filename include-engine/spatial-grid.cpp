@@ -0,0 +1,66 @@
+#include "spatial-grid.h"
+#include "thread-pool.h"
+
+spatial_grid::spatial_grid(float min_cell_size) : min_cell_size{min_cell_size}, cell_size{min_cell_size}, origin{0,0}, dims{0,0}
+{
+
+}
+
+float spatial_grid::get_ring_clearance(const float2 & p, const int2 & center, int radius, float slack) const
+{
+    // The distance from p to the nearest point outside the square of cells within radius of the center cell, less the slack
+    const float2 lo = origin + float2(center - radius) * cell_size, hi = origin + float2(center + radius + 1) * cell_size;
+    return std::min(std::min(p.x - lo.x, hi.x - p.x), std::min(p.y - lo.y, hi.y - p.y)) - slack;
+}
+
+void spatial_grid::find_pairs(float radius, std::vector<uint2> & pairs, thread_pool * threads) const
+{
+    pairs.clear();
+    if(indices.empty()) return;
+
+    // Compare each cell against the forward half of its neighborhood, so that every pair of cells is compared exactly once
+    const int reach = static_cast<int>(std::ceil(radius / cell_size));
+    const float radius2 = radius*radius;
+    auto compare_cells = [&](uint32_t a, uint32_t b, std::vector<uint2> & out)
+    {
+        for(uint32_t i=cell_starts[a]; i<cell_starts[a+1]; ++i)
+        {
+            const float x = xs[i], y = ys[i];
+            for(uint32_t j = a == b ? i+1 : cell_starts[b]; j<cell_starts[b+1]; ++j)
+            {
+                const float dx = xs[j] - x, dy = ys[j] - y;
+                if(dx*dx + dy*dy < radius2) out.push_back({std::min(indices[i], indices[j]), std::max(indices[i], indices[j])});
+            }
+        }
+    };
+    auto search_rows = [&](int y0, int y1, std::vector<uint2> & out)
+    {
+        for(int y=y0; y<y1; ++y)
+        {
+            for(int x=0; x<dims.x; ++x)
+            {
+                const uint32_t cell = y*dims.x + x;
+                if(cell_starts[cell] == cell_starts[cell+1]) continue;
+                for(int dy=0; dy<=reach && y+dy<dims.y; ++dy)
+                {
+                    for(int dx = dy ? -reach : 0; dx<=reach; ++dx)
+                    {
+                        if(x+dx < 0 || x+dx >= dims.x) continue;
+                        compare_cells(cell, cell + dy*dims.x + dx, out);
+                    }
+                }
+            }
+        }
+    };
+
+    // Sorting makes the order independent of how the rows were divided between threads
+    if(threads && threads->get_thread_count() > 1 && dims.y > 1)
+    {
+        const size_t chunk_count = std::min<size_t>(threads->get_thread_count()*4, dims.y);
+        std::vector<std::vector<uint2>> chunks(chunk_count);
+        threads->run(chunk_count, [&](size_t i) { search_rows(static_cast<int>(dims.y*i/chunk_count), static_cast<int>(dims.y*(i+1)/chunk_count), chunks[i]); });
+        for(auto & c : chunks) pairs.insert(pairs.end(), c.begin(), c.end());
+    }
+    else search_rows(0, dims.y, pairs);
+    std::sort(pairs.begin(), pairs.end(), [](const uint2 & a, const uint2 & b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+}
@@ -0,0 +1,194 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <vector>       // For std::vector<T>
+#include <optional>     // For std::optional<T>
+#include <algorithm>    // For std::upper_bound(...)
+#include <limits>       // For std::numeric_limits<T>
+#include <functional>   // For std::hash<T>, specialized by linalg.h
+#include "linalg.h"
+using namespace linalg::aliases;
+
+class thread_pool;
+
+// Indexes a set of 2D points by the cells of a uniform grid, for nearest neighbor and radius queries. The grid covers the bounds of 
+// the points, and is rebuilt from scratch with a counting sort, so that the points of each cell are contiguous. Points are identified
+// by index, and their positions are read through a function get_position(index), so that they can live in any container. Queries 
+// read the current positions of the points, which may each have moved by up to slack since the grid was built, so that a simulation
+// can move points while querying the grid without rebuilding it. Results are identical to a brute force search over the current 
+// positions, with ties between equally distant points broken in favor of the lowest index.
+class spatial_grid
+{
+    float min_cell_size, cell_size;
+    float2 origin;
+    int2 dims;
+    std::vector<uint32_t> cell_starts;  // Index into indices of the first point of each cell, with an extra entry for the end of the last cell
+    std::vector<uint32_t> indices;      // Indices of the points, sorted by cell
+    std::vector<float> xs, ys;          // Positions of the points when the grid was built, in the same order as indices
+    std::vector<uint32_t> point_cells;  // Scratch space for the cell of each point during build(...)
+
+    int2 get_cell(const float2 & p) const { return int2(floor((p - origin) / cell_size)); }
+    template<class F> void for_each_cell_in_ring(const int2 & center, int radius, F f) const;
+    float get_ring_clearance(const float2 & p, const int2 & center, int radius, float slack) const;
+    bool covers_grid(const int2 & center, int radius) const { return center.x - radius <= 0 && center.y - radius <= 0 && center.x + radius >= dims.x-1 && center.y + radius >= dims.y-1; }
+public:
+    // Cells are at least min_cell_size on a side, and grow if needed to keep the number of cells proportional to the number of points
+    explicit spatial_grid(float min_cell_size);
+
+    template<class P> void build(size_t count, P get_position);
+
+    // Return the nearest point to p for which accept(index) returns true, or std::nullopt if there is none
+    template<class P, class F> std::optional<uint32_t> find_nearest(const float2 & p, P get_position, float slack, F accept) const;
+
+    // Fill results with up to k of the nearest points to p for which accept(index) returns true, in order of increasing distance
+    template<class P, class F> void find_k_nearest(const float2 & p, size_t k, P get_position, float slack, F accept, std::vector<uint32_t> & results) const;
+
+    // Fill results with every point strictly within radius of p for which accept(index) returns true, in no particular order
+    template<class P, class F> void find_within(const float2 & p, float radius, P get_position, float slack, F accept, std::vector<uint32_t> & results) const;
+
+    // Fill pairs with every pair of points {i,j} where i < j which were strictly within radius of each other when the grid was built,
+    // sorted by i and then by j. Each cell is compared against itself and the neighboring cells ahead of it, using the positions stored 
+    // contiguously by cell. Rows of cells are searched in parallel if threads are provided, without changing the result.
+    void find_pairs(float radius, std::vector<uint2> & pairs, thread_pool * threads=nullptr) const;
+};
+
+template<class P> void spatial_grid::build(size_t count, P get_position)
+{
+    indices.resize(count);
+    point_cells.resize(count);
+    if(count == 0)
+    {
+        dims = {0,0};
+        cell_starts.assign(1, 0);
+        return;
+    }
+
+    // Points are identified by uint32_t indices, so count is assumed to fit in one. Cover the bounds of the points, with no more than a
+    // few cells per point.
+    float2 min_position = get_position(0u), max_position = get_position(0u);
+    for(uint32_t i=1; i<count; ++i)
+    {
+        min_position = min(min_position, get_position(i));
+        max_position = max(max_position, get_position(i));
+    }
+    const float2 extent = max_position - min_position;
+    const float max_cells = static_cast<float>(count*4 + 16);
+    cell_size = std::max(min_cell_size, std::sqrt(extent.x * extent.y / max_cells));
+    while((std::floor(extent.x / cell_size) + 1) * (std::floor(extent.y / cell_size) + 1) > max_cells) cell_size *= 1.5f;
+    origin = min_position;
+    dims = int2(floor(extent / cell_size)) + 1;
+
+    // Count the points in each cell, then scatter their indices into place
+    const size_t cell_count = dims.x*dims.y;
+    cell_starts.assign(cell_count + 1, 0);
+    for(uint32_t i=0; i<count; ++i)
+    {
+        const int2 cell = min(get_cell(get_position(i)), dims - 1);
+        point_cells[i] = cell.y*dims.x + cell.x;
+        ++cell_starts[point_cells[i] + 1];
+    }
+    for(size_t i=0; i<cell_count; ++i) cell_starts[i+1] += cell_starts[i];
+    for(uint32_t i=0; i<count; ++i) indices[cell_starts[point_cells[i]]++] = i;
+    xs.resize(count);
+    ys.resize(count);
+    for(size_t i=0; i<count; ++i)
+    {
+        const float2 position = get_position(indices[i]);
+        xs[i] = position.x;
+        ys[i] = position.y;
+    }
+
+    // Scattering advanced each start to the start of the next cell, so shift them back
+    for(size_t i=cell_count; i>0; --i) cell_starts[i] = cell_starts[i-1];
+    cell_starts[0] = 0;
+}
+
+template<class F> void spatial_grid::for_each_cell_in_ring(const int2 & center, int radius, F f) const
+{
+    const int y0 = std::max(center.y - radius, 0), y1 = std::min(center.y + radius, dims.y-1);
+    for(int y=y0; y<=y1; ++y)
+    {
+        const bool full_row = y == center.y - radius || y == center.y + radius;
+        const int step = full_row || radius == 0 ? 1 : radius*2;
+        for(int x=center.x - radius; x<=center.x + radius; x+=step)
+        {
+            if(x < 0 || x >= dims.x) continue;
+            const uint32_t cell = y*dims.x + x;
+            for(uint32_t i=cell_starts[cell]; i<cell_starts[cell+1]; ++i) f(indices[i]);
+        }
+    }
+}
+
+template<class P, class F> std::optional<uint32_t> spatial_grid::find_nearest(const float2 & p, P get_position, float slack, F accept) const
+{
+    if(indices.empty()) return std::nullopt;
+    std::optional<uint32_t> best;
+    float best_dist2 = std::numeric_limits<float>::infinity();
+    const int2 center = get_cell(p);
+    for(int radius=0; ; ++radius)
+    {
+        for_each_cell_in_ring(center, radius, [&](uint32_t index)
+        {
+            const float dist2 = distance2(p, get_position(index));
+            if(dist2 < best_dist2 || (dist2 == best_dist2 && best && index < *best))
+            {
+                if(!accept(index)) return;
+                best_dist2 = dist2;
+                best = index;
+            }
+        });
+
+        // Every point not yet visited is at least as far away as the clearance
+        const float clearance = get_ring_clearance(p, center, radius, slack);
+        if(best && clearance > 0 && best_dist2 < clearance*clearance) break;
+        if(covers_grid(center, radius)) break;
+    }
+    return best;
+}
+
+template<class P, class F> void spatial_grid::find_k_nearest(const float2 & p, size_t k, P get_position, float slack, F accept, std::vector<uint32_t> & results) const
+{
+    results.clear();
+    if(indices.empty() || k == 0) return;
+
+    // Keep the k best candidates found so far, sorted by distance and then by index
+    std::vector<std::pair<float, uint32_t>> best;
+    const int2 center = get_cell(p);
+    for(int radius=0; ; ++radius)
+    {
+        for_each_cell_in_ring(center, radius, [&](uint32_t index)
+        {
+            const std::pair<float, uint32_t> candidate {distance2(p, get_position(index)), index};
+            if(best.size() == k && !(candidate < best.back())) return;
+            if(!accept(index)) return;
+            if(best.size() == k) best.pop_back();
+            best.insert(std::upper_bound(best.begin(), best.end(), candidate), candidate);
+        });
+
+        const float clearance = get_ring_clearance(p, center, radius, slack);
+        if(best.size() == k && clearance > 0 && best.back().first < clearance*clearance) break;
+        if(covers_grid(center, radius)) break;
+    }
+    for(auto & b : best) results.push_back(b.second);
+}
+
+template<class P, class F> void spatial_grid::find_within(const float2 & p, float radius, P get_position, float slack, F accept, std::vector<uint32_t> & results) const
+{
+    results.clear();
+    if(indices.empty()) return;
+    const int2 min_cell = max(get_cell(p - (radius + slack)), int2(0,0)), max_cell = min(get_cell(p + (radius + slack)), dims - 1);
+    for(int y=min_cell.y; y<=max_cell.y; ++y)
+    {
+        for(int x=min_cell.x; x<=max_cell.x; ++x)
+        {
+            const uint32_t cell = y*dims.x + x;
+            for(uint32_t i=cell_starts[cell]; i<cell_starts[cell+1]; ++i)
+            {
+                const uint32_t index = indices[i];
+                if(distance2(p, get_position(index)) < radius*radius && accept(index)) results.push_back(index);
+            }
+        }
+    }
+}
+
+#endif
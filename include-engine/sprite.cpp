@@ -1,62 +1,100 @@
 #include "sprite.h"
+#include "distance-field.h"
 
 //////////////////
 // sprite_sheet //
 //////////////////
 
+sprite_sheet::sprite_sheet(int2 page_dims, size_t max_page_count) : page_dims{page_dims}, max_page_count{max_page_count}
+{
+    if(max_page_count == 0) throw std::logic_error("sprite_sheet requires at least one page");
+}
+
 size_t sprite_sheet::add_sprite(image img, int border)
 {
-    const size_t index = sprites.size();
-    sprites.push_back({std::move(img), border});
-    return index;
+    if(img.get_width() > page_dims.x || img.get_height() > page_dims.y) throw std::runtime_error("sprite is larger than a sprite_sheet page");
+
+    // Place the sprite on the first page with room for it, starting a new page if none has room
+    std::optional<int2> position;
+    uint32_t page = 0;
+    for(; page<packers.size(); ++page) if(packers[page] && (position = packers[page]->insert({img.get_width(), img.get_height()}))) break;
+    if(!position)
+    {
+        page = create_page();
+        packers[page].emplace(page_dims);
+        position = packers[page]->insert({img.get_width(), img.get_height()});
+    }
+    write_region(page, *position, img);
+
+    sprite s {std::move(img), border, page};
+    s.s0 = static_cast<float>(position->x+s.border)/page_dims.x;
+    s.t0 = static_cast<float>(position->y+s.border)/page_dims.y;
+    s.s1 = static_cast<float>(position->x+s.img.get_width()-s.border)/page_dims.x;
+    s.t1 = static_cast<float>(position->y+s.img.get_height()-s.border)/page_dims.y;
+    sprites.push_back(std::move(s));
+    return sprites.size()-1;
 }
 
-void sprite_sheet::prepare_sheet()
+uint32_t sprite_sheet::create_page()
 {
-    // Sort glyphs by descending height, then descending width
-    std::vector<sprite *> sorted_sprites;
-    for(auto & g : sprites) sorted_sprites.push_back(&g);
-    std::sort(begin(sorted_sprites), end(sorted_sprites), [](const sprite * a, const sprite * b)
+    if(pages.size() == max_page_count) throw std::runtime_error("sprite_sheet has no pages left");
+    pages.emplace_back(page_dims, VK_FORMAT_R8_UNORM);
+    memset(pages.back().get_pixels(), 0, compute_image_size(page_dims, VK_FORMAT_R8_UNORM));
+    packers.emplace_back();
+    dirty_rects.push_back({0,0,0,0});
+    return static_cast<uint32_t>(pages.size()-1);
+}
+
+uint32_t sprite_sheet::add_page()
+{
+    return create_page();
+}
+
+void sprite_sheet::write_region(uint32_t page, int2 offset, const image & contents)
+{
+    if(offset.x < 0 || offset.y < 0 || offset.x + contents.get_width() > page_dims.x || offset.y + contents.get_height() > page_dims.y) throw std::logic_error("sprite_sheet::write_region(...) must write within a page");
+    if(contents.get_width() == 0 || contents.get_height() == 0) return;
+
+    auto & sheet = pages[page];
+    for(int i=0; i<contents.get_height(); ++i)
     {
-        return std::make_tuple(a->img.get_height(), a->img.get_width()) > std::make_tuple(b->img.get_height(), b->img.get_width());
-    });
+        memcpy(sheet.get_pixels()+sheet.get_width()*(offset.y+i)+offset.x, contents.get_pixels()+contents.get_width()*i, contents.get_width());
+    }
+    auto & dirty = dirty_rects[page];
+    if(dirty.x0 >= dirty.x1) dirty = {offset.x, offset.y, offset.x+contents.get_width(), offset.y+contents.get_height()};
+    else dirty = {std::min(dirty.x0, offset.x), std::min(dirty.y0, offset.y), std::max(dirty.x1, offset.x+contents.get_width()), std::max(dirty.y1, offset.y+contents.get_height())};
+}
 
-    int2 tex_dims = {64, 64};
-    while(true)
+void sprite_sheet::update_texture(renderer & r)
+{
+    if(!atlas)
     {
-        sheet = image{tex_dims, VK_FORMAT_R8_UNORM};
-        memset(sheet.get_pixels(), 0, sheet.get_width()*sheet.get_height());
-        bool bad_pack = false;
-        int2 used {0, 0};
-        int next_y = 0;
-        for(auto * s : sorted_sprites)
+        // Layers beyond the current pages start out blank, as new pages do, so they only need their written regions uploaded
+        const size_t page_size = compute_image_size(page_dims, VK_FORMAT_R8_UNORM);
+        std::vector<image> layers;
+        for(size_t i=0; i<max_page_count; ++i)
         {
-            if(used.x + s->img.get_width() > sheet.get_width()) used = {0, next_y};
-            if(used.x + s->img.get_width() > sheet.get_width() || used.y + s->img.get_height() > sheet.get_height()) 
-            {
-                bad_pack = true;
-                break;
-            }
-
-            s->s0 = static_cast<float>(used.x+s->border)/sheet.get_width();
-            s->t0 = static_cast<float>(used.y+s->border)/sheet.get_height();
-            s->s1 = static_cast<float>(used.x+s->img.get_width()-s->border)/sheet.get_width();
-            s->t1 = static_cast<float>(used.y+s->img.get_height()-s->border)/sheet.get_height();
-
-            for(int i=0; i<s->img.get_height(); ++i)
-            {
-                memcpy(sheet.get_pixels()+sheet.get_width()*(used.y+i)+used.x, s->img.get_pixels()+s->img.get_width()*i, s->img.get_width());
-            }
-
-            used.x += s->img.get_width();
-            next_y = std::max(next_y, used.y + s->img.get_height());
+            layers.emplace_back(page_dims, VK_FORMAT_R8_UNORM);
+            if(i < pages.size()) memcpy(layers[i].get_pixels(), pages[i].get_pixels(), page_size);
+            else memset(layers[i].get_pixels(), 0, page_size);
         }
-        if(bad_pack)
+        atlas = r.create_texture_2d_array(layers);
+        for(auto & dirty : dirty_rects) dirty = {0,0,0,0};
+        return;
+    }
+
+    // Upload only the bounds of the sprites added to each page
+    for(size_t page=0; page<pages.size(); ++page)
+    {
+        auto & dirty = dirty_rects[page];
+        if(dirty.x0 >= dirty.x1) continue;
+        image region {dirty.dims(), VK_FORMAT_R8_UNORM};
+        for(int i=0; i<region.get_height(); ++i)
         {
-            if(tex_dims.x == tex_dims.y) tex_dims.x *= 2;
-            else tex_dims.y *= 2;
+            memcpy(region.get_pixels()+region.get_width()*i, pages[page].get_pixels()+page_dims.x*(dirty.y0+i)+dirty.x0, region.get_width());
         }
-        else break;
+        atlas->update_region(static_cast<uint32_t>(page), {dirty.x0, dirty.y0}, region);
+        dirty = {0,0,0,0};
     }
 }
 
@@ -138,43 +176,116 @@ gui_sprites::gui_sprites(sprite_sheet & sheet) : sheet{sheet}
 // gui_context //
 /////////////////
 
-gui_context::gui_context(gui_sprites & sprites, draw_list & list, const uint2 & dims) : sprites{sprites}, list{list}, dims{dims} 
+gui_context::gui_context(gui_sprites & sprites, draw_list & list, const uint2 & dims, gui_panel_cache * cache) : sprites{sprites}, list{list}, dims{dims}, cache{cache}
 {
 
 }
 
 void gui_context::begin_frame()
 {
-    list.begin_vertices();
-    list.begin_indices();
+    list.begin_instances();
     num_quads = 0;
+    clip_stack = {{0, 0, static_cast<int>(dims.x), static_cast<int>(dims.y)}};
+    batches = {{clip_stack.back(), 0}};
+    if(!cache) return;
+    for(auto it = cache->panels.begin(); it != cache->panels.end(); )
+    {
+        if(it->second.used) (it++)->second.used = false;
+        else it = cache->panels.erase(it);
+    }
 }
 
-void gui_context::draw_sprite(const rect & r, float s0, float t0, float s1, float t1, const float4 & color)
+bool gui_context::begin_panel(size_t id, size_t input_hash)
 {
-    const float fx0 = r.x0*2.0f/dims.x-1;
-    const float fy0 = r.y0*2.0f/dims.y-1;
-    const float fx1 = r.x1*2.0f/dims.x-1;
-    const float fy1 = r.y1*2.0f/dims.y-1;
-    list.write_vertex(image_vertex{{fx0,fy0},{s0,t0},color});
-    list.write_vertex(image_vertex{{fx0,fy1},{s0,t1},color});
-    list.write_vertex(image_vertex{{fx1,fy1},{s1,t1},color});
-    list.write_vertex(image_vertex{{fx1,fy0},{s1,t0},color});
-    list.write_indices(num_quads*4+uint3{0,1,2});
-    list.write_indices(num_quads*4+uint3{0,2,3});
+    if(recording) throw std::logic_error("gui_context::begin_panel(...) called without matching end_panel()");
+    if(!cache) return true;
+
+    auto & p = cache->panels[id];
+    if(p.used) throw std::logic_error("gui panel drawn twice in one frame");
+    p.used = true;
+    if(p.input_hash == input_hash && !p.quads.empty())
+    {
+        // Replay the panel's changes of clip rect between the runs of quads they apply to
+        size_t written = 0;
+        auto write_quads = [&](size_t end)
+        {
+            list.write_instances(p.quads.data() + written, end - written);
+            num_quads += narrow(end - written);
+            written = end;
+        };
+        for(auto & [first_quad, clip] : p.clips)
+        {
+            write_quads(first_quad);
+            set_clip(clip);
+        }
+        write_quads(p.quads.size());
+        set_clip(get_clip());
+        for(auto & [font, sheet_pages] : p.font_pages) font->touch_pages(sheet_pages);
+        return false;
+    }
+
+    p.input_hash = input_hash;
+    p.quads.clear();
+    p.clips.clear();
+    p.font_pages.clear();
+    recording = &p;
+    recording_clip_depth = clip_stack.size();
+    return true;
+}
+
+void gui_context::end_panel()
+{
+    if(recording && clip_stack.size() != recording_clip_depth) throw std::logic_error("gui panel ended with unmatched push_clip(...)");
+    recording = nullptr;
+}
+
+void gui_context::push_clip(const rect & r)
+{
+    clip_stack.push_back(r.intersected(get_clip()));
+    set_clip(get_clip());
+}
+
+void gui_context::pop_clip()
+{
+    if(clip_stack.size() < 2) throw std::logic_error("gui_context::pop_clip() called without matching push_clip(...)");
+    clip_stack.pop_back();
+    set_clip(get_clip());
+}
+
+void gui_context::set_clip(const rect & r)
+{
+    if(recording) recording->clips.push_back({recording->quads.size(), r});
+    if(batches.back().first_quad == num_quads) batches.back().clip = r;
+    else if(batches.back().clip != r) batches.push_back({r, num_quads});
+}
+
+static int16_t pack_coord(int x) { return static_cast<int16_t>(std::max(-32768, std::min(x, 32767))); }
+static uint16_t pack_unorm16(float x) { return static_cast<uint16_t>(std::max(0.0f, std::min(x, 1.0f)) * 65535 + 0.5f); }
+static uint8_t pack_unorm8(float x) { return static_cast<uint8_t>(std::max(0.0f, std::min(x, 1.0f)) * 255 + 0.5f); }
+
+void gui_context::draw_sprite(const rect & r, uint32_t page, float s0, float t0, float s1, float t1, const float4 & color, uint16_t flags)
+{
+    if(!is_visible(r)) return;
+    auto & quad = *list.reserve_instances<gui_quad>(1);
+    quad.page = narrow(page);
+    quad.flags = flags;
+    quad.rect = {pack_coord(r.x0), pack_coord(r.y0), pack_coord(r.x1), pack_coord(r.y1)};
+    quad.texcoords = {pack_unorm16(s0), pack_unorm16(t0), pack_unorm16(s1), pack_unorm16(t1)};
+    quad.color = {pack_unorm8(color.x), pack_unorm8(color.y), pack_unorm8(color.z), pack_unorm8(color.w)};
+    if(recording) recording->quads.push_back(quad);
     ++num_quads;
 }
 
 void gui_context::draw_sprite_sheet(const int2 & p)
 {
-    draw_sprite({p.x,p.y,p.x+sprites.sheet.sheet.get_width(),p.y+sprites.sheet.sheet.get_height()}, 0, 0, 1, 1, {1,1,1,1});
+    draw_sprite({p.x,p.y,p.x+sprites.sheet.get_page_dims().x,p.y+sprites.sheet.get_page_dims().y}, 0, 0, 0, 1, 1, {1,1,1,1});
 }
 
 void gui_context::draw_rect(const rect & r, const float4 & color)
 {
     const auto & solid = sprites.sheet.sprites[sprites.solid_pixel];
     const float s = (solid.s0 + solid.s1)/2, t = (solid.t0 + solid.t1)/2;
-    draw_sprite(r, s, t, s, t, color);
+    draw_sprite(r, solid.page, s, t, s, t, color);
 }
 
 void gui_context::draw_rounded_rect(rect r, int radius, const float4 & color)
@@ -191,73 +302,271 @@ void gui_context::draw_partial_rounded_rect(rect r, int radius, const float4 & c
     if(tl || tr)
     {
         rect r2 = r.take_y0(radius);
-        if(tl) draw_sprite(r2.take_x0(radius), sprite.s1, sprite.t1, sprite.s0, sprite.t0, color);    
-        if(tr) draw_sprite(r2.take_x1(radius), sprite.s0, sprite.t1, sprite.s1, sprite.t0, color);
+        if(tl) draw_sprite(r2.take_x0(radius), sprite.page, sprite.s1, sprite.t1, sprite.s0, sprite.t0, color);    
+        if(tr) draw_sprite(r2.take_x1(radius), sprite.page, sprite.s0, sprite.t1, sprite.s1, sprite.t0, color);
         draw_rect(r2, color);
     }
 
     if(bl || br)
     {
         rect r2 = r.take_y1(radius);
-        if(bl) draw_sprite(r2.take_x0(radius), sprite.s1, sprite.t0, sprite.s0, sprite.t1, color);
-        if(br) draw_sprite(r2.take_x1(radius), sprite.s0, sprite.t0, sprite.s1, sprite.t1, color);
+        if(bl) draw_sprite(r2.take_x0(radius), sprite.page, sprite.s1, sprite.t0, sprite.s0, sprite.t1, color);
+        if(br) draw_sprite(r2.take_x1(radius), sprite.page, sprite.s0, sprite.t0, sprite.s1, sprite.t1, color);
         draw_rect(r2, color);
     }
 
     draw_rect(r, color);
 }
 
-void gui_context::draw_text(const font_face & font, const float4 & color, int x, int y, std::string_view text)
+void gui_context::draw_glyphs(font_face & font, const float4 & color, int x, int y, std::string_view text, float scale, uint16_t flags)
 {
-    for(auto ch : text)
+    if(font.get_rendering() == glyph_rendering::signed_distance) flags |= gui_quad::signed_distance;
+    std::vector<uint32_t> * sheet_pages = nullptr;
+    if(recording)
     {
-        auto it = font.glyphs.find(ch);
-        if(it == font.glyphs.end()) continue;
-        auto & b = it->second;
-        auto & s = font.sheet.sprites[b.sprite_index];
-        const int x0 = x + b.offset.x, y0 = y + b.offset.y, x1 = x0 + s.img.get_width(), y1 = y0 + s.img.get_height();
-        draw_sprite({x0+s.border, y0+s.border, x1-s.border, y1-s.border}, s.s0, s.t0, s.s1, s.t1, color);
-        x += b.advance;
+        auto it = std::find_if(recording->font_pages.begin(), recording->font_pages.end(), [&](const auto & fp) { return fp.first == &font; });
+        sheet_pages = &(it != recording->font_pages.end() ? *it : recording->font_pages.emplace_back(&font, std::vector<uint32_t>{})).second;
     }
+    font.layout_text(text, [&](const glyph_info & g, float pen_x)
+    {
+        if(!g.is_resident || g.dims.x == 0 || g.dims.y == 0) return;
+        if(sheet_pages && std::find(sheet_pages->begin(), sheet_pages->end(), g.page) == sheet_pages->end()) sheet_pages->push_back(g.page);
+        const float x0 = x + (pen_x + g.offset.x) * scale, y0 = y + g.offset.y * scale;
+        const rect r {static_cast<int>(std::round(x0)), static_cast<int>(std::round(y0)), static_cast<int>(std::round(x0 + g.dims.x * scale)), static_cast<int>(std::round(y0 + g.dims.y * scale))};
+        draw_sprite(r, g.page, g.s0, g.t0, g.s1, g.t1, color, flags);
+    });
+}
+
+void gui_context::draw_text(font_face & font, const float4 & color, int x, int y, std::string_view text, float scale)
+{
+    draw_glyphs(font, color, x, y, text, scale, 0);
 }
 
-void gui_context::draw_shadowed_text(const font_face & font, const float4 & color, int x, int y, std::string_view text)
+void gui_context::draw_shadowed_text(font_face & font, const float4 & color, int x, int y, std::string_view text, float scale)
 {
-    draw_text(font,{0,0,0,color.w},x+1,y+1,text);
-    draw_text(font,color,x,y,text);
+    // Signed distance fields have room around each glyph to draw its shadow within the same quad
+    if(font.get_rendering() == glyph_rendering::signed_distance) return draw_glyphs(font, color, x, y, text, scale, gui_quad::shadow);
+    draw_text(font,{0,0,0,color.w},x+1,y+1,text,scale);
+    draw_text(font,color,x,y,text,scale);
 }
 
 void gui_context::end_frame(const scene_material & mtl, const sampler & samp)
 {
-    auto vertex_info = list.end_vertices();
+    auto instance_info = list.end_instances();
+
+    // The corners of the unit quad are derived from the vertex index, so only its indices are needed
+    list.begin_indices();
+    list.write_indices(uint3{0,1,2});
+    list.write_indices(uint3{0,2,3});
     auto index_info = list.end_indices();
+
     auto desc = list.descriptor_set(mtl);
-    desc.write_combined_image_sampler(0, 0, samp, *sprites.sheet.texture);
-    list.draw(desc, {vertex_info}, index_info, num_quads*6, 1);
+    desc.write_combined_image_sampler(0, 0, samp, *sprites.sheet.get_texture());
+    desc.write_uniform_buffer(1, 0, list.upload_uniforms(float2(dims)));
+
+    // Draw each batch from its own range of the instance buffer, with its clip rect as the scissor rect
+    for(size_t i=0; i<batches.size(); ++i)
+    {
+        const auto & b = batches[i];
+        const uint32_t end_quad = i+1 < batches.size() ? batches[i+1].first_quad : num_quads;
+        const rect clip = b.clip.intersected({0, 0, static_cast<int>(dims.x), static_cast<int>(dims.y)});
+        if(end_quad == b.first_quad || clip.width() == 0 || clip.height() == 0) continue;
+        list.set_scissor({{clip.x0, clip.y0}, {static_cast<uint32_t>(clip.width()), static_cast<uint32_t>(clip.height())}});
+        list.draw(desc, {{instance_info.buffer, instance_info.offset + b.first_quad*sizeof(gui_quad), (end_quad - b.first_quad)*sizeof(gui_quad)}}, index_info, 6, end_quad - b.first_quad);
+    }
+    list.set_scissor({});
 }
 
+///////////////
+// font_face //
+///////////////
+
 #define STB_TRUETYPE_IMPLEMENTATION
 #include <stb_truetype.h>
 
-font_face::font_face(sprite_sheet & sheet, const char * filepath, float pixel_height) : sheet{sheet}
+// Signed distance fields are computed from coverage rasterized at a higher resolution, and extend a few texels beyond each glyph
+static const int sdf_oversample = 4, sdf_spread = 4;
+
+font_face::font_face(sprite_sheet & sheet, const char * filepath, float pixel_height, size_t page_count, glyph_rendering rendering) : 
+    sheet{sheet}, data{load_binary_file(filepath)}, info{std::make_unique<stbtt_fontinfo>()}, rendering{rendering}
+{
+    if(!stbtt_InitFont(info.get(), data.data(), 0)) throw std::runtime_error("stbtt_InitFont(...) failed");
+    scale = stbtt_ScaleForPixelHeight(info.get(), pixel_height);
+    for(size_t i=0; i<page_count; ++i) pages.push_back({sheet.add_page(), skyline_packer{sheet.get_page_dims()}, 0});
+
+    for(uint32_t ch=0; ch<128; ++ch) ascii_glyphs[ch] = add_glyph(ch);
+    for(uint32_t ch=0; ch<128; ++ch) if(isprint(ch)) get_glyph(ch);
+    update();
+}
+
+font_face::~font_face()
+{
+
+}
+
+uint32_t font_face::add_glyph(uint32_t codepoint)
+{
+    glyph_entry g {};
+    g.glyph_index = stbtt_FindGlyphIndex(info.get(), codepoint);
+    int advance, lsb, x0, y0, x1, y1;
+    stbtt_GetGlyphHMetrics(info.get(), g.glyph_index, &advance, &lsb);
+    if(rendering == glyph_rendering::signed_distance)
+    {
+        // Align the oversampled bitmap to the texels of the field, with room for the spread on every side
+        stbtt_GetGlyphBitmapBox(info.get(), g.glyph_index, scale*sdf_oversample, scale*sdf_oversample, &x0, &y0, &x1, &y1);
+        if(x0 < x1 && y0 < y1)
+        {
+            const int2 min_texel = int2(floor(float2(x0, y0) / float(sdf_oversample))) - sdf_spread, max_texel = int2(ceil(float2(x1, y1) / float(sdf_oversample))) + sdf_spread;
+            g.info.offset = min_texel;
+            g.info.dims = max_texel - min_texel;
+            g.raster_offset = int2{x0, y0} - min_texel * sdf_oversample;
+            g.raster_dims = {x1-x0, y1-y0};
+        }
+    }
+    else
+    {
+        stbtt_GetGlyphBitmapBox(info.get(), g.glyph_index, scale, scale, &x0, &y0, &x1, &y1);
+        g.info.offset = {x0, y0};
+        g.info.dims = {x1-x0, y1-y0};
+    }
+    g.info.advance = static_cast<int>(std::round(scale * advance));
+    glyphs.push_back(g);
+    return static_cast<uint32_t>(glyphs.size()-1);
+}
+
+uint32_t font_face::find_glyph(uint32_t codepoint)
+{
+    if(codepoint < ascii_glyphs.size()) return ascii_glyphs[codepoint];
+    auto it = other_glyphs.find(codepoint);
+    if(it == other_glyphs.end()) it = other_glyphs.emplace(codepoint, add_glyph(codepoint)).first;
+    return it->second;
+}
+
+const glyph_info & font_face::get_glyph(uint32_t codepoint)
+{
+    return use_glyph(find_glyph(codepoint));
+}
+
+const glyph_info & font_face::use_glyph(uint32_t index)
+{
+    auto & g = glyphs[index];
+    if(g.info.is_resident) pages[g.font_page].last_used_frame = frame;
+    else if(!g.is_pending)
+    {
+        g.is_pending = true;
+        pending_glyphs.push_back(index);
+    }
+    return g.info;
+}
+
+void font_face::touch_pages(const std::vector<uint32_t> & sheet_pages)
+{
+    for(auto & p : pages) if(std::find(sheet_pages.begin(), sheet_pages.end(), p.sheet_page) != sheet_pages.end()) p.last_used_frame = frame;
+}
+
+const font_face::text_run & font_face::get_run(std::string_view text)
+{
+    // Runs hold glyph indices rather than bitmaps, so they remain valid when glyphs are evicted and rasterized again
+    auto & run = runs[std::hash<std::string_view>{}(text)];
+    run.used = true;
+    if(run.text == text) return run;
+
+    run.text = text;
+    run.glyphs.clear();
+    run.pen_x.clear();
+    float pen = 0;
+    for(int prev_glyph_index = 0; !text.empty(); )
+    {
+        const uint32_t index = find_glyph(decode_utf8(text));
+        const auto & g = glyphs[index];
+        if(prev_glyph_index && g.glyph_index) pen += scale * stbtt_GetGlyphKernAdvance(info.get(), prev_glyph_index, g.glyph_index);
+        run.glyphs.push_back(index);
+        run.pen_x.push_back(pen);
+        pen += g.info.advance;
+        prev_glyph_index = g.glyph_index;
+    }
+    run.advance = pen;
+    return run;
+}
+
+void font_face::update(thread_pool * threads)
+{
+    ++frame;
+    for(auto it = runs.begin(); it != runs.end(); )
+    {
+        if(it->second.used) (it++)->second.used = false;
+        else it = runs.erase(it);
+    }
+    if(pending_glyphs.empty()) return;
+
+    // Glyphs are rasterized independently, and then placed in request order, so that the result does not depend on threading
+    std::vector<image> bitmaps(pending_glyphs.size());
+    auto rasterize = [&](size_t i)
+    {
+        auto & g = glyphs[pending_glyphs[i]];
+        bitmaps[i] = image{g.info.dims, VK_FORMAT_R8_UNORM};
+        if(g.info.dims.x == 0 || g.info.dims.y == 0) return;
+        if(rendering == glyph_rendering::signed_distance)
+        {
+            const int2 dims = g.info.dims * sdf_oversample;
+            std::vector<uint8_t> coverage(product(dims));
+            stbtt_MakeGlyphBitmap(info.get(), coverage.data() + g.raster_offset.y*dims.x + g.raster_offset.x, g.raster_dims.x, g.raster_dims.y, dims.x, scale*sdf_oversample, scale*sdf_oversample, g.glyph_index);
+            const auto field = compute_signed_distance_field(coverage.data(), dims, sdf_oversample, sdf_spread);
+            memcpy(bitmaps[i].get_pixels(), field.data(), field.size());
+        }
+        else stbtt_MakeGlyphBitmap(info.get(), reinterpret_cast<uint8_t *>(bitmaps[i].get_pixels()), g.info.dims.x, g.info.dims.y, g.info.dims.x, scale, scale, g.glyph_index);
+    };
+    if(threads) threads->run(pending_glyphs.size(), rasterize);
+    else for(size_t i=0; i<pending_glyphs.size(); ++i) rasterize(i);
+
+    for(size_t i=0; i<pending_glyphs.size(); ++i) place_glyph(glyphs[pending_glyphs[i]], bitmaps[i]);
+    pending_glyphs.clear();
+    ++generation;
+}
+
+void font_face::place_glyph(glyph_entry & glyph, const image & bitmap)
 {
-    auto data = load_binary_file(filepath);
-    stbtt_fontinfo f {};
-    if(!stbtt_InitFont(&f, data.data(), 0)) throw std::runtime_error("stbtt_InitFont(...) failed");
-    const float scale = stbtt_ScaleForPixelHeight(&f, pixel_height);
+    glyph.is_pending = false;
+    if(bitmap.get_width() == 0 || bitmap.get_height() == 0)
+    {
+        glyph.info.is_resident = true;
+        return;
+    }
 
-    for(int ch=0; ch<128; ++ch)
+    // Try every page, then claim another page of the sheet while one is available, then evict the least recently used page
+    std::optional<int2> position;
+    size_t page = 0;
+    for(; page<pages.size(); ++page) if((position = pages[page].packer.insert({bitmap.get_width(), bitmap.get_height()}))) break;
+    if(!position)
     {
-        if(!isprint(ch)) continue;
-        const int g = stbtt_FindGlyphIndex(&f, ch);
-        int advance, lsb, x0, y0, x1, y1;
-        stbtt_GetGlyphHMetrics(&f, g, &advance, &lsb);
-        stbtt_GetGlyphBitmapBox(&f, g, scale, scale, &x0, &y0, &x1, &y1);
-
-        image img{{x1-x0, y1-y0}, VK_FORMAT_R8_UNORM};
-        stbtt_MakeGlyphBitmap(&f, reinterpret_cast<uint8_t *>(img.get_pixels()), img.get_width(), img.get_height(), img.get_width(), scale, scale, g);
-        glyphs[ch].sprite_index = sheet.add_sprite(std::move(img), 0);
-        glyphs[ch].offset = {x0,y0};
-        glyphs[ch].advance = static_cast<int>(std::round(scale * advance));
+        if(sheet.get_page_count() < sheet.get_max_page_count())
+        {
+            page = pages.size();
+            pages.push_back({sheet.add_page(), skyline_packer{sheet.get_page_dims()}, frame});
+        }
+        else
+        {
+            // Evicting a page which was drawn from during the previous frame, or written during this update, would only thrash it
+            page = std::min_element(pages.begin(), pages.end(), [](const font_page & a, const font_page & b) { return a.last_used_frame < b.last_used_frame; }) - pages.begin();
+            if(pages[page].last_used_frame + 1 >= frame) return; // The glyph stays non-resident, and will be requested again on a later frame
+            for(auto & g : glyphs) if(g.info.is_resident && g.font_page == page && g.info.dims.x > 0 && g.info.dims.y > 0) g.info.is_resident = false;
+            pages[page].packer = skyline_packer{sheet.get_page_dims()};
+            image blank {sheet.get_page_dims(), VK_FORMAT_R8_UNORM};
+            memset(blank.get_pixels(), 0, compute_image_size(sheet.get_page_dims(), VK_FORMAT_R8_UNORM));
+            sheet.write_region(pages[page].sheet_page, {0,0}, blank);
+        }
+        position = pages[page].packer.insert({bitmap.get_width(), bitmap.get_height()});
+        if(!position) throw std::runtime_error("glyph is larger than a sprite_sheet page");
     }
-}
\ No newline at end of file
+
+    sheet.write_region(pages[page].sheet_page, *position, bitmap);
+    const float2 page_dims {sheet.get_page_dims()};
+    glyph.info.is_resident = true;
+    glyph.info.page = pages[page].sheet_page;
+    glyph.font_page = page;
+    glyph.info.s0 = position->x / page_dims.x;
+    glyph.info.t0 = position->y / page_dims.y;
+    glyph.info.s1 = (position->x + bitmap.get_width()) / page_dims.x;
+    glyph.info.t1 = (position->y + bitmap.get_height()) / page_dims.y;
+    pages[page].last_used_frame = frame;
+}
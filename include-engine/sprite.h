@@ -2,6 +2,12 @@
 #define SPRITE_H
 
 #include "renderer.h"
+#include "skyline-packer.h"
+#include <unordered_map>
+#include <array>
+#include <deque>
+
+struct stbtt_fontinfo;
 
 struct rect 
 { 
@@ -13,6 +19,10 @@ struct rect
     float aspect_ratio() const { return (float)width()/height(); }
 
     rect adjusted(int dx0, int dy0, int dx1, int dy1) const { return {x0+dx0, y0+dy0, x1+dx1, y1+dy1}; }
+    rect intersected(const rect & r) const { return {std::max(x0, r.x0), std::max(y0, r.y0), std::max(std::max(x0, r.x0), std::min(x1, r.x1)), std::max(std::max(y0, r.y0), std::min(y1, r.y1))}; }
+    bool intersects(const rect & r) const { return x0 < r.x1 && r.x0 < x1 && y0 < r.y1 && r.y0 < y1; }
+    bool operator == (const rect & r) const { return x0 == r.x0 && y0 == r.y0 && x1 == r.x1 && y1 == r.y1; }
+    bool operator != (const rect & r) const { return !(*this == r); }
 
     rect take_x0(int x) { rect r {x0, y0, x0+x, y1}; x0 = r.x1; return r; }
     rect take_x1(int x) { rect r {x1-x, y0, x1, y1}; x1 = r.x0; return r; }
@@ -20,36 +30,138 @@ struct rect
     rect take_y1(int y) { rect r {x0, y1-y, x1, y1}; y1 = r.y0; return r; }
 };
 
-// sprite_sheet is a simple class which packs a collection of 2D images into a single atlas texture
+// sprite_sheet packs a collection of 2D images into the pages of an atlas texture. Sprites may be added at any time, and are placed 
+// by a skyline packer without moving earlier sprites, so that only the regions covered by new sprites need to be uploaded. The atlas
+// has a fixed number of layers, allocated on first upload, so that it is never recreated while earlier frames may still be using it.
 struct sprite
 {
     image img;              // The contents of the sprite
     int border;             // Number of pixels from the edge of the image which are not considered part of the sprite (but should be copied to the atlas anyway)
-    float s0, t0, s1, t1;   // The subrect of this sprite within the texture atlas
+    uint32_t page;          // The page of the atlas containing this sprite, which is the layer of the atlas texture
+    float s0, t0, s1, t1;   // The subrect of this sprite within its page
 };
-struct sprite_sheet
+class sprite_sheet
 {
-    image sheet;
-    std::shared_ptr<texture> texture;
+    int2 page_dims;
+    std::vector<image> pages;
+    std::vector<std::optional<skyline_packer>> packers; // Empty for pages reserved by add_page()
+    std::vector<rect> dirty_rects; // The region of each page written since it was last uploaded, empty if x0 >= x1
+
+    size_t max_page_count;
+    std::shared_ptr<texture> atlas;
+
+    uint32_t create_page();
+public:
     std::vector<sprite> sprites;
 
+    // Pages can be added up to max_page_count, beyond which adding a page throws
+    explicit sprite_sheet(int2 page_dims={512,512}, size_t max_page_count=8);
+
+    int2 get_page_dims() const { return page_dims; }
+    size_t get_page_count() const { return pages.size(); }
+    size_t get_max_page_count() const { return max_page_count; }
+    const image & get_page(size_t index) const { return pages[index]; }
+
+    // The atlas is a 2D array texture with max_page_count layers, where layer i holds page i
+    const std::shared_ptr<texture> & get_texture() const { return atlas; }
+
     size_t add_sprite(image img, int border);
-    void prepare_sheet();
+
+    // Reserve a page which add_sprite(...) will not use, for the caller to manage with write_region(...)
+    uint32_t add_page();
+    void write_region(uint32_t page, int2 offset, const image & contents);
+
+    // Upload the region of each page written since the last call, creating the atlas on the first call. Call before drawing any 
+    // sprites added since the last call.
+    void update_texture(renderer & r);
 };
 
-// font_face rasterizes a collection of text glyphs into a sprite_sheet
+// font_face rasterizes the glyphs of a TrueType font into pages of a sprite_sheet on first use. Glyphs can be rasterized either as
+// coverage, which looks best when drawn at the pixel height of the font, or as signed distance fields, which can be drawn sharply 
+// at any scale, and support shadows without further draws. Metrics are available immediately, while bitmaps of glyphs first 
+// requested during a frame are rasterized by the next call to update(...). When every page is full, the font claims another page 
+// of the sheet while one is available, and otherwise clears the least recently used page for reuse. If that page was drawn from 
+// during the previous frame, the new glyph is left out until a later frame instead. get_generation() changes whenever glyphs are 
+// added or evicted, and cached quads which were generated from an earlier generation should be regenerated. Strings are laid out 
+// into runs of kerned glyph positions, which are cached by their text, so that drawing the same string again skips decoding, glyph 
+// lookups and kerning.
+enum class glyph_rendering { coverage, signed_distance };
 struct glyph_info
 {
-    size_t sprite_index;
-    int2 offset;
+    int2 offset, dims;          // The rect of the glyph bitmap relative to the pen position
     int advance;
+    bool is_resident;           // True if the bitmap is in the sprite_sheet and can be drawn
+    uint32_t page;              // The page of the sprite_sheet containing the bitmap
+    float s0, t0, s1, t1;
 };
-struct font_face
+class font_face
 {
+    struct glyph_entry
+    {
+        glyph_info info;
+        int glyph_index;
+        int2 raster_offset, raster_dims; // Where the glyph is rasterized within a signed distance field's oversampled coverage bitmap
+        size_t font_page;
+        bool is_pending;
+    };
+    struct text_run
+    {
+        std::string text;
+        std::vector<uint32_t> glyphs;   // Index into glyphs
+        std::vector<float> pen_x;       // The pen position of each glyph relative to the start of the run, including kerning
+        float advance;
+        bool used;
+    };
+    struct font_page
+    {
+        uint32_t sheet_page;
+        skyline_packer packer;
+        uint64_t last_used_frame;
+    };
+
     sprite_sheet & sheet;
-    std::map<int, glyph_info> glyphs;
+    std::vector<uint8_t> data;
+    std::unique_ptr<stbtt_fontinfo> info;
+    float scale;
+    glyph_rendering rendering;
+    std::deque<glyph_entry> glyphs;                         // A deque, so that references returned by get_glyph(...) stay valid
+    std::array<uint32_t, 128> ascii_glyphs;                 // Direct-mapped index into glyphs for the ASCII range
+    std::unordered_map<uint32_t, uint32_t> other_glyphs;    // Index into glyphs for every other code point requested so far
+    std::vector<uint32_t> pending_glyphs;
+    std::vector<font_page> pages;
+    std::unordered_map<size_t, text_run> runs;              // Keyed by the hash of their text
+    uint64_t frame {}, generation {};
+
+    uint32_t add_glyph(uint32_t codepoint);
+    uint32_t find_glyph(uint32_t codepoint);
+    const glyph_info & use_glyph(uint32_t index);
+    const text_run & get_run(std::string_view text);
+    void place_glyph(glyph_entry & glyph, const image & bitmap);
+public:
+    // The font claims page_count pages of the sheet up front, and the printable ASCII range is rasterized immediately
+    font_face(sprite_sheet & sheet, const char * filepath, float pixel_height, size_t page_count=1, glyph_rendering rendering=glyph_rendering::coverage);
+    ~font_face();
+
+    glyph_rendering get_rendering() const { return rendering; }
+    uint64_t get_generation() const { return generation; }
+    const glyph_info & get_glyph(uint32_t codepoint);
 
-    font_face(sprite_sheet & sheet, const char * filepath, float pixel_height);
+    // Call f(const glyph_info & glyph, float pen_x) for each glyph of UTF-8 encoded text, with kerning applied to the pen positions. 
+    // Runs which were not laid out since the previous call to update(...) are discarded.
+    template<class F> void layout_text(std::string_view text, F f) 
+    { 
+        const auto & run = get_run(text);
+        for(size_t i=0; i<run.glyphs.size(); ++i) f(use_glyph(run.glyphs[i]), run.pen_x[i]);
+    }
+    float get_text_width(std::string_view text) { return get_run(text).advance; }
+
+    // Mark pages of the sheet, given by glyph_info::page, as drawn from during this frame, for callers which draw glyphs they cached
+    // earlier without laying out their text again
+    void touch_pages(const std::vector<uint32_t> & sheet_pages);
+
+    // Rasterize every glyph requested since the last call, across threads if provided, and write them into the sheet. Call once per
+    // frame, before drawing any text, and follow it with sheet.update(...) so that the new glyphs reach the GPU.
+    void update(thread_pool * threads=nullptr);
 };
 
 // gui_sprites rasterizes a collection of useful shapes into a sprite_sheet
@@ -63,26 +175,91 @@ struct gui_sprites
 };
 
 struct image_vertex { float2 position, texcoord; float4 color; };
+
+// gui_context writes one gui_quad instance per sprite, which the vertex shader expands from a unit quad. The rect is in pixels, the 
+// texcoords are 16-bit normalized, the color is 8-bit normalized RGBA, and the page selects the layer of the sprite atlas. Flags
+// select how the sprite is interpreted.
+struct gui_quad 
+{ 
+    short4 rect; ushort4 texcoords; byte4 color; uint16_t page, flags; 
+
+    static constexpr uint16_t signed_distance = 1;  // The sprite holds a signed distance field rather than coverage
+    static constexpr uint16_t shadow = 2;           // Draw a black shadow one pixel below and to the right, for signed distance fields only
+};
+
+// Combine the hashes of several values, such as the inputs which determine the contents of a GUI panel
+template<class... T> size_t hash_values(const T & ... values) 
+{ 
+    size_t h = 0;
+    ((h ^= std::hash<T>{}(values) + 0x9e3779b9 + (h << 6) + (h >> 2)), ...);
+    return h;
+}
+
+// gui_panel_cache retains the quads generated for each panel from frame to frame, keyed by a caller-chosen ID. Panels which were
+// not drawn during a frame are discarded at the start of the next frame.
+class gui_panel_cache
+{
+    struct panel 
+    { 
+        size_t input_hash; 
+        std::vector<gui_quad> quads; 
+        std::vector<std::pair<size_t, rect>> clips; // Each change of clip rect within the panel, and the index of the first quad it applies to
+        std::vector<std::pair<font_face *, std::vector<uint32_t>>> font_pages; // The sheet pages which each font's glyphs were drawn from
+        bool used; 
+    };
+    std::unordered_map<size_t, panel> panels;
+    friend struct gui_context;
+public:
+    size_t get_panel_count() const { return panels.size(); }
+};
+
+// gui_context clips quads to the rect on top of its clip stack. Quads which lie entirely outside of it are discarded as they are
+// drawn, and the rest are drawn in batches which share a clip rect, each with its own scissor rect, so that partially visible quads
+// are clipped by the GPU. Clip rects are in pixels, and are intersected with the clip rect below them on the stack.
 struct gui_context
 {
+    struct batch { rect clip; uint32_t first_quad; };
+
     gui_sprites & sprites;
     draw_list & list;
     uint2 dims;
     uint32_t num_quads;
+    gui_panel_cache * cache;
+    gui_panel_cache::panel * recording {};
+    size_t recording_clip_depth;
+    std::vector<rect> clip_stack;
+    std::vector<batch> batches;
 
-    gui_context(gui_sprites & sprites, draw_list & list, const uint2 & dims);
+    gui_context(gui_sprites & sprites, draw_list & list, const uint2 & dims, gui_panel_cache * cache=nullptr);
 
     void begin_frame();
 
+    // If a panel with this ID was drawn last frame from the same input hash, its cached quads are written and begin_panel(...) returns
+    // false, and the font pages its glyphs were drawn from count as used. Otherwise it returns true, and the caller should draw the 
+    // panel's contents and then call end_panel(). Without a cache, this always returns true. Panels may not be nested.
+    bool begin_panel(size_t id, size_t input_hash);
+    void end_panel();
+
+    // Every push_clip(...) must be matched by a pop_clip(), within the same panel if it was pushed within a panel
+    void push_clip(const rect & r);
+    void pop_clip();
+    const rect & get_clip() const { return clip_stack.back(); }
+    bool is_visible(const rect & r) const { return r.intersects(get_clip()); } // Callers can use this to skip whole widgets, such as the rows of a list
+    void set_clip(const rect & r); // Begin a new batch if r differs from the clip rect of the current batch
+
     void draw_sprite_sheet(const int2 & p);
-    void draw_sprite(const rect & r, float s0, float t0, float s1, float t1, const float4 & color);
+    void draw_sprite(const rect & r, uint32_t page, float s0, float t0, float s1, float t1, const float4 & color, uint16_t flags=0);
 
     void draw_rect(const rect & r, const float4 & color);
     void draw_rounded_rect(rect r, int radius, const float4 & color);
     void draw_partial_rounded_rect(rect r, int radius, const float4 & color, bool tl, bool tr, bool bl, bool br);
     
-    void draw_text(const font_face & font, const float4 & color, int x, int y, std::string_view text);
-    void draw_shadowed_text(const font_face & font, const float4 & color, int x, int y, std::string_view text);
+    // Text is UTF-8 encoded, and drawn at scale times the pixel height of the font
+    void draw_glyphs(font_face & font, const float4 & color, int x, int y, std::string_view text, float scale, uint16_t flags);
+    void draw_text(font_face & font, const float4 & color, int x, int y, std::string_view text, float scale=1);
+    void draw_shadowed_text(font_face & font, const float4 & color, int x, int y, std::string_view text, float scale=1);
+
+    // The material must use an instance rate vertex format of gui_quad, and the shaders which accompany example-rts, in assets/gui.vert
     void end_frame(const scene_material & mtl, const sampler & samp);
 };
 
@@ -0,0 +1,74 @@
+#include "thread-pool.h"
+
+thread_pool::thread_pool(size_t worker_count)
+{
+    for(size_t i=0; i<worker_count; ++i) workers.emplace_back([this]()
+    {
+        uint64_t last_generation = 0;
+        while(true)
+        {
+            {
+                std::unique_lock<std::mutex> lock {mutex};
+                work_ready.wait(lock, [&]() { return stopping || generation != last_generation; });
+                if(stopping) return;
+                last_generation = generation;
+            }
+            execute_tasks();
+        }
+    });
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for(auto & w : workers) w.join();
+}
+
+void thread_pool::execute_tasks()
+{
+    while(true)
+    {
+        size_t index;
+        {
+            std::lock_guard<std::mutex> lock {mutex};
+            if(next_task == task_count) return;
+            index = next_task++;
+        }
+
+        try { (*task)(index); }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock {mutex};
+            if(!error) error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock {mutex};
+        if(--tasks_remaining == 0) work_done.notify_all();
+    }
+}
+
+void thread_pool::run(size_t count, const std::function<void(size_t)> & task)
+{
+    if(count == 0) return;
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+        this->task = &task;
+        task_count = count;
+        next_task = 0;
+        tasks_remaining = count;
+        error = nullptr;
+        ++generation;
+    }
+    work_ready.notify_all();
+    execute_tasks();
+
+    std::unique_lock<std::mutex> lock {mutex};
+    work_done.wait(lock, [this]() { return tasks_remaining == 0; });
+    this->task = nullptr;
+    task_count = next_task = 0;
+    if(error) std::rethrow_exception(error);
+}
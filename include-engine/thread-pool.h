@@ -0,0 +1,37 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>               // For std::thread
+#include <mutex>                // For std::mutex
+#include <condition_variable>   // For std::condition_variable
+#include <functional>           // For std::function<T>
+#include <exception>            // For std::exception_ptr
+#include <vector>               // For std::vector<T>
+#include <algorithm>            // For std::max(...)
+
+// A thread_pool owns a fixed set of worker threads, which cooperate with the calling thread to execute batches of tasks
+class thread_pool
+{
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable work_ready, work_done;
+    const std::function<void(size_t)> * task {};
+    size_t task_count {}, next_task {}, tasks_remaining {};
+    uint64_t generation {};
+    bool stopping {};
+    std::exception_ptr error;
+
+    void execute_tasks();
+public:
+    explicit thread_pool(size_t worker_count = std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    ~thread_pool();
+
+    // Number of threads which participate in run(...), including the calling thread
+    size_t get_thread_count() const { return workers.size() + 1; }
+
+    // Invoke task(i) for every i in [0,count) and return once all have completed. Tasks may run in any order on any thread.
+    // If any task throws, the first exception is rethrown on the calling thread. Must not be called from within a task.
+    void run(size_t count, const std::function<void(size_t)> & task);
+};
+
+#endif
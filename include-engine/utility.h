@@ -1,6 +1,9 @@
 #ifndef UTILITY_H
 #define UTILITY_H
 
+#include <cstdint>      // For uint32_t
+#include <string_view>  // For std::string_view
+
 [[noreturn]] void fail_fast();
 
 template<class T> struct narrower
@@ -19,4 +22,29 @@ template<class T> narrower<T> narrow(const T & value)
     return {value}; 
 }
 
+// Remove the first code point from a UTF-8 encoded string and return it. Malformed sequences decode to U+FFFD, consuming one byte.
+inline uint32_t decode_utf8(std::string_view & text)
+{
+    const auto byte = [&](size_t i) { return static_cast<uint8_t>(text[i]); };
+    const uint8_t lead = byte(0);
+    const size_t length = lead < 0x80 ? 1 : (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : (lead & 0xF8) == 0xF0 ? 4 : 0;
+    uint32_t codepoint = length == 1 ? lead : length == 2 ? lead & 0x1F : length == 3 ? lead & 0x0F : lead & 0x07;
+    bool valid = length != 0 && length <= text.size();
+    for(size_t i=1; valid && i<length; ++i)
+    {
+        valid = (byte(i) & 0xC0) == 0x80;
+        codepoint = codepoint << 6 | (byte(i) & 0x3F);
+    }
+
+    // Reject overlong encodings, surrogates and values beyond the Unicode range
+    const uint32_t min_codepoint[] {0, 0, 0x80, 0x800, 0x10000};
+    if(!valid || codepoint < min_codepoint[length] || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+    {
+        text.remove_prefix(1);
+        return 0xFFFD;
+    }
+    text.remove_prefix(length);
+    return codepoint;
+}
+
 #endif